@@ -20,6 +20,21 @@ const EVENT_VOLUME = 0x01
 const EVENT_CHANNEL = 0x02
 const EVENT_RADIO_NAME = 0x05
 const EVENT_RADIO_TEXT = 0x06
+const EVENT_STATION = 0x07
+const EVENT_PRESET = 0x08
+const EVENT_PRESET_SAVE = 0x09
+const EVENT_TUNER = 0x0A
+const EVENT_RDS_PROVISIONAL = 0x0B
+const EVENT_RADIO_TEXT_PART = 0x0C
+const EVENT_PROTOCOL = 0x0D
+
+// Messages start with a 1-byte length in v1, with a 2-byte one in v2.
+// Events other than volume, channel and radio name/text are only sent
+// to v2 clients.
+const PROTOCOL_V1 = 1
+const PROTOCOL_V2 = 2
+
+const TEXT_PART_AB = 0x80
 
 // ===================================================================
 
@@ -28,37 +43,114 @@ export default class ServiceClient {
     actions
   } = {}) {
     this._socket = new Socket()
-    this._buf = new Buffer(128)
-    this._off = 0
+    this._buf = new Buffer(0)
+    this._protocol = PROTOCOL_V1
 
-    for (const attr of [ 'volume', 'channel', 'radioName', 'radioText' ]) {
+    for (const attr of [ 'volume', 'channel', 'radioName', 'radioText', 'provisional' ]) {
       if (actions[attr] === undefined) {
         actions[attr] = val => { console.log(`${attr}: '${val}'`) }
       }
     }
 
+    if (actions.station === undefined) {
+      actions.station = ({ channel, name }) => { console.log(`station: ${channel} '${name}'`) }
+    }
+
+    if (actions.radioTextPart === undefined) {
+      actions.radioTextPart = ({ start, text }) => { console.log(`radioTextPart ${start}: '${text}'`) }
+    }
+
+    if (actions.preset === undefined) {
+      actions.preset = ({ index, channel }) => { console.log(`preset ${index}: ${channel}`) }
+    }
+
     this._actions = actions
   }
 
   _parseMsg (buf) {
     let i = 0
+    let tuner = 0
     const { _actions: actions } = this
 
     while (i < buf.length) {
       const event = buf.readUInt8(i++)
 
+      // The following events of the message concern this tuner.
+      if (event === EVENT_TUNER) {
+        tuner = buf.readUInt8(i)
+        i++
+        continue
+      }
+
+      // Protocol used by the server from the next message.
+      if (event === EVENT_PROTOCOL) {
+        this._protocol = buf.readUInt8(i)
+        i++
+        continue
+      }
+
       if (event === EVENT_VOLUME) {
-        actions.volume(buf.readUInt8(i))
+        actions.volume(buf.readUInt8(i), tuner)
+        i++
+        continue
+      }
+
+      // The following radio name/text are the last known ones of the
+      // station, until its PI is received.
+      if (event === EVENT_RDS_PROVISIONAL) {
+        actions.provisional(buf.readUInt8(i) !== 0, tuner)
         i++
         continue
       }
 
       if (event === EVENT_CHANNEL) {
-        actions.channel(buf.readUInt16BE(i))
+        actions.channel(buf.readUInt16BE(i), tuner)
         i += 2
         continue
       }
 
+      if (event === EVENT_STATION) {
+        const len = buf.readUInt8(i + 5)
+
+        actions.station({
+          channel: buf.readUInt16BE(i),
+          rssi: buf.readUInt8(i + 2),
+          pi: buf.readUInt16BE(i + 3),
+          name: buf.slice(i + 6, i + 6 + len)
+        })
+
+        i += len + 6
+        continue
+      }
+
+      // Characters of the text being received, from the start position.
+      // A new A/B flag means a new text.
+      if (event === EVENT_RADIO_TEXT_PART) {
+        const pos = buf.readUInt8(i)
+        const len = buf.readUInt8(i + 1)
+
+        actions.radioTextPart({
+          ab: (pos & TEXT_PART_AB) !== 0,
+          start: pos & ~TEXT_PART_AB,
+          text: buf.slice(i + 2, i + 2 + len),
+          tuner
+        })
+
+        i += len + 2
+        continue
+      }
+
+      if (event === EVENT_PRESET) {
+        actions.preset({
+          index: buf.readUInt8(i),
+          channel: buf.readUInt16BE(i + 1),
+          tuner
+        })
+
+        i += 3
+        continue
+      }
+
       if (event !== EVENT_RADIO_NAME && event !== EVENT_RADIO_TEXT) {
         throw Error('Unknown event.')
       }
@@ -68,36 +160,43 @@ export default class ServiceClient {
       const radioData = buf.slice(start, start + len)
 
       if (event === EVENT_RADIO_NAME) {
-        actions.radioName(radioData)
+        actions.radioName(radioData, tuner)
       } else {
-        actions.radioText(radioData)
+        actions.radioText(radioData, tuner)
       }
 
       i += len + 1
     }
   }
 
+  // A chunk can hold many messages (the whole state is written at once
+  // when joining) and end with an incomplete one, kept for the next chunk.
   _onData (data) {
-    const { _buf: buf } = this
+    const buf = this._buf.length > 0 ? Buffer.concat([ this._buf, data ]) : data
+    let off = 0
 
-    data.copy(buf, this._off)
-    this._off += data.length
+    while (off < buf.length) {
+      const header = this._protocol === PROTOCOL_V2 ? 2 : 1
 
-    if (this._off >= buf.length) {
-      throw new Error('The buffer is full.')
-    }
+      if (buf.length - off < header) {
+        break
+      }
 
-    while (this._off > 0) {
-      const len = buf.readUInt8(0)
+      const len = header === 2 ? buf.readUInt16BE(off) : buf.readUInt8(off)
 
-      if (this._off >= len) {
-        this._parseMsg(buf.slice(1, len))
-        buf.copy(buf, 0, len)
-        this._off -= len
-      } else {
+      if (len < header) {
+        throw new Error('Malformed message length.')
+      }
+
+      if (buf.length - off < len) {
         break
       }
+
+      this._parseMsg(buf.slice(off + header, off + len))
+      off += len
     }
+
+    this._buf = buf.slice(off)
   }
 
   async _send (buf) {
@@ -125,22 +224,37 @@ export default class ServiceClient {
 
     this.endConnection = eventToPromise(socket, 'end')
     await eventToPromise(socket, 'connect')
+
+    // The protocol request is always sent in v1.
+    await this._send(new Buffer([ 3, EVENT_PROTOCOL, PROTOCOL_V2 ]))
+  }
+
+  // Requests of the first tuner are sent without EVENT_TUNER.
+  async _sendTo (tuner, data) {
+    const events = tuner === 0 ? data : [ EVENT_TUNER, tuner & 0xFF, ...data ]
+
+    if (this._protocol === PROTOCOL_V2) {
+      const len = events.length + 2
+      return this._send(new Buffer([ (len >> 8) & 0xFF, len & 0xFF, ...events ]))
+    }
+
+    return this._send(new Buffer([ events.length + 1, ...events ]))
   }
 
-  async setVolume (volume) {
-    return this._send(
-      new Buffer([ 0x03, EVENT_VOLUME, volume & 0xFF ])
-    )
+  async setVolume (volume, tuner = 0) {
+    return this._sendTo(tuner, [ EVENT_VOLUME, volume & 0xFF ])
   }
 
-  async setChannel (channel) {
-    const buf = new Buffer(4)
+  async setChannel (channel, tuner = 0) {
+    return this._sendTo(tuner, [ EVENT_CHANNEL, (channel >> 8) & 0xFF, channel & 0xFF ])
+  }
 
-    buf.writeUInt8(0x04, 0)
-    buf.writeUInt8(EVENT_CHANNEL, 1)
-    buf.writeUInt16BE(channel & 0xFFFF, 2)
+  async recallPreset (index, tuner = 0) {
+    return this._sendTo(tuner, [ EVENT_PRESET, index & 0xFF ])
+  }
 
-    return this._send(buf)
+  async savePreset (index, tuner = 0) {
+    return this._sendTo(tuner, [ EVENT_PRESET_SAVE, index & 0xFF ])
   }
 
   async waitEndConnection () {
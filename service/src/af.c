@@ -0,0 +1,180 @@
+/*
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "utils/ptime.h"
+
+#include "af.h"
+
+/* Gain min en dBuV d'une AF sur le channel réglé. */
+#define RSSI_MARGIN 6
+
+/* Mesure du RSSI d'une AF. */
+#define DWELL_SAMPLES 2
+#define DWELL_DELAY 1
+
+/* Attente en ms d'un block A correct pour vérifier le PI: plus de 2
+   groupes (87.6 ms par groupe). */
+#define PI_TIMEOUT 250
+#define PI_DELAY 10
+
+/* Durée max en ms d'une recherche. Une étape commencée est terminée:
+   le son peut être coupé jusqu'à AF_MUTE_MAX + PI_TIMEOUT + 2 tunes. */
+#define AF_MUTE_MAX 1000
+
+typedef struct Candidate {
+  int channel;
+  int rssi;
+} Candidate;
+
+/* --------------------------------------------------------------------- */
+
+/* Retourne -1 en cas d'échec, sinon le RSSI moyen du channel réglé. */
+static int __dwell (Fm_tuner *fm_tuner) {
+  int rssi, sum = 0;
+  int i;
+
+  for (i = 0; i < DWELL_SAMPLES; i++) {
+    if (i > 0)
+      sleep_m(DWELL_DELAY);
+
+    if ((rssi = fm_tuner_get_rssi(fm_tuner)) == -1)
+      return -1;
+
+    sum += rssi;
+  }
+
+  return sum / DWELL_SAMPLES;
+}
+
+/* Attend un PI lisible sur le channel réglé.
+   Retourne -1 en cas d'échec, 1 s'il est celui attendu, sinon 0. */
+static int __confirm_pi (Fm_tuner *fm_tuner, uint16_t pi) {
+  uint16_t blocks[RDS_BLOCKS_N];
+  uint8_t bler[RDS_BLOCKS_N];
+  int state;
+  Time start, cur;
+
+  time_get_cur(&start);
+
+  do {
+    if (fm_tuner_read_rds(fm_tuner, blocks, bler, &state) == -1)
+      return -1;
+
+    /* Un groupe déjà lu donne aussi le PI. */
+    if (state != FM_TUNER_RDS_NONE && bler[0] <= RDS_BLER_1_2)
+      return blocks[0] == pi;
+
+    sleep_m(PI_DELAY);
+    time_get_cur(&cur);
+  } while (time_diff(&start, &cur) < PI_TIMEOUT);
+
+  return 0;
+}
+
+/* Tri par RSSI décroissant. */
+static void __sort (Candidate *candidates, int n) {
+  Candidate candidate;
+  int i, j;
+
+  for (i = 1; i < n; i++) {
+    candidate = candidates[i];
+
+    for (j = i; j > 0 && candidates[j - 1].rssi < candidate.rssi; j--)
+      candidates[j] = candidates[j - 1];
+
+    candidates[j] = candidate;
+  }
+
+  return;
+}
+
+static inline int __timeout (Time *start) {
+  Time cur;
+
+  time_get_cur(&cur);
+
+  return time_diff(start, &cur) >= AF_MUTE_MAX;
+}
+
+int af_follow (Fm_tuner *fm_tuner, const Af_list *list, Af_result *result) {
+  Candidate candidates[RDS_AF_MAX];
+  int n = 0, ret = 0;
+  int channel, rssi, min_rssi;
+  int i;
+  Time start, end;
+
+  result->checked = 0;
+  result->mute_time = 0;
+
+  if ((channel = fm_tuner_get_channel(fm_tuner)) == -1 ||
+      (rssi = fm_tuner_get_rssi(fm_tuner)) == -1)
+    return -1;
+
+  result->channel = channel;
+  min_rssi = rssi + RSSI_MARGIN;
+
+  time_get_cur(&start);
+
+  if (fm_tuner_set_mute(fm_tuner, 1) == -1)
+    return -1;
+
+  /* Mesure de chaque AF. */
+  for (i = 0; i < list->n && !__timeout(&start); i++) {
+    if (list->channels[i] == channel)
+      continue;
+
+    if (fm_tuner_set_channel(fm_tuner, list->channels[i]) == -1 || (rssi = __dwell(fm_tuner)) == -1)
+      goto err;
+
+    result->checked++;
+
+    if (rssi >= min_rssi) {
+      candidates[n].channel = list->channels[i];
+      candidates[n++].rssi = rssi;
+    }
+  }
+
+  /* La meilleure AF qui diffuse le bon PI est gardée. */
+  __sort(candidates, n);
+
+  for (i = 0; i < n && !__timeout(&start); i++) {
+    if (fm_tuner_set_channel(fm_tuner, candidates[i].channel) == -1 ||
+        (ret = __confirm_pi(fm_tuner, list->pi)) == -1)
+      goto err;
+
+    if (ret) {
+      result->channel = candidates[i].channel;
+      break;
+    }
+  }
+
+  if (!ret && fm_tuner_set_channel(fm_tuner, channel) == -1)
+    goto err;
+
+  if (fm_tuner_set_mute(fm_tuner, 0) == -1)
+    return -1;
+
+  time_get_cur(&end);
+  result->mute_time = time_diff(&start, &end);
+
+  return ret;
+
+ err:
+  /* Retour sur le channel de départ, le son rétabli. */
+  fm_tuner_set_channel(fm_tuner, channel);
+  fm_tuner_set_mute(fm_tuner, 0);
+
+  return -1;
+}
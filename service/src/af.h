@@ -0,0 +1,44 @@
+/*
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _AF_H_
+#define _AF_H_
+
+#include <stdint.h>
+
+#include "fm_tuner.h"
+
+/* Fréquences alternatives d'une station. */
+typedef struct Af_list {
+  uint16_t pi;
+  int channels[RDS_AF_MAX];
+  int n;
+} Af_list;
+
+/* Résultat d'un changement de fréquence. */
+typedef struct Af_result {
+  int channel; /* Channel final, celui de départ si aucune AF n'est gardée. */
+  int checked; /* Fréquences mesurées. */
+  long mute_time; /* Durée en ms sans son. */
+} Af_result;
+
+/* Cherche une fréquence alternative meilleure que le channel réglé:
+   chaque AF est mesurée brièvement, puis les meilleures sont réglées
+   jusqu'à ce que l'une d'elles diffuse le PI de la liste. Le son est
+   coupé pendant la recherche, qui est abandonnée après AF_MUTE_MAX ms.
+   Retourne -1 en cas d'échec, 0 si le channel n'a pas changé, sinon 1. */
+int af_follow (Fm_tuner *fm_tuner, const Af_list *list, Af_result *result);
+
+#endif /* _AF_H_ INCLUDED */
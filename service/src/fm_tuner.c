@@ -15,6 +15,7 @@
 
 #include <arpa/inet.h>
 #include <stdio.h>
+#include <unistd.h>
 
 #include "hw/i2c.h"
 #include "hw/pin.h"
@@ -38,6 +39,10 @@
 /* Taille en bytes d'un registre du tuner. */
 #define FM_TUNER_REGISTER_SIZE 2
 
+/* Taille en bytes d'une lecture/écriture complète des registres. */
+#define FM_TUNER_READ_SIZE (FM_TUNER_REGISTERS_N * FM_TUNER_REGISTER_SIZE)
+#define FM_TUNER_WRITE_SIZE (6 * FM_TUNER_REGISTER_SIZE)
+
 /* Registres du tuner. */
 #define REG_DEVICEID 0x00
 #define REG_CHIPID  0x01
@@ -56,20 +61,53 @@
 #define REG_RDSC 0x0E
 #define REG_RDSD 0x0F
 
+/* Bit d'un registre dans les masques dirty/cached. */
+#define REG_BIT(REG) (1 << (REG))
+
+/* Le tuner se lit de 0x0A à 0x0F puis de 0x00 à 0x09: position d'un
+   registre dans cet ordre. Documentation: "doc/Si4702-03-C19-1.pdf", page 18. */
+#define READ_INDEX(REG) (((REG) - REG_STATUSRSSI + FM_TUNER_REGISTERS_N) % FM_TUNER_REGISTERS_N)
+
+/* Registres modifiés par le tuner lui-même: ils ne sont jamais servis
+   depuis le cache. Les autres ne changent que lorsqu'on les écrit. */
+#define VOLATILE_REGISTERS (REG_BIT(REG_STATUSRSSI) | REG_BIT(REG_READCHAN) | \
+                            REG_BIT(REG_RDSA) | REG_BIT(REG_RDSB) |            \
+                            REG_BIT(REG_RDSC) | REG_BIT(REG_RDSD))
+
 #define MASK_CHANNEL 0x03FF
 #define MASK_DE_EMPHASIS 0x0800
+#define MASK_DISABLE 0x0040
+#define MASK_DMUTE 0x4000
+#define MASK_ENABLE 0x0001
+#define MASK_FIRMWARE 0x003F
 #define MASK_ENABLE_RDS 0x1000
+#define MASK_GPIO2 0x000C
+#define MASK_RDSIEN 0x8000
+#define MASK_RDSM 0x0800
+#define MASK_RDSPRF 0x0200
 #define MASK_RSSI 0x00FF
 #define MASK_SEEK 0x0100
 #define MASK_SEEKUP 0x0200
 #define MASK_SFBL 0x2000
 #define MASK_SKMODE 0x0400
 #define MASK_SPACE_EUROPE 0x0010
+#define MASK_ST 0x0100
 #define MASK_STC 0x4000
+#define MASK_STCIEN 0x4000
 #define MASK_TEST_RDS 0x8000
 #define MASK_TUNE 0x8000
 #define MASK_VOLUME 0x000F
+#define MASK_XOSCEN 0x8000
 
+/* Erreurs des blocks RDS, en mode verbose. */
+#define BIT_BLERA 9
+#define BIT_BLERB 14
+#define BIT_BLERC 12
+#define BIT_BLERD 10
+#define MASK_BLER 0x0003
+
+#define VAL_DEVICEID 0x1242
+#define VAL_GPIO2_INTERRUPT 0x0004
 #define VAL_OSCILLATOR 0x8100
 #define VAL_POWER_ON 0x4001
 #define VAL_POWER_OFF 0x0041
@@ -77,20 +115,172 @@
 #define STC_DISABLED 0
 #define STC_ENABLED 1
 
+/* Etats des opérations asynchrones (tune/seek).
+   IDLE -> TUNE/SEEK: TUNE/SEEK écrit, attente de STC = 1.
+   TUNE/SEEK -> END: TUNE/SEEK remis à 0, attente de STC = 0.
+   END -> IDLE: opération terminée. */
+#define ASYNC_IDLE 0
+#define ASYNC_TUNE 1
+#define ASYNC_SEEK 2
+#define ASYNC_END 3
+
 struct Fm_tuner {
   int bus;
-  uint16_t regs[FM_TUNER_REGISTERS_N];
+  int gpio2; /* Descripteur du pin GPIO2 ou -1. */
+  uint16_t regs[FM_TUNER_REGISTERS_N]; /* Copie locale des registres. */
+  uint16_t dirty; /* Registres modifiés localement mais pas encore écrits. */
+  uint16_t cached; /* Registres dont la copie locale est à jour. */
+  Fm_tuner_stats stats;
+  int op; /* Opération en cours, FM_TUNER_OP_*. */
+  int keep_powered; /* Pas de power down à la libération. */
+  int rds_read; /* Groupe signalé par RDSR déjà lu. */
+
+  /* Opération asynchrone en cours. */
+  int async_state;
+  int async_success;
 };
 
+/* Met à jour les bits de mask d'un registre local et le marque
+   comme modifié si sa valeur change. */
+static inline void __update_register (Fm_tuner *fm_tuner, int reg, uint16_t mask, uint16_t value) {
+  uint16_t new_value = (fm_tuner->regs[reg] & ~mask) | (value & mask);
+
+  if (new_value != fm_tuner->regs[reg]) {
+    fm_tuner->regs[reg] = new_value;
+    fm_tuner->dirty |= REG_BIT(reg);
+  }
+
+  return;
+}
+
+static inline void __set_register (Fm_tuner *fm_tuner, int reg, uint16_t value) {
+  __update_register(fm_tuner, reg, 0xFFFF, value);
+  return;
+}
+
 static inline void __set_volume(Fm_tuner *fm_tuner, int volume) {
   /* Suppose que volume est dans l'intervalle
      [ FM_TUNER_VOLUME_MIN, FM_TUNER_VOLUME_MAX ]. */
-  fm_tuner->regs[REG_SYSCONFIG2] &= ~MASK_VOLUME;
-  fm_tuner->regs[REG_SYSCONFIG2] |= volume;
+  __update_register(fm_tuner, REG_SYSCONFIG2, MASK_VOLUME, volume);
+  return;
+}
 
+/* Début d'un appel de l'API: les accès au bus suivants lui sont comptés. */
+static inline void __enter (Fm_tuner *fm_tuner, int op) {
+  fm_tuner->op = op;
+  fm_tuner->stats.ops[op].calls++;
   return;
 }
 
+/* Ecrit les registres modifiés si write est non nul, puis lit les registres
+   dans l'ordre 0x0A, 0x0B... en s'arrêtant au registre last (inclus), sauf
+   si last vaut -1. L'écriture et la lecture forment une seule transaction
+   lorsque l'adaptateur le permet.
+   Documentation: "doc/Si4702-03-C19-1.pdf", pages 18 et 19.
+   Retourne -1 en cas d'échec, sans l'afficher, sinon 0. */
+static int __try_transfer_registers (Fm_tuner *fm_tuner, int write, int last) {
+  Fm_tuner_op_stats *op_stats = &fm_tuner->stats.ops[fm_tuner->op];
+  uint16_t out[FM_TUNER_WRITE_SIZE / FM_TUNER_REGISTER_SIZE];
+  uint16_t in[FM_TUNER_REGISTERS_N];
+  I2c_msg msgs[2];
+  int n_msgs = 0, n_out = 0, n_in = 0;
+  int last_write = -1;
+  int i, reg, syscalls;
+
+  /* L'écriture commence toujours en 0x02 et s'arrête au dernier
+     registre modifié (au plus 0x07). */
+  if (write) {
+    for (last_write = REG_TEST1; last_write >= REG_POWERCFG &&
+           !(fm_tuner->dirty & REG_BIT(last_write)); last_write--);
+
+    for (reg = REG_POWERCFG; reg <= last_write; reg++)
+      out[n_out++] = htons(fm_tuner->regs[reg]);
+
+    if (n_out > 0)
+      msgs[n_msgs++] = (I2c_msg){ I2C_MSG_WRITE, out, n_out * FM_TUNER_REGISTER_SIZE };
+
+    fm_tuner->stats.bytes_saved += FM_TUNER_WRITE_SIZE - n_out * FM_TUNER_REGISTER_SIZE;
+  }
+
+  if (last != -1) {
+    n_in = READ_INDEX(last) + 1;
+    msgs[n_msgs++] = (I2c_msg){ I2C_MSG_READ, in, n_in * FM_TUNER_REGISTER_SIZE };
+  }
+
+  if (n_msgs == 0)
+    return 0;
+
+  if ((syscalls = i2c_transfer(fm_tuner->bus, msgs, n_msgs)) == -1)
+    return -1;
+
+  op_stats->syscalls += syscalls;
+  op_stats->messages += n_msgs;
+
+  if (n_out > 0) {
+    fm_tuner->stats.writes++;
+    fm_tuner->stats.bytes_written += n_out * FM_TUNER_REGISTER_SIZE;
+    fm_tuner->dirty &= ~((REG_BIT(last_write + 1) - 1) & ~(REG_BIT(REG_POWERCFG) - 1));
+  }
+
+  if (n_in == 0)
+    return 0;
+
+  fm_tuner->stats.reads++;
+  fm_tuner->stats.bytes_read += n_in * FM_TUNER_REGISTER_SIZE;
+  fm_tuner->stats.bytes_saved += FM_TUNER_READ_SIZE - n_in * FM_TUNER_REGISTER_SIZE;
+
+  /* Attention: données en entrée en big-endian !
+     Les registres modifiés localement ne sont pas écrasés. */
+  for (i = 0; i < n_in; i++) {
+    reg = (REG_STATUSRSSI + i) % FM_TUNER_REGISTERS_N;
+
+    if (!(fm_tuner->dirty & REG_BIT(reg)))
+      fm_tuner->regs[reg] = ntohs(in[i]);
+
+    fm_tuner->cached |= REG_BIT(reg);
+  }
+
+  /* RDSR reste actif au moins 40 ms après chaque groupe: le groupe
+     suivant n'est attendu qu'après une lecture de RDSR inactif. */
+  if (!(fm_tuner->regs[REG_STATUSRSSI] & MASK_TEST_RDS))
+    fm_tuner->rds_read = 0;
+
+  return 0;
+}
+
+static int __transfer_registers (Fm_tuner *fm_tuner, int write, int last) {
+  if (__try_transfer_registers(fm_tuner, write, last) == -1)
+    return error("Unable to transfer registers.");
+
+  return 0;
+}
+
+static inline int __write_registers (Fm_tuner *fm_tuner) {
+  return __transfer_registers(fm_tuner, 1, -1);
+}
+
+/* Met à jour les registres de mask. Seuls les registres volatiles ou
+   absents du cache sont relus, et la lecture s'arrête au dernier
+   d'entre eux dans l'ordre de lecture du tuner.
+   Retourne -1 en cas d'échec, sinon 0. */
+static int __fetch_registers (Fm_tuner *fm_tuner, uint16_t mask) {
+  uint16_t needed = mask & (VOLATILE_REGISTERS | ~fm_tuner->cached);
+  int last = -1;
+  int reg;
+
+  for (reg = 0; reg < FM_TUNER_REGISTERS_N; reg++)
+    if ((needed & REG_BIT(reg)) && (last == -1 || READ_INDEX(reg) > READ_INDEX(last)))
+      last = reg;
+
+  /* Tout est déjà en cache. */
+  if (last == -1) {
+    fm_tuner->stats.bytes_saved += FM_TUNER_READ_SIZE;
+    return 0;
+  }
+
+  return __transfer_registers(fm_tuner, 0, last);
+}
+
 static inline int __get_channel (Fm_tuner *fm_tuner) {
   int channel = fm_tuner->regs[REG_READCHAN] & MASK_CHANNEL;
 
@@ -101,26 +291,82 @@ static inline int __get_channel (Fm_tuner *fm_tuner) {
   return channel + FM_TUNER_CHANNEL_START;
 }
 
-static int __wait_stc (Fm_tuner *fm_tuner, int status) {
-  for (;;) {
-    if (fm_tuner_read_registers(fm_tuner) == -1)
-      return -1;
-    if (!!(fm_tuner->regs[REG_STATUSRSSI] & MASK_STC) == status)
-      break;
-
+/* Attend un possible changement de STC: interruption GPIO2
+   si elle est disponible, sinon 1ms. */
+static void __wait_stc_event (Fm_tuner *fm_tuner, int status) {
+  /* GPIO2 n'est activé qu'à la montée de STC, la descente est
+     toujours attendue par polling. */
+  if (fm_tuner->gpio2 == -1 || status != STC_ENABLED) {
     sleep_m(1);
+    return;
   }
 
+  switch (pin_wait_edge(fm_tuner->gpio2, FM_TUNER_GPIO2_TIMEOUT)) {
+    case 1:
+      fm_tuner->stats.stc_wakeups++;
+      break;
+    case 0:
+      fm_tuner->stats.stc_timeouts++;
+      break;
+    default:
+      error("Unable to wait GPIO2, polling mode enabled.");
+      close(fm_tuner->gpio2);
+      fm_tuner->gpio2 = -1;
+  }
+
+  return;
+}
+
+/* Lit le bit STC, après avoir écrit les registres modifiés si write
+   est non nul. READCHAN est relu dans la même transaction.
+   Retourne -1 en cas d'échec, sinon la valeur du bit. */
+static int __read_stc (Fm_tuner *fm_tuner, int write) {
+  fm_tuner->stats.stc_polls++;
+
+  if (__transfer_registers(fm_tuner, write, REG_READCHAN) == -1)
+    return -1;
+
+  return !!(fm_tuner->regs[REG_STATUSRSSI] & MASK_STC);
+}
+
+/* Documentation: "doc/AN230.pdf", page 11. */
+static int __open_gpio2 (Fm_tuner *fm_tuner, int pin) {
+  if (pin < 0)
+    return 0;
+
+  if (pin_open(pin) == -1 ||
+      pin_set_direction(pin, PIN_IN) == -1 ||
+      pin_set_edge(pin, PIN_EDGE_FALLING) == -1 ||
+      (fm_tuner->gpio2 = pin_open_value(pin)) == -1)
+    return error("Unable to use the %d pin for GPIO2, polling mode enabled.", pin);
+
   return 0;
 }
 
-/* Documentation: "doc/AN230.pdf", page 12. */
-static int __fm_tuner_init (Fm_tuner *fm_tuner, Fm_tuner_conf *conf) {
+/* Ajoute la durée d'une phase de l'init depuis start, puis
+   fait démarrer la phase suivante maintenant. */
+static void __end_init_phase (Fm_tuner *fm_tuner, int phase, Time *start) {
+  Time cur;
+
+  time_get_cur(&cur);
+  fm_tuner->stats.init_times[phase] += time_diff_u(start, &cur);
+  *start = cur;
+
+  return;
+}
+
+/* Reset du tuner, SDIO au niveau bas pour choisir le bus 2 fils.
+   Un pin négatif n'est pas géré (tuner émulé par exemple).
+   Documentation: "doc/AN230.pdf", page 12. */
+static int __reset (Fm_tuner_conf *conf) {
   int pins[] = { conf->pin_rst, conf->pin_sdio };
   int i;
 
   /* Ouverture des pins en mode OUT et LOW. */
   for (i = 0; i < 2; i++) {
+    if (pins[i] < 0)
+      continue;
+
     if (pin_open(pins[i]) == -1)
       return error("Unable to open the %d pin.", pins[i]);
 
@@ -133,64 +379,156 @@ static int __fm_tuner_init (Fm_tuner *fm_tuner, Fm_tuner_conf *conf) {
 
   sleep_m(1);
 
-  /* Reset du tuner. */
-  if (pin_set_value(conf->pin_rst, PIN_HIGH) == -1)
+  if (conf->pin_rst >= 0 && pin_set_value(conf->pin_rst, PIN_HIGH) == -1)
     return error("Unable to reset the fm tuner.");
 
   sleep_m(1);
 
+  return 0;
+}
+
+/* Garde le pin de reset au niveau haut: un tuner en marche n'est pas
+   remis à zéro. SDIO n'est lu par le tuner qu'au reset. */
+static int __keep_running (Fm_tuner_conf *conf) {
+  if (conf->pin_rst < 0)
+    return 0;
+
+  if (pin_open(conf->pin_rst) == -1 || pin_set_direction(conf->pin_rst, PIN_OUT_HIGH) == -1)
+    return error("Unable to keep the %d pin high.", conf->pin_rst);
+
+  return 0;
+}
+
+/* Vrai si les registres lus sont ceux d'un tuner alimenté dont
+   l'oscillateur tourne: le firmware n'est connu qu'après le power up.
+   Documentation: "doc/Si4702-03-C19-1.pdf", pages 22 et 26. */
+static inline int __is_running (Fm_tuner *fm_tuner) {
+  const uint16_t *regs = fm_tuner->regs;
+
+  return regs[REG_DEVICEID] == VAL_DEVICEID &&
+    (regs[REG_CHIPID] & MASK_FIRMWARE) != 0 &&
+    (regs[REG_POWERCFG] & (MASK_ENABLE | MASK_DISABLE)) == MASK_ENABLE &&
+    (regs[REG_TEST1] & MASK_XOSCEN);
+}
+
+/* Documentation: "doc/AN230.pdf", page 12. */
+static int __fm_tuner_init (Fm_tuner *fm_tuner, Fm_tuner_conf *conf) {
+  int warm = 0;
+  Time start;
+
+  fm_tuner->gpio2 = -1;
+  fm_tuner->keep_powered = conf->warm_start;
+
+  time_get_cur(&start);
+
+  if ((conf->warm_start ? __keep_running(conf) : __reset(conf)) == -1)
+    return -1;
+
+  __end_init_phase(fm_tuner, FM_TUNER_INIT_RESET, &start);
+  __enter(fm_tuner, FM_TUNER_OP_OTHER);
+
   /* Accès au bus. */
   if ((fm_tuner->bus = i2c_open(conf->i2c_id, conf->tuner_addr)) == -1)
     return error("Unable to open the bus.");
 
-  if (fm_tuner_read_registers(fm_tuner) == -1)
-    goto err;
+  /* Un tuner gardé en reset ne répond pas: démarrage à froid, sans
+     erreur. */
+  if (conf->warm_start && __try_transfer_registers(fm_tuner, 0, REG_BOOTCONFIG) == 0)
+    warm = __is_running(fm_tuner);
 
-  /* Activation de l'oscillateur. */
-  fm_tuner->regs[REG_TEST1] = VAL_OSCILLATOR;
+  if (!warm) {
+    if (conf->warm_start) {
+      debug("Fm tuner is not running, cold start.\n");
+      __end_init_phase(fm_tuner, FM_TUNER_INIT_BUS, &start);
 
-  if (fm_tuner_write_registers(fm_tuner) == -1)
-    goto err;
+      if (__reset(conf) == -1)
+        goto err;
 
-  sleep_m(500);
+      __end_init_phase(fm_tuner, FM_TUNER_INIT_RESET, &start);
+    }
 
-  if (fm_tuner_read_registers(fm_tuner) == -1)
-    goto err;
+    if (__transfer_registers(fm_tuner, 0, REG_BOOTCONFIG) == -1)
+      goto err;
+  }
+
+  __end_init_phase(fm_tuner, FM_TUNER_INIT_BUS, &start);
+
+  if (!warm) {
+    /* Activation de l'oscillateur. */
+    __set_register(fm_tuner, REG_TEST1, VAL_OSCILLATOR);
+
+    if (__write_registers(fm_tuner) == -1)
+      goto err;
 
-  /* Power up. */
-  fm_tuner->regs[REG_POWERCFG] = VAL_POWER_ON;
+    sleep_m(500);
+
+    if (__transfer_registers(fm_tuner, 0, REG_BOOTCONFIG) == -1)
+      goto err;
+
+    __end_init_phase(fm_tuner, FM_TUNER_INIT_OSCILLATOR, &start);
+
+    /* Power up. */
+    __set_register(fm_tuner, REG_POWERCFG, VAL_POWER_ON);
+
+    /* Volume au minimum. */
+    __set_volume(fm_tuner, 0);
+  } else {
+    /* Channel et volume gardés, sauf un tune/seek laissé en cours. */
+    __update_register(fm_tuner, REG_POWERCFG, MASK_SEEK, 0);
+    __update_register(fm_tuner, REG_CHANNEL, MASK_TUNE, 0);
+  }
 
   #ifdef EUROPE_VERSION
-    fm_tuner->regs[REG_SYSCONFIG1] |= MASK_DE_EMPHASIS;
-    fm_tuner->regs[REG_SYSCONFIG2] |= MASK_SPACE_EUROPE;
+    __update_register(fm_tuner, REG_SYSCONFIG1, MASK_DE_EMPHASIS, MASK_DE_EMPHASIS);
+    __update_register(fm_tuner, REG_SYSCONFIG2, MASK_SPACE_EUROPE, MASK_SPACE_EUROPE);
   #endif
 
-  /* Activation RDS. */
-  fm_tuner->regs[REG_SYSCONFIG1] |= MASK_ENABLE_RDS;
+  /* Activation RDS, en mode verbose pour connaître les erreurs de chaque
+     block, et performances RDS améliorées. */
+  __update_register(fm_tuner, REG_SYSCONFIG1, MASK_ENABLE_RDS, MASK_ENABLE_RDS);
+  __update_register(fm_tuner, REG_POWERCFG, MASK_RDSM, MASK_RDSM);
+  __update_register(fm_tuner, REG_SYSCONFIG3, MASK_RDSPRF, MASK_RDSPRF);
+
+  /* Interruptions STC/RDS sur GPIO2. */
+  __open_gpio2(fm_tuner, conf->pin_gpio2);
 
-  /* Volume au minimum. */
-  __set_volume(fm_tuner, 0);
+  if (fm_tuner->gpio2 != -1)
+    __update_register(fm_tuner, REG_SYSCONFIG1, MASK_STCIEN | MASK_RDSIEN | MASK_GPIO2,
+                      MASK_STCIEN | MASK_RDSIEN | VAL_GPIO2_INTERRUPT);
 
-  if (fm_tuner_write_registers(fm_tuner) == -1)
+  if (__write_registers(fm_tuner) == -1)
     goto err;
 
-  sleep_m(110);
+  if (!warm)
+    sleep_m(110);
+
+  __end_init_phase(fm_tuner, FM_TUNER_INIT_POWER_UP, &start);
+  fm_tuner->stats.warm_start = warm;
+
   return 0;
 
  err:
+  if (fm_tuner->gpio2 != -1)
+    close(fm_tuner->gpio2);
+
   i2c_close(fm_tuner->bus);
   return -1;
 }
 
 /* Documentation: "doc/AN230.pdf", page 13. */
 static int __fm_tuner_close (Fm_tuner *fm_tuner) {
-  if (fm_tuner_read_registers(fm_tuner) == -1)
-    return -1;
+  __enter(fm_tuner, FM_TUNER_OP_OTHER);
 
-  fm_tuner->regs[REG_POWERCFG] = VAL_POWER_OFF;
+  /* Un tuner gardé alimenté permet le démarrage à chaud suivant. */
+  if (!fm_tuner->keep_powered) {
+    __set_register(fm_tuner, REG_POWERCFG, VAL_POWER_OFF);
 
-  if (fm_tuner_write_registers(fm_tuner) == -1)
-    return -1;
+    if (__write_registers(fm_tuner) == -1)
+      return -1;
+  }
+
+  if (fm_tuner->gpio2 != -1)
+    close(fm_tuner->gpio2);
 
   if (i2c_close(fm_tuner->bus) == -1)
     return error("Unable to close the bus.");
@@ -199,7 +537,7 @@ static int __fm_tuner_close (Fm_tuner *fm_tuner) {
 }
 
 Fm_tuner *fm_tuner_new (Fm_tuner_conf *conf) {
-  Fm_tuner *fm_tuner = pnew(Fm_tuner);
+  Fm_tuner *fm_tuner = pnew0(Fm_tuner);
 
   if (__fm_tuner_init(fm_tuner, conf) == -1)
     fatal_error("Unable to create a fm tuner.");
@@ -218,38 +556,21 @@ void fm_tuner_free (Fm_tuner *fm_tuner) {
 
 /* Documentation: "doc/Si4702-03-C19-1.pdf", page 19. */
 int fm_tuner_write_registers (Fm_tuner *fm_tuner) {
-  const ssize_t size = 6 * FM_TUNER_REGISTER_SIZE;
-  uint16_t regs[6];
-  int i, j;
-
-  /* Ecriture des registres 0x02 à 0x07. */
-  for (i = 0x02, j = 0; i <= 0x07; i++, j++)
-    regs[j] = htons(fm_tuner->regs[i]);
-
-  if (i2c_write(fm_tuner->bus, (void *)regs, size) != size)
-    return error("Unable to write registers.");
-
-  return 0;
+  __enter(fm_tuner, FM_TUNER_OP_OTHER);
+  return __write_registers(fm_tuner);
 }
 
 /* Documentation: "doc/Si4702-03-C19-1.pdf", page 18. */
 int fm_tuner_read_registers (Fm_tuner *fm_tuner) {
-  const ssize_t size = FM_TUNER_REGISTERS_N * FM_TUNER_REGISTER_SIZE;
-  uint16_t regs[FM_TUNER_REGISTERS_N];
-  int i, j;
+  __enter(fm_tuner, FM_TUNER_OP_OTHER);
 
   /* Lecture de tous les registres, de 0x0A à 0x0F puis de 0x00 à 0x09. */
-  if (i2c_read(fm_tuner->bus, (void *)regs, size) != size)
-    return error("Unable to read registers.");
-
-  /* Attention: données en entrée en big-endian ! */
-  for (i = 0x0A, j = 0; i <= 0x0F; i++, j++)
-    fm_tuner->regs[i] = ntohs(regs[j]);
-
-  for (i = 0x00; i <= 0x09; i++, j++)
-    fm_tuner->regs[i] = ntohs(regs[j]);
+  return __transfer_registers(fm_tuner, 0, REG_BOOTCONFIG);
+}
 
-  return 0;
+void fm_tuner_get_stats (Fm_tuner *fm_tuner, Fm_tuner_stats *stats) {
+  *stats = fm_tuner->stats;
+  return;
 }
 
 void fm_tuner_print_registers (Fm_tuner *fm_tuner) {
@@ -271,7 +592,9 @@ void fm_tuner_print_registers (Fm_tuner *fm_tuner) {
 
 /* Documentation: "doc/Si4702-03-C19-1.pdf", page 28. */
 int fm_tuner_set_volume (Fm_tuner *fm_tuner, int volume) {
-  if (fm_tuner_read_registers(fm_tuner) == -1)
+  __enter(fm_tuner, FM_TUNER_OP_VOLUME);
+
+  if (__fetch_registers(fm_tuner, REG_BIT(REG_SYSCONFIG2)) == -1)
     return -1;
 
   /* Clamping du volume. */
@@ -283,52 +606,89 @@ int fm_tuner_set_volume (Fm_tuner *fm_tuner, int volume) {
   /* Mise à jour du volume.*/
   __set_volume(fm_tuner, volume);
 
-  if (fm_tuner_write_registers(fm_tuner) == -1)
+  if (__write_registers(fm_tuner) == -1)
     return -1;
 
   return volume;
 }
 
+/* Documentation: "doc/Si4702-03-C19-1.pdf", page 26.
+   DMUTE à 1 désactive le mute. */
+int fm_tuner_set_mute (Fm_tuner *fm_tuner, int mute) {
+  __enter(fm_tuner, FM_TUNER_OP_VOLUME);
+
+  if (__fetch_registers(fm_tuner, REG_BIT(REG_POWERCFG)) == -1)
+    return -1;
+
+  __update_register(fm_tuner, REG_POWERCFG, MASK_DMUTE, mute ? 0 : MASK_DMUTE);
+
+  return __write_registers(fm_tuner);
+}
+
 /* Documentation: "doc/Si4702-03-C19-1.pdf", page 28. */
 int fm_tuner_get_volume (Fm_tuner *fm_tuner) {
-  if (fm_tuner_read_registers(fm_tuner) == -1)
+  __enter(fm_tuner, FM_TUNER_OP_VOLUME);
+
+  if (__fetch_registers(fm_tuner, REG_BIT(REG_SYSCONFIG2)) == -1)
     return -1;
 
   return fm_tuner->regs[REG_SYSCONFIG2] & MASK_VOLUME;
 }
 
-/* Documentation: "doc/AN230.pdf", page 22. */
-int fm_tuner_set_channel (Fm_tuner *fm_tuner, int channel) {
-  int rds_channel = channel - FM_TUNER_CHANNEL_START;
-
-  #ifdef AMERICAN_VERSION
-    rds_channel /= 2;
-  #endif
+/* Remet à 0 les bits TUNE/SEEK, le tuner remet alors STC à 0.
+   STC est relu dans la même transaction.
+   Retourne -1 en cas d'échec, sinon la valeur de STC. */
+static int __async_end (Fm_tuner *fm_tuner) {
+  int stc;
 
-  rds_channel &= MASK_CHANNEL;
+  __update_register(fm_tuner, REG_CHANNEL, MASK_TUNE, 0);
+  __update_register(fm_tuner, REG_POWERCFG, MASK_SEEK, 0);
 
-  if (fm_tuner_read_registers(fm_tuner) == -1)
+  if ((stc = __read_stc(fm_tuner, 1)) == -1)
     return -1;
 
-  /* Ecriture du channel choisi. */
-  fm_tuner->regs[REG_CHANNEL] &= ~MASK_CHANNEL;
-  fm_tuner->regs[REG_CHANNEL] |= rds_channel;
+  fm_tuner->async_state = ASYNC_END;
+  return stc;
+}
 
-  /* Mise à 1 du bit TUNE. */
-  fm_tuner->regs[REG_CHANNEL] |= MASK_TUNE;
+/* Attend la fin d'une opération asynchrone. */
+static int __async_wait (Fm_tuner *fm_tuner, int *channel, int *success) {
+  int ret;
 
-  if (fm_tuner_write_registers(fm_tuner) == -1)
-    return -1;
+  while ((ret = fm_tuner_async_poll(fm_tuner, channel, success)) == FM_TUNER_ASYNC_PENDING)
+    __wait_stc_event(fm_tuner, fm_tuner->async_state == ASYNC_END ? STC_DISABLED : STC_ENABLED);
 
-  /* On attend que le tune soit pris en compte. */
-  if (__wait_stc(fm_tuner, STC_ENABLED) == -1)
-    return -1;
+  return ret == -1 ? -1 : 0;
+}
+
+/* Termine une opération en cours avant d'en commencer une nouvelle. */
+static int __async_preempt (Fm_tuner *fm_tuner) {
+  int stc;
+
+  if (fm_tuner->async_state == ASYNC_IDLE)
+    return 0;
+
+  /* Une opération interrompue n'aboutit pas. */
+  if (fm_tuner->async_state != ASYNC_END) {
+    fm_tuner->async_success = 0;
+    stc = __async_end(fm_tuner);
+  }
+  else
+    stc = __read_stc(fm_tuner, 0);
 
-  /* Remise à 0 du bit TUNE. */
-  fm_tuner->regs[REG_CHANNEL] &= ~MASK_TUNE;
+  while (stc == STC_ENABLED) {
+    __wait_stc_event(fm_tuner, STC_DISABLED);
+    stc = __read_stc(fm_tuner, 0);
+  }
+
+  fm_tuner->async_state = ASYNC_IDLE;
+  return stc == -1 ? -1 : 0;
+}
 
-  if (fm_tuner_write_registers(fm_tuner) == -1 ||
-      __wait_stc(fm_tuner, STC_DISABLED) == -1)
+/* Documentation: "doc/AN230.pdf", page 22. */
+int fm_tuner_set_channel (Fm_tuner *fm_tuner, int channel) {
+  if (fm_tuner_tune_start(fm_tuner, channel) == -1 ||
+      __async_wait(fm_tuner, NULL, NULL) == -1)
     return -1;
 
   return channel;
@@ -336,7 +696,9 @@ int fm_tuner_set_channel (Fm_tuner *fm_tuner, int channel) {
 
 /* Documentation: "doc/AN230.pdf", page 22. */
 int fm_tuner_get_channel (Fm_tuner *fm_tuner) {
-  if (fm_tuner_read_registers(fm_tuner) == -1)
+  __enter(fm_tuner, FM_TUNER_OP_CHANNEL);
+
+  if (__fetch_registers(fm_tuner, REG_BIT(REG_READCHAN)) == -1)
     return -1;
 
   return __get_channel(fm_tuner);
@@ -344,62 +706,197 @@ int fm_tuner_get_channel (Fm_tuner *fm_tuner) {
 
 /* Documentation: "doc/AN230.pdf", page 20. */
 int fm_tuner_seek (Fm_tuner *fm_tuner, int direction, int *success) {
+  int channel;
+
   *success = 0;
 
-  if (fm_tuner_read_registers(fm_tuner) == -1)
+  if (fm_tuner_seek_start(fm_tuner, direction) == -1 ||
+      __async_wait(fm_tuner, &channel, success) == -1)
     return -1;
 
-  /* Ne pas sortir des limites de la bande. */
-  fm_tuner->regs[REG_POWERCFG] |= MASK_SKMODE;
+  return channel;
+}
 
-  /* Choix de la direction, NEXT ou PREV. */
-  if (direction)
-    fm_tuner->regs[REG_POWERCFG] |= MASK_SEEKUP;
-  else
-    fm_tuner->regs[REG_POWERCFG] &= ~MASK_SEEKUP;
+/* Documentation: "doc/AN230.pdf", page 22. */
+int fm_tuner_tune_start (Fm_tuner *fm_tuner, int channel) {
+  int rds_channel = channel - FM_TUNER_CHANNEL_START;
+
+  #ifdef AMERICAN_VERSION
+    rds_channel /= 2;
+  #endif
+
+  rds_channel &= MASK_CHANNEL;
+
+  __enter(fm_tuner, FM_TUNER_OP_TUNE);
+
+  if (__async_preempt(fm_tuner) == -1 ||
+      __fetch_registers(fm_tuner, REG_BIT(REG_CHANNEL)) == -1)
+    return -1;
 
-  /* Activation du seek. */
-  fm_tuner->regs[REG_POWERCFG] |= MASK_SEEK;
+  /* Ecriture du channel choisi et mise à 1 du bit TUNE. */
+  __update_register(fm_tuner, REG_CHANNEL, MASK_CHANNEL | MASK_TUNE, rds_channel | MASK_TUNE);
 
-  if (fm_tuner_write_registers(fm_tuner) == -1 ||
-      __wait_stc(fm_tuner, STC_ENABLED) == -1)
+  if (__write_registers(fm_tuner) == -1)
     return -1;
 
-  /* Indique si oui ou non le changement de station a pu se faire. */
-  *success = !(fm_tuner->regs[REG_STATUSRSSI] & MASK_SFBL);
+  fm_tuner->async_state = ASYNC_TUNE;
+  return 0;
+}
 
-  /* Reset du seek. */
-  fm_tuner->regs[REG_POWERCFG] &= ~MASK_SEEK;
+/* Documentation: "doc/AN230.pdf", page 20. */
+int fm_tuner_seek_start (Fm_tuner *fm_tuner, int direction) {
+  __enter(fm_tuner, FM_TUNER_OP_SEEK);
 
-  if (fm_tuner_write_registers(fm_tuner) == -1 ||
-      __wait_stc(fm_tuner, STC_DISABLED) == -1)
+  if (__async_preempt(fm_tuner) == -1 ||
+      __fetch_registers(fm_tuner, REG_BIT(REG_POWERCFG)) == -1)
     return -1;
 
-  return __get_channel(fm_tuner);
+  /* Ne pas sortir des limites de la bande, choix de la direction
+     (NEXT ou PREV) et activation du seek. */
+  __update_register(fm_tuner, REG_POWERCFG, MASK_SKMODE | MASK_SEEKUP | MASK_SEEK,
+                    MASK_SKMODE | (direction ? MASK_SEEKUP : 0) | MASK_SEEK);
+
+  if (__write_registers(fm_tuner) == -1)
+    return -1;
+
+  fm_tuner->async_state = ASYNC_SEEK;
+  return 0;
+}
+
+int fm_tuner_async_poll (Fm_tuner *fm_tuner, int *channel, int *success) {
+  int stc;
+
+  if (fm_tuner->async_state == ASYNC_IDLE)
+    return FM_TUNER_ASYNC_IDLE;
+
+  __enter(fm_tuner, FM_TUNER_OP_ASYNC);
+
+  if ((stc = __read_stc(fm_tuner, 0)) == -1)
+    goto err;
+
+  /* TUNE/SEEK en cours. */
+  if (fm_tuner->async_state != ASYNC_END) {
+    if (stc == STC_DISABLED)
+      return FM_TUNER_ASYNC_PENDING;
+
+    /* Indique si oui ou non le changement de station a pu se faire. */
+    fm_tuner->async_success = fm_tuner->async_state == ASYNC_TUNE ||
+      !(fm_tuner->regs[REG_STATUSRSSI] & MASK_SFBL);
+
+    if ((stc = __async_end(fm_tuner)) == -1)
+      goto err;
+  }
+
+  if (stc == STC_ENABLED)
+    return FM_TUNER_ASYNC_PENDING;
+
+  /* Opération terminée, READCHAN a été lu avec STC. */
+  fm_tuner->async_state = ASYNC_IDLE;
+
+  if (channel != NULL)
+    *channel = __get_channel(fm_tuner);
+  if (success != NULL)
+    *success = fm_tuner->async_success;
+
+  return FM_TUNER_ASYNC_DONE;
+
+ err:
+  fm_tuner->async_state = ASYNC_IDLE;
+  return -1;
+}
+
+int fm_tuner_async_cancel (Fm_tuner *fm_tuner) {
+  if (fm_tuner->async_state != ASYNC_TUNE && fm_tuner->async_state != ASYNC_SEEK)
+    return 0;
+
+  __enter(fm_tuner, FM_TUNER_OP_ASYNC);
+
+  /* Une opération interrompue n'aboutit pas. */
+  fm_tuner->async_success = 0;
+
+  return __async_end(fm_tuner) == -1 ? -1 : 0;
+}
+
+int fm_tuner_get_stc_fd (Fm_tuner *fm_tuner) {
+  /* GPIO2 n'est activé qu'à la montée de STC. */
+  if (fm_tuner->async_state != ASYNC_TUNE && fm_tuner->async_state != ASYNC_SEEK)
+    return -1;
+
+  return fm_tuner->gpio2;
+}
+
+void fm_tuner_ack_stc (Fm_tuner *fm_tuner, int received) {
+  if (fm_tuner->gpio2 == -1)
+    return;
+
+  if (!received) {
+    fm_tuner->stats.stc_timeouts++;
+    return;
+  }
+
+  if (pin_ack_edge(fm_tuner->gpio2) == -1) {
+    error("Unable to wait GPIO2, polling mode enabled.");
+    close(fm_tuner->gpio2);
+    fm_tuner->gpio2 = -1;
+    return;
+  }
+
+  fm_tuner->stats.stc_wakeups++;
+
+  return;
 }
 
 /* Documentation: "doc/AN230.pdf", page 12. */
-int fm_tuner_read_rds (Fm_tuner *fm_tuner, uint16_t blocks[static RDS_BLOCKS_N], int *data_exists) {
+int fm_tuner_read_rds (Fm_tuner *fm_tuner, uint16_t blocks[static RDS_BLOCKS_N],
+                       uint8_t bler[static RDS_BLOCKS_N], int *state) {
+  uint16_t status, readchan;
   int i;
 
-  if (fm_tuner_read_registers(fm_tuner) == -1)
+  __enter(fm_tuner, FM_TUNER_OP_RDS);
+
+  /* Lecture de 0x0A à 0x0F uniquement. */
+  if (__fetch_registers(fm_tuner, REG_BIT(REG_STATUSRSSI) | REG_BIT(REG_READCHAN) | REG_BIT(REG_RDSD)) == -1)
     return -1;
 
-  if (fm_tuner->regs[REG_STATUSRSSI] & MASK_TEST_RDS) {
+  status = fm_tuner->regs[REG_STATUSRSSI];
+  readchan = fm_tuner->regs[REG_READCHAN];
+
+  if (status & MASK_TEST_RDS) {
     for (i = 0; i < RDS_BLOCKS_N; i++)
       blocks[i] = fm_tuner->regs[REG_RDSA + i];
 
-    *data_exists = 1;
+    /* Erreurs de chaque block: BLERA dans STATUSRSSI, les autres dans READCHAN. */
+    bler[0] = (status >> BIT_BLERA) & MASK_BLER;
+    bler[1] = (readchan >> BIT_BLERB) & MASK_BLER;
+    bler[2] = (readchan >> BIT_BLERC) & MASK_BLER;
+    bler[3] = (readchan >> BIT_BLERD) & MASK_BLER;
+
+    *state = fm_tuner->rds_read ? FM_TUNER_RDS_ALREADY_READ : FM_TUNER_RDS_NEW;
+    fm_tuner->rds_read = 1;
   }
   else
-    *data_exists = 0;
+    *state = FM_TUNER_RDS_NONE;
 
   return 0;
 }
 
 int fm_tuner_get_rssi (Fm_tuner *fm_tuner) {
-  if (fm_tuner_read_registers(fm_tuner) == -1)
+  __enter(fm_tuner, FM_TUNER_OP_RSSI);
+
+  if (__fetch_registers(fm_tuner, REG_BIT(REG_STATUSRSSI)) == -1)
     return -1;
 
   return fm_tuner->regs[REG_STATUSRSSI] & MASK_RSSI;
 }
+
+int fm_tuner_get_signal (Fm_tuner *fm_tuner, int *rssi, int *stereo) {
+  __enter(fm_tuner, FM_TUNER_OP_RSSI);
+
+  if (__fetch_registers(fm_tuner, REG_BIT(REG_STATUSRSSI)) == -1)
+    return -1;
+
+  *rssi = fm_tuner->regs[REG_STATUSRSSI] & MASK_RSSI;
+  *stereo = !!(fm_tuner->regs[REG_STATUSRSSI] & MASK_ST);
+
+  return 0;
+}
@@ -29,30 +29,113 @@
 /* Valeur max du rssi donné par le tunner en dBuV. */
 #define FM_TUNER_RSSI_MAX 75
 
+/* Limites de la bande en 100 kHz et écart entre deux channels. */
 #define FM_TUNER_CHANNEL_START 875
+#define FM_TUNER_CHANNEL_END 1080
+
+#ifdef AMERICAN_VERSION
+  #define FM_TUNER_CHANNEL_SPACING 2
+#else
+  #define FM_TUNER_CHANNEL_SPACING 1
+#endif
+
+/* Etats retournés par fm_tuner_async_poll. */
+#define FM_TUNER_ASYNC_IDLE 0
+#define FM_TUNER_ASYNC_PENDING 1
+#define FM_TUNER_ASYNC_DONE 2
+
+/* Attente max en ms d'une interruption GPIO2 avant de relire le statut. */
+#define FM_TUNER_GPIO2_TIMEOUT 20
+
+/* Etats d'une lecture de fm_tuner_read_rds. */
+#define FM_TUNER_RDS_NONE 0
+#define FM_TUNER_RDS_NEW 1
+#define FM_TUNER_RDS_ALREADY_READ 2
 
 typedef struct Fm_tuner Fm_tuner;
 
 /* Configuration du tuner. */
 typedef struct Fm_tuner_conf {
-  /* Pins utilisés: /sys/class/gpio/gpioXX/ */
+  /* Pins utilisés: /sys/class/gpio/gpioXX/, ignorés s'ils sont négatifs. */
   int pin_sdio;
   int pin_rst;
 
+  /* Pin relié à GPIO2 du tuner, ou -1. S'il est défini, la fin des
+     tune/seek est attendue sur interruption plutôt que par polling. */
+  int pin_gpio2;
+
   /* Identifiant du bus relié au tuner. */
   int i2c_id;
 
   /* Adresse du tuner. */
   int tuner_addr;
+
+  /* Si non nul, un tuner déjà alimenté et réglé garde son état (channel,
+     volume): reset, oscillateur et power up sont évités. Le tuner reste
+     alors alimenté à sa libération. */
+  int warm_start;
 } Fm_tuner_conf;
 
+/* Opérations du tuner dont les accès au bus sont comptés séparément. */
+#define FM_TUNER_OP_OTHER 0 /* Init, close, lecture/écriture des registres. */
+#define FM_TUNER_OP_VOLUME 1
+#define FM_TUNER_OP_CHANNEL 2
+#define FM_TUNER_OP_TUNE 3
+#define FM_TUNER_OP_SEEK 4
+#define FM_TUNER_OP_ASYNC 5 /* fm_tuner_async_poll/cancel. */
+#define FM_TUNER_OP_RDS 6
+#define FM_TUNER_OP_RSSI 7
+#define FM_TUNER_OPS_N 8
+
+/* Phases de l'initialisation d'un tuner. */
+#define FM_TUNER_INIT_RESET 0 /* Pins et reset. */
+#define FM_TUNER_INIT_BUS 1 /* Ouverture du bus et lecture des registres. */
+#define FM_TUNER_INIT_OSCILLATOR 2
+#define FM_TUNER_INIT_POWER_UP 3
+#define FM_TUNER_INIT_PHASES_N 4
+
+/* Accès au bus d'une opération. */
+typedef struct Fm_tuner_op_stats {
+  unsigned long calls; /* Nombre d'appels de l'API. */
+  unsigned long syscalls;
+
+  /* Lectures et écritures sur le bus, combinées ou non
+     en une seule transaction I2C. */
+  unsigned long messages;
+} Fm_tuner_op_stats;
+
+/* Compteurs des transferts I2C d'un tuner. */
+typedef struct Fm_tuner_stats {
+  unsigned long reads; /* Nombre de lectures. */
+  unsigned long writes; /* Nombre d'écritures. */
+  unsigned long bytes_read;
+  unsigned long bytes_written;
+
+  /* Bytes non transférés par rapport à des lectures/écritures
+     complètes des registres grâce au cache. */
+  unsigned long bytes_saved;
+
+  /* Attente de STC: lectures du statut, réveils par interruption GPIO2
+     et timeouts de l'attente d'interruption. */
+  unsigned long stc_polls;
+  unsigned long stc_wakeups;
+  unsigned long stc_timeouts;
+
+  Fm_tuner_op_stats ops[FM_TUNER_OPS_N];
+
+  /* Démarrage à chaud et durées en µs des phases de l'initialisation. */
+  int warm_start;
+  long init_times[FM_TUNER_INIT_PHASES_N];
+} Fm_tuner_stats;
+
 /* Crée et donne l'accès à un tuner. */
 Fm_tuner *fm_tuner_new (Fm_tuner_conf *conf);
 
 /* Libère un tuner. */
 void fm_tuner_free (Fm_tuner *fm_tuner);
 
-/* Ecrit les registres contenus dans fm_tuner sur le tuner physique.
+/* Ecrit les registres modifiés de fm_tuner sur le tuner physique.
+   L'écriture commence en 0x02 et s'arrête au dernier registre modifié.
    Retourne -1 en cas d'échec, sinon 0. */
 int fm_tuner_write_registers (Fm_tuner *fm_tuner);
 
@@ -61,6 +144,9 @@ int fm_tuner_write_registers (Fm_tuner *fm_tuner);
    Retourne -1 en cas d'échec, sinon 0. */
 int fm_tuner_read_registers (Fm_tuner *fm_tuner);
 
+/* Copie les compteurs de transferts I2C d'un tuner dans stats. */
+void fm_tuner_get_stats (Fm_tuner *fm_tuner, Fm_tuner_stats *stats);
+
 /* Affiche le contenu des registres d'un tuner sur la
    sortie standard. */
 void fm_tuner_print_registers (Fm_tuner *fm_tuner);
@@ -70,6 +156,10 @@ void fm_tuner_print_registers (Fm_tuner *fm_tuner);
    Retourne -1 en cas d'échec, sinon le volume. */
 int fm_tuner_set_volume (Fm_tuner *fm_tuner, int volume);
 
+/* Coupe le son du tuner si mute est non nul, sinon le rétablit.
+   Retourne -1 en cas d'échec, sinon 0. */
+int fm_tuner_set_mute (Fm_tuner *fm_tuner, int mute);
+
 /* Donne la valeur actuelle du volume du tuner.
    Retourne -1 en cas d'échec, sinon le volume. */
 int fm_tuner_get_volume (Fm_tuner *fm_tuner);
@@ -88,13 +178,51 @@ int fm_tuner_get_channel (Fm_tuner *fm_tuner);
    sinon le channel. */
 int fm_tuner_seek (Fm_tuner *fm_tuner, int direction, int *success);
 
-/* Stocke dans blocks des données rds si elles existent.
-   Dans le cas où elles existent, data_exists vaut 1 sinon 0.
+/* Commence un changement de channel/de station sans attendre sa fin.
+   Une opération encore en cours est d'abord annulée.
+   Retourne -1 en cas d'échec, sinon 0. */
+int fm_tuner_tune_start (Fm_tuner *fm_tuner, int channel);
+int fm_tuner_seek_start (Fm_tuner *fm_tuner, int direction);
+
+/* Fait avancer l'opération commencée par fm_tuner_tune_start ou
+   fm_tuner_seek_start. Une fois terminée, channel et success
+   (s'ils ne sont pas NULL) reçoivent le channel et la réussite de
+   l'opération. Retourne -1 en cas d'échec, sinon FM_TUNER_ASYNC_IDLE,
+   FM_TUNER_ASYNC_PENDING ou FM_TUNER_ASYNC_DONE. */
+int fm_tuner_async_poll (Fm_tuner *fm_tuner, int *channel, int *success);
+
+/* Annule l'opération en cours. fm_tuner_async_poll doit encore être
+   appelé jusqu'à FM_TUNER_ASYNC_DONE.
    Retourne -1 en cas d'échec, sinon 0. */
-int fm_tuner_read_rds (Fm_tuner *fm_tuner, uint16_t blocks[static RDS_BLOCKS_N], int *data_exists);
+int fm_tuner_async_cancel (Fm_tuner *fm_tuner);
+
+/* Retourne le descripteur GPIO2 à surveiller (POLLPRI) pendant une
+   opération commencée par fm_tuner_tune_start ou fm_tuner_seek_start:
+   un front signale la fin du tune/seek. Retourne -1 sans pin GPIO2 ou
+   si aucun front n'est attendu, fm_tuner_async_poll doit alors être
+   appelé périodiquement. */
+int fm_tuner_get_stc_fd (Fm_tuner *fm_tuner);
+
+/* Acquitte l'attente sur le descripteur de fm_tuner_get_stc_fd: le front
+   reçu si received est non nul, sinon le timeout atteint. En cas
+   d'échec, GPIO2 n'est plus utilisé. */
+void fm_tuner_ack_stc (Fm_tuner *fm_tuner, int received);
+
+/* Stocke dans blocks des données rds si elles existent, et dans bler
+   les erreurs de chaque block (RDS_BLER_*). Seuls les registres 0x0A
+   à 0x0F sont lus.
+   state reçoit FM_TUNER_RDS_NONE sans données, FM_TUNER_RDS_NEW pour
+   un groupe lu pour la première fois, sinon FM_TUNER_RDS_ALREADY_READ.
+   Retourne -1 en cas d'échec, sinon 0. */
+int fm_tuner_read_rds (Fm_tuner *fm_tuner, uint16_t blocks[static RDS_BLOCKS_N],
+                       uint8_t bler[static RDS_BLOCKS_N], int *state);
 
 /* Retourne le RSSI actuel ou -1 en cas d'erreur.
    Max: 75dBuV. */
 int fm_tuner_get_rssi (Fm_tuner *fm_tuner);
 
+/* Donne le RSSI et l'indicateur stéréo, lus en une seule fois.
+   Retourne -1 en cas d'échec, sinon 0. */
+int fm_tuner_get_signal (Fm_tuner *fm_tuner, int *rssi, int *stereo);
+
 #endif /* _FM_TUNER_ INCLUDED */
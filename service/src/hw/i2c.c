@@ -13,7 +13,9 @@
   along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <errno.h>
 #include <fcntl.h>
+#include <linux/i2c.h>
 #include <linux/i2c-dev.h>
 #include <stdio.h>
 #include <sys/ioctl.h>
@@ -24,9 +26,20 @@
 #define BUFFER_SIZE 128
 #define PATH_I2C "/dev/i2c-"
 
+/* Nombre max de messages d'une transaction. */
+#define MSGS_MAX 8
+
+/* Descripteurs suivis par le backend /dev: au-delà, pas de I2C_RDWR. */
+#define DEV_FDS_MAX 64
+
+/* Adresse de l'adaptateur ouvert sur un descripteur (nécessaire à
+   I2C_RDWR), ou -1 si l'adaptateur ne gère pas les transactions. */
+static int dev_addrs[DEV_FDS_MAX];
+
 /* Documentation: https://www.kernel.org/doc/Documentation/i2c/dev-interface */
 
-int i2c_open (unsigned int bus_id, char addr) {
+static int __dev_open (unsigned int bus_id, char addr) {
+  unsigned long funcs;
   int fd;
   char filename[BUFFER_SIZE];
 
@@ -42,17 +55,100 @@ int i2c_open (unsigned int bus_id, char addr) {
     return -1;
   }
 
+  if (fd < DEV_FDS_MAX)
+    dev_addrs[fd] = (ioctl(fd, I2C_FUNCS, &funcs) != -1 && (funcs & I2C_FUNC_I2C)) ? addr : -1;
+
   return fd;
 }
 
-int i2c_close (int fd) {
+static int __dev_close (int fd) {
+  if (fd >= 0 && fd < DEV_FDS_MAX)
+    dev_addrs[fd] = -1;
+
   return close(fd);
 }
 
-ssize_t i2c_write (int fd, void *buf, size_t count) {
+static ssize_t __dev_write (int fd, void *buf, size_t count) {
   return write(fd, buf, count);
 }
 
-ssize_t i2c_read (int fd, void *buf, size_t count) {
+static ssize_t __dev_read (int fd, void *buf, size_t count) {
   return read(fd, buf, count);
 }
+
+static int __dev_transfer (int fd, I2c_msg *msgs, int n) {
+  struct i2c_msg dev_msgs[MSGS_MAX];
+  struct i2c_rdwr_ioctl_data data = { dev_msgs, n };
+  int i;
+
+  if (fd < 0 || fd >= DEV_FDS_MAX || dev_addrs[fd] == -1 || n > MSGS_MAX) {
+    errno = EOPNOTSUPP;
+    return -1;
+  }
+
+  for (i = 0; i < n; i++) {
+    dev_msgs[i].addr = dev_addrs[fd];
+    dev_msgs[i].flags = (msgs[i].type == I2C_MSG_READ) ? I2C_M_RD : 0;
+    dev_msgs[i].len = msgs[i].count;
+    dev_msgs[i].buf = msgs[i].buf;
+  }
+
+  if (ioctl(fd, I2C_RDWR, &data) != n)
+    return -1;
+
+  return 1;
+}
+
+static const I2c_backend dev_backend = {
+  .open = __dev_open,
+  .close = __dev_close,
+  .write = __dev_write,
+  .read = __dev_read,
+  .transfer = __dev_transfer
+};
+
+static const I2c_backend *backend = &dev_backend;
+
+/* --------------------------------------------------------------------- */
+
+void i2c_set_backend (const I2c_backend *new_backend) {
+  backend = (new_backend != NULL) ? new_backend : &dev_backend;
+  return;
+}
+
+int i2c_open (unsigned int bus_id, char addr) {
+  return backend->open(bus_id, addr);
+}
+
+int i2c_close (int fd) {
+  return backend->close(fd);
+}
+
+ssize_t i2c_write (int fd, void *buf, size_t count) {
+  return backend->write(fd, buf, count);
+}
+
+ssize_t i2c_read (int fd, void *buf, size_t count) {
+  return backend->read(fd, buf, count);
+}
+
+int i2c_transfer (int fd, I2c_msg *msgs, int n) {
+  ssize_t ret;
+  int i;
+
+  if (backend->transfer != NULL &&
+      ((ret = backend->transfer(fd, msgs, n)) != -1 || errno != EOPNOTSUPP))
+    return ret;
+
+  /* Adaptateur sans transactions: un appel par message. */
+  for (i = 0; i < n; i++) {
+    ret = (msgs[i].type == I2C_MSG_READ) ?
+      backend->read(fd, msgs[i].buf, msgs[i].count) :
+      backend->write(fd, msgs[i].buf, msgs[i].count);
+
+    if (ret != (ssize_t)msgs[i].count)
+      return -1;
+  }
+
+  return n;
+}
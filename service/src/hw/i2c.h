@@ -18,6 +18,34 @@
 
 #include <sys/types.h>
 
+/* Types des messages d'une transaction. */
+#define I2C_MSG_WRITE 0
+#define I2C_MSG_READ 1
+
+/* Message d'une transaction: count bytes à écrire depuis buf
+   ou à lire dans buf. */
+typedef struct I2c_msg {
+  int type;
+  void *buf;
+  size_t count;
+} I2c_msg;
+
+/* Implémentation d'un bus I2C. Chaque fonction a la même
+   sémantique que la fonction i2c_* correspondante.
+   transfer peut être NULL ou échouer avec errno = EOPNOTSUPP: les
+   messages sont alors envoyés un par un avec write/read. */
+typedef struct I2c_backend {
+  int (*open) (unsigned int bus_id, char addr);
+  int (*close) (int fd);
+  ssize_t (*write) (int fd, void *buf, size_t count);
+  ssize_t (*read) (int fd, void *buf, size_t count);
+  int (*transfer) (int fd, I2c_msg *msgs, int n);
+} I2c_backend;
+
+/* Change le backend utilisé par les fonctions i2c_*.
+   NULL remet le backend par défaut: /dev/i2c-(bus_id). */
+void i2c_set_backend (const I2c_backend *backend);
+
 /* Donne l'accès à un adaptateur I2C situé sur le
    bus /dev/i2c-(bus_id) à l'adresse (addr).
    Retourne -1 en cas d'échec, sinon 0. */
@@ -32,4 +60,10 @@ int i2c_close (int fd);
 ssize_t i2c_write (int fd, void *buf, size_t count);
 ssize_t i2c_read (int fd, void *buf, size_t count);
 
+/* Envoie n messages en une seule transaction (I2C_RDWR) si
+   l'adaptateur le permet, sinon un par un. Chaque message doit
+   être transféré en entier.
+   Retourne -1 en cas d'échec, sinon le nombre d'appels système. */
+int i2c_transfer (int fd, I2c_msg *msgs, int n);
+
 #endif /* _I2C_H_ INCLUDED */
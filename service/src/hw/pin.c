@@ -14,6 +14,7 @@
 */
 
 #include <fcntl.h>
+#include <poll.h>
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
@@ -21,13 +22,19 @@
 #include "pin.h"
 
 #define BUFFER_SIZE 128
-#define PATH_PIN_PREFIX "/sys/class/gpio/gpio"
-#define PATH_EXPORT "/sys/class/gpio/export"
+#define PATH_ROOT "/sys/class/gpio"
 
 /* Documentation: "doc/GPIO_Programming_on_the_Beaglebone.pdf" */
 
+static const char *root = PATH_ROOT;
+
+void pin_set_root (const char *path) {
+  root = (path != NULL) ? path : PATH_ROOT;
+  return;
+}
+
 static inline int __get_pin_directory (char *dest, int pin) {
-  return snprintf(dest, BUFFER_SIZE, PATH_PIN_PREFIX "%d/", pin & 0xFF);
+  return snprintf(dest, BUFFER_SIZE, "%s/gpio%d/", root, pin & 0xFF);
 }
 
 int pin_open (int pin) {
@@ -41,7 +48,8 @@ int pin_open (int pin) {
   if (!access(buf, F_OK))
     return 0;
 
-  if ((fd = open(PATH_EXPORT, O_WRONLY)) == -1)
+  if (snprintf(buf, BUFFER_SIZE, "%s/export", root) >= BUFFER_SIZE ||
+      (fd = open(buf, O_WRONLY)) == -1)
     return -1;
 
   if (write(fd, pin_s, sprintf(pin_s, "%d", pin & 0xFF)) == -1) {
@@ -72,10 +80,12 @@ static int __set_attribute (int pin, const char *attribute, const char *value) {
 }
 
 int pin_set_direction (int pin, int direction) {
-  if (direction != PIN_IN && direction != PIN_OUT)
+  static const char *directions[] = { "in", "out", "high" };
+
+  if (direction < PIN_IN || direction > PIN_OUT_HIGH)
     return -1;
 
-  return __set_attribute(pin, "direction", direction == PIN_IN ? "in" : "out");
+  return __set_attribute(pin, "direction", directions[direction]);
 }
 
 int pin_set_value (int pin, int value) {
@@ -84,3 +94,59 @@ int pin_set_value (int pin, int value) {
 
   return __set_attribute(pin, "value", value == PIN_LOW ? "0" : "1");
 }
+
+int pin_set_edge (int pin, int edge) {
+  static const char *edges[] = { "none", "rising", "falling", "both" };
+
+  if (edge < PIN_EDGE_NONE || edge > PIN_EDGE_BOTH)
+    return -1;
+
+  return __set_attribute(pin, "edge", edges[edge]);
+}
+
+int pin_open_value (int pin) {
+  char buf[BUFFER_SIZE];
+  int end = __get_pin_directory(buf, pin);
+  int fd;
+
+  if (end >= BUFFER_SIZE || snprintf(buf + end, BUFFER_SIZE - end, "value") >= BUFFER_SIZE - end)
+    return -1;
+
+  if ((fd = open(buf, O_RDONLY | O_NONBLOCK)) == -1)
+    return -1;
+
+  /* Le fichier est signalé POLLPRI dès son ouverture: une première
+     lecture acquitte cet événement, sinon le premier pin_wait_edge
+     retournerait sans attendre de front. */
+  if (pin_ack_edge(fd) == -1) {
+    close(fd);
+    return -1;
+  }
+
+  return fd;
+}
+
+/* Documentation: https://www.kernel.org/doc/Documentation/gpio/sysfs.txt */
+int pin_ack_edge (int fd) {
+  char value[2];
+
+  /* L'événement est acquitté en relisant la valeur depuis le début. */
+  if (lseek(fd, 0, SEEK_SET) == -1 || read(fd, value, sizeof value) == -1)
+    return -1;
+
+  return 0;
+}
+
+int pin_wait_edge (int fd, int timeout) {
+  struct pollfd pfd;
+  int ret;
+
+  pfd.fd = fd;
+  pfd.events = POLLPRI | POLLERR;
+  pfd.revents = 0;
+
+  if ((ret = poll(&pfd, 1, timeout)) <= 0)
+    return ret;
+
+  return pin_ack_edge(fd) == -1 ? -1 : 1;
+}
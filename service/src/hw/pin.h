@@ -16,15 +16,27 @@
 #ifndef _PIN_H_
 #define _PIN_H_
 
-/* Directions possibles d'un pin. */
+/* Directions possibles d'un pin. PIN_OUT_HIGH passe en sortie au
+   niveau haut sans passer par le niveau bas. */
 #define PIN_IN 0
 #define PIN_OUT 1
+#define PIN_OUT_HIGH 2
 
 /* Valeurs possibles d'un pin. */
 #define PIN_LOW 0
 #define PIN_HIGH 1
 
-/* Ouvre le répertoire sous /sys/class/gpio/gpioXX d'un pin
+/* Fronts pouvant déclencher un événement sur un pin en entrée. */
+#define PIN_EDGE_NONE 0
+#define PIN_EDGE_RISING 1
+#define PIN_EDGE_FALLING 2
+#define PIN_EDGE_BOTH 3
+
+/* Change le répertoire sysfs des pins (par défaut /sys/class/gpio).
+   Permet d'utiliser un faux répertoire sysfs. */
+void pin_set_root (const char *root);
+
+/* Ouvre le répertoire sous (root)/gpioXX d'un pin
    du BeagleBone.
    Retourne -1 en cas d'échec, sinon 0. */
 int pin_open (int pin);
@@ -37,4 +49,22 @@ int pin_set_direction (int pin, int direction);
    Retourne -1 en cas d'échec, sinon 0. */
 int pin_set_value (int pin, int value);
 
+/* Définit le front qui déclenche un événement sur un pin.
+   Retourne -1 en cas d'échec, sinon 0. */
+int pin_set_edge (int pin, int edge);
+
+/* Ouvre le fichier value d'un pin pour attendre ses événements.
+   Retourne -1 en cas d'échec, sinon un descripteur. */
+int pin_open_value (int pin);
+
+/* Acquitte l'événement signalé (POLLPRI) sur un descripteur obtenu par
+   pin_open_value, pour attendre ses événements avec poll.
+   Retourne -1 en cas d'échec, sinon 0. */
+int pin_ack_edge (int fd);
+
+/* Attend un événement sur un descripteur obtenu par pin_open_value
+   pendant au plus timeout millisecondes.
+   Retourne -1 en cas d'échec, 0 si le timeout est atteint, sinon 1. */
+int pin_wait_edge (int fd, int timeout);
+
 #endif /* _PIN_H_ INCLUDED */
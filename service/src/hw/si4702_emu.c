@@ -0,0 +1,752 @@
+/*
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../utils/ptime.h"
+
+#include "si4702_emu.h"
+
+/* Documentation: "doc/Si4702-03-C19-1.pdf" et "doc/AN230.pdf". */
+
+/* Nombre max de tuners émulés simultanément. */
+#define CHIPS_MAX 8
+
+/* Premier descripteur rendu par __emu_open, loin des vrais descripteurs. */
+#define FD_BASE 0x4000
+
+#define TUNER_ADDR 0x10
+
+#define REGISTERS_N 16
+
+#define REG_DEVICEID 0x00
+#define REG_CHIPID 0x01
+#define REG_POWERCFG 0x02
+#define REG_CHANNEL 0x03
+#define REG_SYSCONFIG1 0x04
+#define REG_SYSCONFIG2 0x05
+#define REG_SYSCONFIG3 0x06
+#define REG_TEST1 0x07
+#define REG_STATUSRSSI 0x0A
+#define REG_READCHAN 0x0B
+#define REG_RDSA 0x0C
+
+#define MASK_ENABLE 0x0001
+#define MASK_DISABLE 0x0040
+#define MASK_SEEK 0x0100
+#define MASK_SEEKUP 0x0200
+#define MASK_SKMODE 0x0400
+#define MASK_RDSM 0x0800
+#define MASK_TUNE 0x8000
+#define MASK_CHANNEL 0x03FF
+#define MASK_ENABLE_RDS 0x1000
+#define MASK_SEEKTH 0xFF00
+#define MASK_BAND 0x00C0
+#define MASK_SPACE 0x0030
+#define MASK_RDSR 0x8000
+#define MASK_STC 0x4000
+#define MASK_SFBL 0x2000
+#define MASK_RDSS 0x0800
+#define MASK_ST 0x0100
+#define MASK_RSSI 0x00FF
+
+#define BIT_SEEKTH 8
+#define BIT_BAND 6
+#define BIT_SPACE 4
+#define BIT_BLERA 9
+
+#define VAL_DEVICEID 0x1242
+#define VAL_CHIPID_OFF 0x1200
+#define VAL_CHIPID_ON 0x1253
+#define VAL_TEST1_RESET 0x0100
+
+/* Délais du vrai tuner en µs. */
+#define TUNE_DELAY 60000
+#define SEEK_STEP_DELAY 60000
+#define GROUP_PERIOD 87600
+#define RDSR_DURATION 40000
+
+/* Seuil de seek utilisé si SEEKTH vaut 0: le modèle n'émule pas
+   les seuils SNR/impulsions du vrai tuner. */
+#define DEFAULT_SEEKTH 20
+
+/* Un groupe sur EXTRA_PERIOD est un groupe diffusé rarement. */
+#define EXTRA_PERIOD 10
+
+#define RT_PLUS_AID 0x4BD7
+
+/* RSSI min pour décoder le RDS d'une station. */
+#define RDS_MIN_RSSI 15
+
+/* Le RSSI d'une station déborde sur les canaux à +/- 100 kHz. */
+#define NEIGHBOUR_WIDTH 10
+#define NEIGHBOUR_LOSS 25
+
+#define OP_NONE 0
+#define OP_TUNE 1
+#define OP_SEEK 2
+
+typedef struct Emu_chip {
+  char used;
+  unsigned int bus_id;
+  uint16_t regs[REGISTERS_N];
+
+  /* Tune/seek en cours. */
+  int op;
+  Time op_start;
+  long op_duration; /* En µs. */
+  int op_channel; /* Channel atteint à la fin de l'opération. */
+  int op_sfbl;
+
+  /* Réception RDS depuis la fin du dernier tune/seek. */
+  Time tuned_at;
+  unsigned long groups_read; /* Groupes lus en mode instantané. */
+  int rds_gap; /* RDSR inactif à la prochaine lecture en mode instantané. */
+} Emu_chip;
+
+static Si4702_emu_conf conf;
+static int conf_set;
+static Emu_chip chips[CHIPS_MAX];
+
+/* --------------------------------------------------------------------- */
+
+void si4702_emu_default_conf (Si4702_emu_conf *conf) {
+  static const Si4702_emu_station stations[] = {
+    { 879, 38, 1, 0xF203, 14, 0, 0, "FRCULTUR", "France Culture - L'esprit d'ouverture", { 935 }, 1 },
+    { 889, 52, 1, 0xF205, 15, 0, 0, "FIP", "FIP - Jazz & Co, en direct de la Maison de la Radio", { 0 }, 0 },
+    { 938, 48, 1, 0xF201, 1, 1, 0, "FRINTER", "France Inter - Le journal de 13h", { 1011 }, 1 },
+    { 978, 60, 1, 0xF208, 10, 0, 0, "MOUV", "Mouv' - Hip-hop", { 0 }, 0 },
+    { 1011, 35, 1, 0xF201, 1, 1, 0, "FRINTER", "France Inter - Le journal de 13h", { 938 }, 1 },
+    { 1043, 25, 0, 0x0000, 0, 0, 0, "", "", { 0 }, 0 },
+    { 1058, 42, 1, 0xF21A, 10, 0, 0, "NRJ", "NRJ - Hit Music Only", { 0 }, 0 }
+  };
+
+  memset(conf, 0, sizeof *conf);
+  conf->n_stations = sizeof stations / sizeof *stations;
+  memcpy(conf->stations, stations, sizeof stations);
+
+  return;
+}
+
+int si4702_emu_load_band (Si4702_emu_conf *conf, const char *filename) {
+  Si4702_emu_station *station;
+  FILE *file;
+  char line[256];
+  char afs[128];
+  char *p;
+  unsigned int pi;
+
+  if ((file = fopen(filename, "r")) == NULL)
+    return -1;
+
+  conf->n_stations = 0;
+
+  while (fgets(line, sizeof line, file) != NULL && conf->n_stations < SI4702_EMU_STATIONS_MAX) {
+    if (*line == '#' || *line == '\n')
+      continue;
+
+    station = &conf->stations[conf->n_stations];
+    memset(station, 0, sizeof *station);
+    *afs = '\0';
+
+    if (sscanf(line, "%d %d %x %d \"%8[^\"]\" \"%64[^\"]\" %127[0-9,]",
+               &station->channel, &station->rssi, &pi, &station->pty,
+               station->ps, station->rt, afs) < 6) {
+      fclose(file);
+      errno = EINVAL;
+      return -1;
+    }
+
+    station->pi = pi;
+    station->stereo = 1;
+
+    for (p = afs; *p != '\0' && station->n_af < SI4702_EMU_AF_MAX; p += (*p == ',')) {
+      station->af[station->n_af++] = strtol(p, &p, 10);
+
+      if (*p != ',' && *p != '\0')
+        break;
+    }
+
+    conf->n_stations++;
+  }
+
+  fclose(file);
+
+  return 0;
+}
+
+void si4702_emu_set_conf (const Si4702_emu_conf *new_conf) {
+  conf = *new_conf;
+  conf_set = 1;
+
+  return;
+}
+
+/* --------------------------------------------------------------------- */
+
+static inline uint32_t __hash (uint32_t x) {
+  x ^= x >> 16;
+  x *= 0x7FEB352D;
+  x ^= x >> 15;
+  x *= 0x846CA68B;
+  x ^= x >> 16;
+
+  return x;
+}
+
+static inline int __af_code (int channel) {
+  return (channel > 875 && channel < 875 + 205) ? channel - 875 : 205;
+}
+
+/* Groupes diffusés rarement: 3A annonçant RT+ en 11A, tags RT+ (artiste
+   et titre séparés par " - " dans le texte), puis TMC en 8A pour une
+   station TP ou 15B sinon. */
+static void __generate_extra_group (const Si4702_emu_station *station, unsigned long n, uint16_t blocks[static 4]) {
+  const char *dash = strstr(station->rt, " - ");
+  int artist_len, title_start, title_len;
+  uint32_t h;
+
+  switch (n % 3) {
+    case 0:
+      blocks[1] |= (3 << 12) | (11 << 1);
+      blocks[2] = 0x0000;
+      blocks[3] = RT_PLUS_AID;
+      break;
+
+    case 1:
+      /* Content types 4 (artiste) et 1 (titre). */
+      artist_len = dash != NULL ? dash - station->rt : 0;
+      title_start = dash != NULL ? artist_len + 3 : 0;
+
+      blocks[1] |= (11 << 12) | 0x0008;
+      blocks[2] = (4 << 13) | ((((artist_len > 0 ? artist_len : 1) - 1) & 0x3F) << 1);
+      title_len = strlen(station->rt) - title_start;
+      title_len = title_len < 1 ? 1 : (title_len > 32 ? 32 : title_len);
+      blocks[3] = (1 << 11) | (title_start << 5) | (title_len - 1);
+      break;
+
+    default:
+      if (station->tp) {
+        h = __hash(n ^ station->pi);
+        blocks[1] |= (8 << 12) | 0x0008;
+        blocks[2] = h & 0x07FF;
+        blocks[3] = h >> 16;
+      } else {
+        blocks[1] |= (15 << 12) | 0x0800 | (station->ta << 4) | (1 << 3);
+        blocks[3] = blocks[1];
+      }
+  }
+
+  return;
+}
+
+/* Documentation: "doc/RDS_Basics.pdf". */
+void si4702_emu_generate_group (const Si4702_emu_station *station, unsigned long n, uint16_t blocks[static 4]) {
+  uint8_t ps[8], rt[64];
+  int ps_len = strlen(station->ps);
+  int rt_len = strlen(station->rt);
+  int rt_segments = (rt_len == 64) ? 16 : (rt_len + 1 + 3) / 4;
+  int slot;
+  int i, k, n_pairs;
+  long mjd;
+  time_t t;
+  struct tm tm;
+
+  blocks[0] = station->pi;
+  blocks[1] = (station->tp << 10) | (station->pty << 5);
+
+  if (n % EXTRA_PERIOD == EXTRA_PERIOD - 1) {
+    __generate_extra_group(station, n / EXTRA_PERIOD, blocks);
+    return;
+  }
+
+  n -= n / EXTRA_PERIOD;
+  slot = n % 20;
+
+  /* 4A: date et heure. */
+  if (slot == 19) {
+    t = time(NULL);
+    gmtime_r(&t, &tm);
+    mjd = t / 86400 + 40587;
+
+    blocks[1] |= (4 << 12) | ((mjd >> 15) & 0x3);
+    blocks[2] = ((mjd & 0x7FFF) << 1) | (tm.tm_hour >> 4);
+    blocks[3] = ((tm.tm_hour & 0xF) << 12) | (tm.tm_min << 6);
+  }
+  /* 1A: Program Item Number. */
+  else if (slot == 9) {
+    blocks[1] |= 1 << 12;
+    blocks[2] = 0x0000;
+    blocks[3] = (1 << 11) | (12 << 6);
+  }
+  /* 2A: Radio text. */
+  else if (slot % 2 && rt_segments > 0) {
+    memset(rt, ' ', 64);
+    memcpy(rt, station->rt, rt_len);
+
+    if (rt_len < 64)
+      rt[rt_len] = '\r';
+
+    /* 8 segments par cycle de 20 groupes: slots impairs sauf 9 et 19. */
+    k = ((n / 20) * 8 + slot / 2 - (slot > 9)) % rt_segments;
+    blocks[1] |= (2 << 12) | k;
+    blocks[2] = (rt[k * 4] << 8) | rt[k * 4 + 1];
+    blocks[3] = (rt[k * 4 + 2] << 8) | rt[k * 4 + 3];
+  }
+  /* 0A: nom de la station et fréquences alternatives. */
+  else {
+    memset(ps, ' ', 8);
+    memcpy(ps, station->ps, ps_len);
+
+    k = (n / 2) % 4;
+    blocks[1] |= (station->ta << 4) | (1 << 3) | k;
+    blocks[3] = (ps[k * 2] << 8) | ps[k * 2 + 1];
+
+    /* Méthode A: le 1er couple donne le nombre de fréquences. */
+    n_pairs = 1 + station->n_af / 2;
+    i = (n / 8) % n_pairs;
+
+    if (i == 0)
+      blocks[2] = ((224 + station->n_af) << 8) | (station->n_af > 0 ? __af_code(station->af[0]) : 205);
+    else
+      blocks[2] = (__af_code(station->af[i * 2 - 1]) << 8) |
+        (i * 2 < station->n_af ? __af_code(station->af[i * 2]) : 205);
+  }
+
+  return;
+}
+
+/* --------------------------------------------------------------------- */
+
+static long __elapsed (Time *from) {
+  Time now;
+
+  time_get_cur(&now);
+
+  return (now.tv_sec - from->tv_sec) * 1000000L + (now.tv_usec - from->tv_usec);
+}
+
+/* Limites de la bande et espacement en 10 kHz. */
+static void __get_band (Emu_chip *chip, int *bottom, int *top, int *spacing) {
+  static const int bottoms[] = { 8750, 7600, 7600, 8750 };
+  static const int tops[] = { 10800, 10800, 9000, 10800 };
+  static const int spacings[] = { 20, 10, 5, 20 };
+
+  int band = (chip->regs[REG_SYSCONFIG2] & MASK_BAND) >> BIT_BAND;
+
+  *bottom = bottoms[band];
+  *top = tops[band];
+  *spacing = spacings[(chip->regs[REG_SYSCONFIG2] & MASK_SPACE) >> BIT_SPACE];
+
+  return;
+}
+
+/* Station la plus proche d'un channel, NULL si aucune n'est reçue. */
+static const Si4702_emu_station *__get_station (Emu_chip *chip, int channel, int *rssi) {
+  const Si4702_emu_station *station = NULL;
+  int bottom, top, spacing;
+  int freq, diff, best = NEIGHBOUR_WIDTH + 1;
+  int i;
+
+  __get_band(chip, &bottom, &top, &spacing);
+  freq = bottom + channel * spacing;
+
+  for (i = 0; i < conf.n_stations; i++) {
+    diff = conf.stations[i].channel * 10 - freq;
+    diff = diff < 0 ? -diff : diff;
+
+    if (diff < best) {
+      best = diff;
+      station = &conf.stations[i];
+    }
+  }
+
+  /* Bruit de fond. */
+  *rssi = 5 + __hash(freq) % 8;
+
+  if (station != NULL) {
+    if (best == 0)
+      *rssi = station->rssi;
+    else if (station->rssi - NEIGHBOUR_LOSS > *rssi)
+      *rssi = station->rssi - NEIGHBOUR_LOSS;
+  }
+
+  return best == 0 ? station : NULL;
+}
+
+static int __get_rssi (Emu_chip *chip, int channel) {
+  int rssi;
+
+  __get_station(chip, channel, &rssi);
+
+  return rssi;
+}
+
+static void __start_tune (Emu_chip *chip) {
+  chip->op = OP_TUNE;
+  chip->op_channel = chip->regs[REG_CHANNEL] & MASK_CHANNEL;
+  chip->op_sfbl = 0;
+  chip->op_duration = conf.realtime ? TUNE_DELAY : 0;
+  time_get_cur(&chip->op_start);
+
+  return;
+}
+
+/* Documentation: "doc/AN230.pdf", page 20. */
+static void __start_seek (Emu_chip *chip) {
+  int bottom, top, spacing, n;
+  int channel = chip->regs[REG_READCHAN] & MASK_CHANNEL;
+  int start = channel;
+  int step = (chip->regs[REG_POWERCFG] & MASK_SEEKUP) ? 1 : -1;
+  int threshold = (chip->regs[REG_SYSCONFIG2] & MASK_SEEKTH) >> BIT_SEEKTH;
+  int steps = 0;
+
+  __get_band(chip, &bottom, &top, &spacing);
+  n = (top - bottom) / spacing;
+
+  if (threshold == 0)
+    threshold = DEFAULT_SEEKTH;
+
+  chip->op_sfbl = 0;
+
+  for (;;) {
+    channel += step;
+    steps++;
+
+    /* Limite de la bande: retour à l'autre extrémité. Avec SKMODE, le seek
+       s'arrête en échec, READCHAN indiquant alors l'autre extrémité comme
+       sur le vrai tuner. */
+    if (channel < 0 || channel > n) {
+      channel = channel < 0 ? n : 0;
+
+      if (chip->regs[REG_POWERCFG] & MASK_SKMODE) {
+        chip->op_sfbl = 1;
+        break;
+      }
+    }
+
+    if (channel == start) {
+      chip->op_sfbl = 1;
+      break;
+    }
+
+    if (__get_rssi(chip, channel) >= threshold)
+      break;
+  }
+
+  chip->op = OP_SEEK;
+  chip->op_channel = channel;
+  chip->op_duration = conf.realtime ? (long)steps * SEEK_STEP_DELAY : 0;
+  time_get_cur(&chip->op_start);
+
+  return;
+}
+
+static void __end_op (Emu_chip *chip, int stc) {
+  chip->regs[REG_READCHAN] &= ~MASK_CHANNEL;
+  chip->regs[REG_READCHAN] |= chip->op_channel;
+  chip->regs[REG_STATUSRSSI] &= ~(MASK_STC | MASK_SFBL);
+
+  if (stc)
+    chip->regs[REG_STATUSRSSI] |= MASK_STC | (chip->op_sfbl ? MASK_SFBL : 0);
+
+  chip->op = OP_NONE;
+  chip->groups_read = 0;
+  chip->rds_gap = 0;
+  time_get_cur(&chip->tuned_at);
+
+  return;
+}
+
+/* Met à jour les registres RDS. */
+static void __update_rds (Emu_chip *chip, int channel) {
+  const Si4702_emu_station *station;
+  uint16_t blocks[4];
+  uint16_t bler[4] = { 0 };
+  unsigned long n;
+  long elapsed;
+  int rssi, i;
+  uint32_t h;
+
+  chip->regs[REG_STATUSRSSI] &= ~(MASK_RDSR | MASK_RDSS | (0x3 << BIT_BLERA));
+  chip->regs[REG_READCHAN] &= MASK_CHANNEL;
+
+  station = __get_station(chip, channel, &rssi);
+
+  if (!(chip->regs[REG_SYSCONFIG1] & MASK_ENABLE_RDS) || chip->op != OP_NONE ||
+      station == NULL || station->pi == 0 || rssi < RDS_MIN_RSSI)
+    return;
+
+  chip->regs[REG_STATUSRSSI] |= MASK_RDSS;
+
+  /* Un groupe toutes les 87.6 ms, RDSR actif pendant 40 ms. */
+  if (conf.realtime) {
+    elapsed = __elapsed(&chip->tuned_at);
+
+    if (elapsed < GROUP_PERIOD)
+      return;
+
+    n = elapsed / GROUP_PERIOD - 1;
+
+    if (elapsed % GROUP_PERIOD < RDSR_DURATION)
+      chip->regs[REG_STATUSRSSI] |= MASK_RDSR;
+  }
+  /* Un nouveau groupe à chaque lecture, séparé du précédent par
+     une lecture de RDSR inactif. */
+  else if (chip->rds_gap)
+    return;
+  else {
+    n = chip->groups_read;
+    chip->regs[REG_STATUSRSSI] |= MASK_RDSR;
+  }
+
+  si4702_emu_generate_group(station, n, blocks);
+
+  /* Erreurs: corrigées (BLER 1) ou non corrigibles (BLER 3). */
+  for (i = 0; i < 4; i++) {
+    h = __hash((n * 4 + i) ^ (station->pi << 16));
+
+    if ((int)(h % 100) < conf.error_rate) {
+      if (h & 0x100) {
+        bler[i] = 3;
+        blocks[i] ^= (h >> 12) | 1;
+      }
+      else
+        bler[i] = 1;
+    }
+
+    chip->regs[REG_RDSA + i] = blocks[i];
+  }
+
+  /* Les erreurs ne sont indiquées qu'en mode verbose. */
+  if (chip->regs[REG_POWERCFG] & MASK_RDSM) {
+    chip->regs[REG_STATUSRSSI] |= bler[0] << BIT_BLERA;
+    chip->regs[REG_READCHAN] |= (bler[1] << 14) | (bler[2] << 12) | (bler[3] << 10);
+  }
+
+  return;
+}
+
+/* Met à jour les registres volatiles. */
+static void __update (Emu_chip *chip) {
+  int channel;
+  int rssi;
+
+  if (chip->op != OP_NONE && __elapsed(&chip->op_start) >= chip->op_duration)
+    __end_op(chip, 1);
+
+  channel = chip->regs[REG_READCHAN] & MASK_CHANNEL;
+  rssi = (chip->regs[REG_CHIPID] == VAL_CHIPID_ON && chip->op == OP_NONE) ? __get_rssi(chip, channel) : 0;
+
+  chip->regs[REG_STATUSRSSI] &= ~(MASK_RSSI | MASK_ST);
+  chip->regs[REG_STATUSRSSI] |= rssi;
+
+  if (rssi >= DEFAULT_SEEKTH + 10)
+    chip->regs[REG_STATUSRSSI] |= MASK_ST;
+
+  __update_rds(chip, channel);
+
+  return;
+}
+
+/* --------------------------------------------------------------------- */
+
+/* Un tuner fermé sans power down reste alimenté sur son bus. */
+#define IS_POWERED(CHIP) ((CHIP)->regs[REG_CHIPID] == VAL_CHIPID_ON)
+
+static Emu_chip *__get_chip (int fd) {
+  int i = fd - FD_BASE;
+
+  if (i < 0 || i >= CHIPS_MAX || !chips[i].used) {
+    errno = EBADF;
+    return NULL;
+  }
+
+  return &chips[i];
+}
+
+static int __emu_open (unsigned int bus_id, char addr) {
+  Emu_chip *chip;
+  int i;
+
+  if (addr != TUNER_ADDR) {
+    errno = ENXIO;
+    return -1;
+  }
+
+  if (!conf_set) {
+    si4702_emu_default_conf(&conf);
+    conf_set = 1;
+  }
+
+  /* Tuner resté alimenté: son état est gardé. */
+  for (i = 0; i < CHIPS_MAX; i++)
+    if (!chips[i].used && IS_POWERED(&chips[i]) && chips[i].bus_id == bus_id) {
+      chips[i].used = 1;
+      return FD_BASE + i;
+    }
+
+  /* Sinon un emplacement libre, de préférence sans tuner alimenté. */
+  for (i = 0; i < CHIPS_MAX && (chips[i].used || IS_POWERED(&chips[i])); i++);
+
+  if (i == CHIPS_MAX)
+    for (i = 0; i < CHIPS_MAX && chips[i].used; i++);
+
+  if (i == CHIPS_MAX) {
+    errno = EMFILE;
+    return -1;
+  }
+
+  /* Etat après un reset. */
+  chip = &chips[i];
+  memset(chip, 0, sizeof *chip);
+  chip->used = 1;
+  chip->bus_id = bus_id;
+  chip->regs[REG_DEVICEID] = VAL_DEVICEID;
+  chip->regs[REG_CHIPID] = VAL_CHIPID_OFF;
+  chip->regs[REG_TEST1] = VAL_TEST1_RESET;
+  time_get_cur(&chip->tuned_at);
+
+  return FD_BASE + i;
+}
+
+static int __emu_close (int fd) {
+  Emu_chip *chip = __get_chip(fd);
+
+  if (chip == NULL)
+    return -1;
+
+  chip->used = 0;
+
+  return 0;
+}
+
+/* Documentation: "doc/Si4702-03-C19-1.pdf", page 19. */
+static ssize_t __emu_write (int fd, void *buf, size_t count) {
+  Emu_chip *chip = __get_chip(fd);
+  uint8_t *p = buf;
+  uint16_t old_powercfg, old_channel;
+  size_t i;
+
+  if (chip == NULL)
+    return -1;
+
+  __update(chip);
+
+  old_powercfg = chip->regs[REG_POWERCFG];
+  old_channel = chip->regs[REG_CHANNEL];
+
+  /* Ecriture à partir de 0x02, un registre tous les 2 bytes. */
+  for (i = 0; i + 1 < count && REG_POWERCFG + i / 2 <= REG_TEST1; i += 2)
+    chip->regs[REG_POWERCFG + i / 2] = (p[i] << 8) | p[i + 1];
+
+  /* Power up/down. */
+  if ((chip->regs[REG_POWERCFG] & (MASK_ENABLE | MASK_DISABLE)) == MASK_ENABLE)
+    chip->regs[REG_CHIPID] = VAL_CHIPID_ON;
+  else if (chip->regs[REG_POWERCFG] & MASK_DISABLE) {
+    chip->regs[REG_CHIPID] = VAL_CHIPID_OFF;
+    chip->op = OP_NONE;
+  }
+
+  if (chip->regs[REG_CHIPID] != VAL_CHIPID_ON)
+    return count;
+
+  /* Front montant de TUNE/SEEK: début de l'opération.
+     Front descendant: fin ou annulation, STC est remis à 0. */
+  if (!(old_channel & MASK_TUNE) && (chip->regs[REG_CHANNEL] & MASK_TUNE))
+    __start_tune(chip);
+  else if ((old_channel & MASK_TUNE) && !(chip->regs[REG_CHANNEL] & MASK_TUNE) && chip->op != OP_SEEK) {
+    if (chip->op == OP_TUNE)
+      __end_op(chip, 0);
+
+    chip->regs[REG_STATUSRSSI] &= ~(MASK_STC | MASK_SFBL);
+  }
+
+  if (!(old_powercfg & MASK_SEEK) && (chip->regs[REG_POWERCFG] & MASK_SEEK))
+    __start_seek(chip);
+  else if ((old_powercfg & MASK_SEEK) && !(chip->regs[REG_POWERCFG] & MASK_SEEK) && chip->op != OP_TUNE) {
+    /* Un seek annulé s'arrête sur le channel de départ. */
+    if (chip->op == OP_SEEK) {
+      chip->op_channel = chip->regs[REG_READCHAN] & MASK_CHANNEL;
+      __end_op(chip, 0);
+    }
+
+    chip->regs[REG_STATUSRSSI] &= ~(MASK_STC | MASK_SFBL);
+  }
+
+  return count;
+}
+
+/* Documentation: "doc/Si4702-03-C19-1.pdf", page 18. */
+static ssize_t __emu_read (int fd, void *buf, size_t count) {
+  Emu_chip *chip = __get_chip(fd);
+  uint8_t *p = buf;
+  uint16_t reg;
+  size_t i;
+
+  if (chip == NULL)
+    return -1;
+
+  __update(chip);
+
+  /* Lecture à partir de 0x0A puis de 0x00 à 0x09. */
+  for (i = 0; i < count && i < REGISTERS_N * 2; i++) {
+    reg = chip->regs[(REG_STATUSRSSI + i / 2) % REGISTERS_N];
+    p[i] = (i % 2) ? reg & 0xFF : reg >> 8;
+  }
+
+  /* En mode instantané, un groupe RDS lu est consommé. */
+  if (!conf.realtime && count >= 6 * 2 && (chip->regs[REG_STATUSRSSI] & MASK_RDSR)) {
+    chip->groups_read++;
+    chip->rds_gap = 1;
+  }
+  else if (!(chip->regs[REG_STATUSRSSI] & MASK_RDSR))
+    chip->rds_gap = 0;
+
+  return i;
+}
+
+/* Le tuner émulé accepte les transactions combinées (I2C_RDWR). */
+static int __emu_transfer (int fd, I2c_msg *msgs, int n) {
+  ssize_t ret;
+  int i;
+
+  for (i = 0; i < n; i++) {
+    ret = (msgs[i].type == I2C_MSG_READ) ?
+      __emu_read(fd, msgs[i].buf, msgs[i].count) :
+      __emu_write(fd, msgs[i].buf, msgs[i].count);
+
+    if (ret != (ssize_t)msgs[i].count)
+      return -1;
+  }
+
+  return 1;
+}
+
+const I2c_backend *si4702_emu_get_backend (void) {
+  static const I2c_backend backend = {
+    .open = __emu_open,
+    .close = __emu_close,
+    .write = __emu_write,
+    .read = __emu_read,
+    .transfer = __emu_transfer
+  };
+
+  return &backend;
+}
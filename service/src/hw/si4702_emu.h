@@ -0,0 +1,76 @@
+/*
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _SI4702_EMU_H_
+#define _SI4702_EMU_H_
+
+#include <stdint.h>
+
+#include "i2c.h"
+
+/* Nombre max de stations et de fréquences alternatives d'une bande. */
+#define SI4702_EMU_STATIONS_MAX 64
+#define SI4702_EMU_AF_MAX 8
+
+/* Une station de la bande synthétique. */
+typedef struct Si4702_emu_station {
+  int channel; /* En 100 kHz, ex: 938 pour 93.8 MHz. */
+  int rssi; /* En dBuV. */
+  int stereo;
+
+  /* RDS: pas de RDS si pi vaut 0. */
+  uint16_t pi;
+  int pty;
+  int tp;
+  int ta;
+  char ps[8 + 1];
+  char rt[64 + 1];
+
+  /* Fréquences alternatives en 100 kHz. */
+  int af[SI4702_EMU_AF_MAX];
+  int n_af;
+} Si4702_emu_station;
+
+typedef struct Si4702_emu_conf {
+  /* Si non nul, tune/seek/RDS respectent les délais du vrai tuner,
+     sinon ils sont instantanés. */
+  int realtime;
+
+  /* Pourcentage de blocks RDS reçus avec des erreurs. */
+  int error_rate;
+
+  Si4702_emu_station stations[SI4702_EMU_STATIONS_MAX];
+  int n_stations;
+} Si4702_emu_conf;
+
+/* Remplit conf avec une bande par défaut. */
+void si4702_emu_default_conf (Si4702_emu_conf *conf);
+
+/* Charge une bande depuis un fichier texte. Chaque ligne décrit une station:
+   CHANNEL RSSI PI PTY "PS" "RT" [AF1,AF2...]
+   avec PI en hexadécimal. Les lignes commençant par # sont ignorées.
+   Retourne -1 en cas d'échec, sinon 0. */
+int si4702_emu_load_band (Si4702_emu_conf *conf, const char *filename);
+
+/* Définit la configuration des tuners émulés ouverts ensuite. */
+void si4702_emu_set_conf (const Si4702_emu_conf *conf);
+
+/* Backend I2C donnant accès à des Si4702 émulés. */
+const I2c_backend *si4702_emu_get_backend (void);
+
+/* Génère le n-ième groupe RDS diffusé par une station. */
+void si4702_emu_generate_group (const Si4702_emu_station *station, unsigned long n, uint16_t blocks[static 4]);
+
+#endif /* _SI4702_EMU_H_ INCLUDED */
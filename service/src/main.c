@@ -17,24 +17,79 @@
 #include <getopt.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
 #include "fm_tuner.h"
 #include "hw/led.h"
+#include "hw/pin.h"
+#include "hw/si4702_emu.h"
 #include "net/handler.h"
 #include "net/server.h"
-#include "seek.h" /* seek_utils. */
+#include "rds_bench.h"
+#include "rds_demod.h"
+#include "rds_log.h"
+#include "scan.h" /* scan_utils. */
+#include "station_map.h"
+#include "store.h"
+#include "tuner_worker.h"
 #include "utils/error.h"
 
+#define DEFAULT_BACKLOG 128
+#define DEFAULT_GPIO2_PIN -1
 #define DEFAULT_I2C_ID 1
 #define DEFAULT_MAX_CLIENTS 10
+#define DEFAULT_MULTICAST_KEYFRAME 1000
+#define DEFAULT_MULTICAST_TTL 1
 #define DEFAULT_PIN_RST 45
 #define DEFAULT_PIN_SDIO 12
 #define DEFAULT_PORT 9502
+#define DEFAULT_QUEUE_SIZE 65536
+#define DEFAULT_AF_RSSI 20
 
 #define MODE_SERVER 0
-#define MODE_SEEK 1
+#define MODE_SCAN 1
+#define MODE_RDS_BENCH 2
+#define MODE_RDS_REPLAY 3
+#define MODE_MPX 4
+#define MODE_MPX_BENCH 5
 
-static Fm_tuner *fm_tuner;
+/* Tuners servis, le premier est aussi celui du scan. */
+static Fm_tuner *fm_tuners[HANDLER_TUNERS_MAX];
+static int n_fm_tuners;
+
+/* Configurations données par --tuner, sinon celle des options -i/-r/-s/-g. */
+static Fm_tuner_conf tuner_confs[HANDLER_TUNERS_MAX];
+static int n_tuner_confs;
+
+/* Fichier de la carte des stations, ou NULL. */
+static const char *station_map_file;
+
+/* Ecoute du RDS des stations pendant le scan. */
+static int scan_rds;
+
+/* Fichier du store, ou NULL. */
+static const char *store_file;
+
+/* Capture RDS écrite par le serveur ou rejouée. */
+static const char *rds_log_file;
+
+/* Signal MPX décodé sans tuner et sa fréquence d'échantillonnage. */
+static const char *mpx_file;
+static int mpx_rate = RDS_DEMOD_DEFAULT_RATE;
+
+/* Groupe multicast des broadcasts (vide sans publication), son port, le
+   TTL des datagrammes et la période des états complets en ms. */
+static char multicast_group[64];
+static int multicast_port;
+static int multicast_ttl = DEFAULT_MULTICAST_TTL;
+static long multicast_keyframe = DEFAULT_MULTICAST_KEYFRAME;
+
+/* Seuil RSSI de recherche d'une AF, 0 sans suivi des AF. */
+static int af_rssi;
+
+/* Bande des tuners émulés. */
+static Si4702_emu_conf emu_conf;
 
 /* --------------------------------------------------------------------- */
 
@@ -48,11 +103,26 @@ static void __disable_leds (void) {
 }
 
 static void __create_tuner (Fm_tuner_conf *conf) {
-  fm_tuner = fm_tuner_new(conf);
+  Fm_tuner *fm_tuner = fm_tuner_new(conf);
 
-  debug("Init FM tuner.\n");
+  #ifdef DEBUG
+    Fm_tuner_stats stats;
+    long *times = stats.init_times;
+  #endif
+
+  fm_tuners[n_fm_tuners++] = fm_tuner;
+
+  debug("Init FM tuner %d (i2c bus %d).\n", n_fm_tuners - 1, conf->i2c_id);
 
   #ifdef DEBUG
+    fm_tuner_get_stats(fm_tuner, &stats);
+    debug("%s start in %ld us: reset %ld us, bus %ld us, oscillator %ld us, power up %ld us.\n",
+          stats.warm_start ? "Warm" : "Cold",
+          times[FM_TUNER_INIT_RESET] + times[FM_TUNER_INIT_BUS] +
+          times[FM_TUNER_INIT_OSCILLATOR] + times[FM_TUNER_INIT_POWER_UP],
+          times[FM_TUNER_INIT_RESET], times[FM_TUNER_INIT_BUS],
+          times[FM_TUNER_INIT_OSCILLATOR], times[FM_TUNER_INIT_POWER_UP]);
+
     debug("Registers data at init:\n");
     fm_tuner_print_registers(fm_tuner);
   #endif
@@ -60,46 +130,167 @@ static void __create_tuner (Fm_tuner_conf *conf) {
   return;
 }
 
-static void __delete_tuner (void) {
+static void __delete_tuner (Fm_tuner *fm_tuner) {
+  #ifdef DEBUG
+    static const char *op_names[FM_TUNER_OPS_N] = {
+      "other", "volume", "channel", "tune", "seek", "async", "rds", "rssi"
+    };
+    Fm_tuner_stats stats;
+    Fm_tuner_op_stats *op;
+    int i;
+
+    fm_tuner_get_stats(fm_tuner, &stats);
+    debug("I2C stats: %lu reads (%lu bytes), %lu writes (%lu bytes), %lu bytes saved.\n",
+          stats.reads, stats.bytes_read, stats.writes, stats.bytes_written, stats.bytes_saved);
+    debug("STC stats: %lu polls, %lu GPIO2 wakeups, %lu GPIO2 timeouts.\n",
+          stats.stc_polls, stats.stc_wakeups, stats.stc_timeouts);
+
+    for (i = 0; i < FM_TUNER_OPS_N; i++)
+      if ((op = &stats.ops[i])->calls > 0)
+        debug("I2C %-7s %lu calls, %.2f syscalls/call, %.2f messages/call.\n", op_names[i],
+              op->calls, op->syscalls / (double)op->calls, op->messages / (double)op->calls);
+  #endif
+
   fm_tuner_free(fm_tuner);
   return;
 }
 
+static void __delete_tuners (void) {
+  int i;
+
+  for (i = 0; i < n_fm_tuners; i++)
+    __delete_tuner(fm_tuners[i]);
+
+  return;
+}
+
 static void __usage (const char *progname) {
   printf("Usage: %s [OPTION]...\n", progname);
+  printf("  -g, --gpio2-pin=PIN  Wait tune/seek completion on the GPIO2 pin of the fm tuner.\n");
   printf("  -h, --help           Print this helper.\n");
   printf("  -i, --i2c-id=ID      Set the i2c bus id. Default: %d.\n", DEFAULT_I2C_ID);
   printf("  -m, --max-clients=N  Set the number max of server clients. Default: %d.\n", DEFAULT_MAX_CLIENTS);
   printf("  -p, --port=PORT      Set the server port. Default: %d.\n", DEFAULT_PORT);
   printf("  -r, --reset-pin=PIN  Set the reset pin number of the fm tuner. Default: %d.\n", DEFAULT_PIN_RST);
   printf("  -s, --sdio-pin=PIN   Set the sdio pin number of the fm tuner. Default: %d.\n", DEFAULT_PIN_SDIO);
-  printf("      --seek           Seek to locate radio stations.\n");
+  printf("      --af-follow[=RSSI]\n");
+  printf("                       Switch to an alternative frequency of the station when the RSSI\n");
+  printf("                       stays below RSSI dBuV. Default: %d.\n", DEFAULT_AF_RSSI);
+  printf("      --backlog=N      Set the number max of connections waiting for the server. Default: %d.\n",
+         DEFAULT_BACKLOG);
+  printf("      --emulator[=BAND]\n");
+  printf("                       Use an emulated fm tuner, with an optional band file.\n");
+  printf("      --gpio-root=DIR  Set the sysfs gpio directory. Default: /sys/class/gpio.\n");
+  printf("      --mpx=FILE       Demodulate the RDS of a MPX signal (signed 16-bit samples), without tuner.\n");
+  printf("      --mpx-bench      Measure the RDS demodulator throughput on the emulator band.\n");
+  printf("      --mpx-rate=HZ    Set the sample rate of the MPX signal. Default: %d.\n", RDS_DEMOD_DEFAULT_RATE);
+  printf("      --multicast=GROUP:PORT\n");
+  printf("                       Publish the broadcasts to a multicast group, for listen-only clients.\n");
+  printf("      --multicast-keyframe=MS\n");
+  printf("                       Set the period of the whole state on the multicast group. Default: %d.\n",
+         DEFAULT_MULTICAST_KEYFRAME);
+  printf("      --multicast-ttl=N\n");
+  printf("                       Set the number max of routers crossed by the multicast datagrams. Default: %d.\n",
+         DEFAULT_MULTICAST_TTL);
+  printf("      --rds-bench      Measure the RDS decoder throughput on the emulator band.\n");
+  printf("      --rds-errors=PERCENT\n");
+  printf("                       Set the percentage of erroneous RDS blocks in the emulator.\n");
+  printf("      --rds-log=FILE   Append the decoded RDS groups of all tuners to FILE.\n");
+  printf("      --rds-replay=FILE\n");
+  printf("                       Decode a RDS log as fast as possible, without tuner.\n");
+  printf("      --queue-size=BYTES\n");
+  printf("                       Set the bytes max waiting to be sent to a client. Default: %d.\n",
+         DEFAULT_QUEUE_SIZE);
+  printf("      --realtime       Use the delays of the real fm tuner in the emulator.\n");
+  printf("      --scan           Scan the band to locate radio stations.\n");
+  printf("      --scan-rds       Wait for the PI and name of stations during the scan.\n");
+  printf("      --slow-clients=POLICY\n");
+  printf("                       When the queue of a client is full, send it the whole state once\n");
+  printf("                       its queue is empty (coalesce) or disconnect it (drop). Default: coalesce.\n");
+  printf("      --station-map=FILE\n");
+  printf("                       Save the scanned stations in FILE, or serve them to clients.\n");
+  printf("      --store=FILE     Restore and save the tuner state and known stations in FILE.\n");
+  printf("      --warm-start     Keep the state of running tuners, and keep them running at exit.\n");
+  printf("      --tuner=I2C_ID,RST,SDIO[,GPIO2]\n");
+  printf("                       Serve a tuner, up to %d times. Replaces -i, -r, -s and -g.\n",
+         HANDLER_TUNERS_MAX);
 
   exit(EXIT_SUCCESS);
 }
 
 /* --------------------------------------------------------------------- */
 
+/* Lit une configuration de la forme I2C_ID,RST,SDIO[,GPIO2].
+   Retourne -1 en cas d'échec, sinon 0. */
+static int __parse_tuner (const char *arg, const Fm_tuner_conf *base, Fm_tuner_conf *conf) {
+  int n, end = 0;
+
+  *conf = *base;
+  conf->pin_gpio2 = -1;
+
+  n = sscanf(arg, "%d,%d,%d%n,%d%n", &conf->i2c_id, &conf->pin_rst, &conf->pin_sdio,
+             &end, &conf->pin_gpio2, &end);
+
+  return (n < 3 || arg[end] != '\0' || conf->i2c_id < 0) ? -1 : 0;
+}
+
+/* Lit un groupe multicast de la forme GROUP:PORT.
+   Retourne -1 en cas d'échec, sinon 0. */
+static int __parse_multicast (const char *arg) {
+  int n, end = 0;
+
+  n = sscanf(arg, "%63[^:]:%d%n", multicast_group, &multicast_port, &end);
+
+  return (n < 2 || arg[end] != '\0' || multicast_port <= 0 || multicast_port > 65535) ? -1 : 0;
+}
+
 static int __parse_arguments (int argc, char *argv[], Server_conf *server_conf, Fm_tuner_conf *fm_tuner_conf) {
-  static const char *opts = "hm:p:i:r:s:";
+  static const char *opts = "g:hm:p:i:r:s:";
   static struct option long_opts[] = {
+    { "af-follow", optional_argument, NULL, 'A' },
+    { "backlog", required_argument, NULL, 'L' },
+    { "gpio2-pin", required_argument, NULL, 'g' },
+    { "gpio-root", required_argument, NULL, 'G' },
+    { "emulator", optional_argument, NULL, 'e' },
     { "help", no_argument, NULL, 'h' },
     { "i2c-id", required_argument, NULL, 'i' },
     { "max-clients", required_argument, NULL, 'm' },
+    { "mpx", required_argument, NULL, 'X' },
+    { "mpx-bench", no_argument, NULL, 'Z' },
+    { "mpx-rate", required_argument, NULL, 'Y' },
+    { "multicast", required_argument, NULL, 'U' },
+    { "multicast-keyframe", required_argument, NULL, 'F' },
+    { "multicast-ttl", required_argument, NULL, 'V' },
     { "port", required_argument, NULL, 'p' },
+    { "queue-size", required_argument, NULL, 'Q' },
     { "reset-pin", required_argument, NULL, 'r' },
     { "sdio-pin", required_argument, NULL, 's' },
-    { "seek", no_argument, NULL, 'l' },
+    { "realtime", no_argument, NULL, 'R' },
+    { "rds-bench", no_argument, NULL, 'K' },
+    { "rds-errors", required_argument, NULL, 'E' },
+    { "rds-log", required_argument, NULL, 'C' },
+    { "rds-replay", required_argument, NULL, 'P' },
+    { "scan", no_argument, NULL, 'l' },
+    { "scan-rds", no_argument, NULL, 'D' },
+    { "slow-clients", required_argument, NULL, 'S' },
+    { "station-map", required_argument, NULL, 'M' },
+    { "store", required_argument, NULL, 'B' },
+    { "tuner", required_argument, NULL, 'T' },
+    { "warm-start", no_argument, NULL, 'W' },
     { 0, 0, 0, 0}
   };
 
-  int opt;
+  int opt, i;
   int opt_index;
   long value;
   char *endptr;
 
   int mode = MODE_SERVER;
 
+  int emulator = 0;
+  int warm_start = 0;
+
+  si4702_emu_default_conf(&emu_conf);
   errno = 0;
 
   while ((opt = getopt_long(argc, argv, opts, long_opts, &opt_index)) != -1) {
@@ -107,7 +298,99 @@ static int __parse_arguments (int argc, char *argv[], Server_conf *server_conf,
       __usage(*argv);
 
     if (opt == 'l') {
-      mode = MODE_SEEK;
+      mode = MODE_SCAN;
+      continue;
+    }
+
+    if (opt == 'K') {
+      mode = MODE_RDS_BENCH;
+      continue;
+    }
+
+    if (opt == 'X') {
+      mpx_file = optarg;
+      mode = MODE_MPX;
+      continue;
+    }
+
+    if (opt == 'Z') {
+      mode = MODE_MPX_BENCH;
+      continue;
+    }
+
+    if (opt == 'C' || opt == 'P') {
+      rds_log_file = optarg;
+
+      if (opt == 'P')
+        mode = MODE_RDS_REPLAY;
+      continue;
+    }
+
+    if (opt == 'D') {
+      scan_rds = 1;
+      continue;
+    }
+
+    if (opt == 'M') {
+      station_map_file = optarg;
+      continue;
+    }
+
+    if (opt == 'B') {
+      store_file = optarg;
+      continue;
+    }
+
+    if (opt == 'A' && optarg == NULL) {
+      af_rssi = DEFAULT_AF_RSSI;
+      continue;
+    }
+
+    if (opt == 'W') {
+      warm_start = 1;
+      continue;
+    }
+
+    if (opt == 'T') {
+      if (n_tuner_confs == HANDLER_TUNERS_MAX)
+        fatal_error("Too many tuners, max: %d.", HANDLER_TUNERS_MAX);
+
+      if (__parse_tuner(optarg, fm_tuner_conf, &tuner_confs[n_tuner_confs++]) == -1)
+        fatal_error("Invalid tuner: %s.", optarg);
+      continue;
+    }
+
+    if (opt == 'S') {
+      if (strcmp(optarg, "coalesce") == 0)
+        server_conf->overflow = SERVER_OVERFLOW_COALESCE;
+      else if (strcmp(optarg, "drop") == 0)
+        server_conf->overflow = SERVER_OVERFLOW_DROP;
+      else
+        fatal_error("Invalid slow clients policy: %s.", optarg);
+      continue;
+    }
+
+    if (opt == 'U') {
+      if (__parse_multicast(optarg) == -1)
+        fatal_error("Invalid multicast group: %s.", optarg);
+      continue;
+    }
+
+    if (opt == 'G') {
+      pin_set_root(optarg);
+      continue;
+    }
+
+    if (opt == 'e') {
+      if (optarg != NULL && si4702_emu_load_band(&emu_conf, optarg) == -1)
+        fatal_error("Unable to load band file: %s.", optarg);
+
+      emulator = 1;
+      continue;
+    }
+
+    if (opt == 'R') {
+      emu_conf.realtime = 1;
       continue;
     }
 
@@ -117,12 +400,27 @@ static int __parse_arguments (int argc, char *argv[], Server_conf *server_conf,
     }
 
     switch (opt) {
+      case 'g':
+        fm_tuner_conf->pin_gpio2 = value;
+        break;
       case 'm':
         server_conf->max_clients = value;
         break;
       case 'p':
         server_conf->port = value;
         break;
+      case 'L':
+        server_conf->backlog = value;
+        break;
+      case 'Q':
+        server_conf->queue_size = value;
+        break;
+      case 'F':
+        multicast_keyframe = value;
+        break;
+      case 'V':
+        multicast_ttl = value;
+        break;
       case 'i':
         fm_tuner_conf->i2c_id = value;
         break;
@@ -132,19 +430,71 @@ static int __parse_arguments (int argc, char *argv[], Server_conf *server_conf,
       case 's':
         fm_tuner_conf->pin_sdio = value;
         break;
+      case 'E':
+        emu_conf.error_rate = value > 100 ? 100 : value;
+        break;
+      case 'A':
+        af_rssi = value;
+        break;
+      case 'Y':
+        mpx_rate = value;
+        break;
+    }
+  }
+
+  if (n_tuner_confs == 0)
+    tuner_confs[n_tuner_confs++] = *fm_tuner_conf;
+
+  for (i = 0; i < n_tuner_confs; i++)
+    tuner_confs[i].warm_start = warm_start;
+
+  /* Tuners émulés: aucun pin n'est utilisé. */
+  if (emulator) {
+    si4702_emu_set_conf(&emu_conf);
+    i2c_set_backend(si4702_emu_get_backend());
+
+    for (i = 0; i < n_tuner_confs; i++) {
+      tuner_confs[i].pin_rst = -1;
+      tuner_confs[i].pin_sdio = -1;
+      tuner_confs[i].pin_gpio2 = -1;
     }
   }
 
   return mode;
 }
 
+/* Restaure le volume et le channel mémorisés avant l'arrivée des clients.
+   Un tuner démarré à chaud garde les siens: le régler de nouveau
+   couperait le son et son RDS. */
+static void __restore_state (Store *store, int tuner) {
+  Fm_tuner *fm_tuner = fm_tuners[tuner];
+  Fm_tuner_stats stats;
+  Store_state state;
+
+  fm_tuner_get_stats(fm_tuner, &stats);
+
+  if (stats.warm_start || store_get_state(store, tuner, &state) == -1)
+    return;
+
+  if (fm_tuner_set_volume(fm_tuner, state.volume) == -1 ||
+      fm_tuner_set_channel(fm_tuner, state.channel) == -1)
+    error("Unable to restore the state of tuner %d.", tuner);
+
+  debug("Restored volume %d and channel %d of tuner %d.\n", state.volume, state.channel, tuner);
+
+  return;
+}
+
 int main (int argc, char *argv[]) {
   static Handler_value handler_value = {
-    .to_set = 0
+    .n_tuners = 0
   };
   static Server_conf server_conf = {
     .port = DEFAULT_PORT,
     .max_clients = DEFAULT_MAX_CLIENTS,
+    .backlog = DEFAULT_BACKLOG,
+    .queue_size = DEFAULT_QUEUE_SIZE,
+    .overflow = SERVER_OVERFLOW_COALESCE,
     .user_value = &handler_value,
     .handlers = {
       .event = handler_event,
@@ -157,22 +507,117 @@ int main (int argc, char *argv[]) {
     .i2c_id = DEFAULT_I2C_ID,
     .pin_rst = DEFAULT_PIN_RST,
     .pin_sdio = DEFAULT_PIN_SDIO,
+    .pin_gpio2 = DEFAULT_GPIO2_PIN,
     .tuner_addr = 0x10
   };
 
   int mode = __parse_arguments(argc, argv, &server_conf, &fm_tuner_conf);
+  Handler_tuner *tuner;
+  long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  int i;
+
+  #ifdef DEBUG
+    Rds_stats rds_stats;
+  #endif
+
+  /* Le décodeur seul est mesuré, aucun tuner n'est utilisé. */
+  if (mode == MODE_RDS_BENCH) {
+    rds_bench_utils(&emu_conf);
+    exit(EXIT_SUCCESS);
+  }
+
+  if (mode == MODE_RDS_REPLAY) {
+    rds_log_replay_utils(rds_log_file);
+    exit(EXIT_SUCCESS);
+  }
+
+  if (mode == MODE_MPX) {
+    rds_demod_utils(mpx_file, mpx_rate);
+    exit(EXIT_SUCCESS);
+  }
+
+  if (mode == MODE_MPX_BENCH) {
+    rds_demod_bench_utils(&emu_conf, mpx_rate);
+    exit(EXIT_SUCCESS);
+  }
+
+  atexit(__delete_tuners);
+
+  for (i = 0; i < n_tuner_confs; i++)
+    __create_tuner(&tuner_confs[i]);
 
-  __create_tuner(&fm_tuner_conf);
-  atexit(__delete_tuner);
   __disable_leds();
 
-  if (mode == MODE_SEEK)
-    seek_utils(fm_tuner);
+  if (mode == MODE_SCAN)
+    scan_utils(fm_tuners[0], scan_rds, station_map_file);
   else {
-    handler_value.fm_tuner = fm_tuner;
-    handler_value.rds = rds_new();
-    server_run(&server_conf, 500);
-    rds_free(handler_value.rds);
+    if (store_file != NULL)
+      handler_value.store = store_open(store_file);
+
+    handler_value.rds_cache = rds_cache_new();
+
+    if (rds_log_file != NULL && (handler_value.rds_log = rds_log_open(rds_log_file)) == NULL)
+      error("Unable to open the RDS log, no RDS capture.");
+
+    for (i = 0; i < n_fm_tuners; i++) {
+      tuner = &handler_value.tuners[i];
+
+      if (handler_value.store != NULL)
+        __restore_state(handler_value.store, i);
+
+      tuner->volume = fm_tuner_get_volume(fm_tuners[i]);
+      tuner->channel = fm_tuner_get_channel(fm_tuners[i]);
+      tuner->rds = rds_new();
+      handler_restore(&handler_value, i);
+    }
+
+    handler_value.n_tuners = n_fm_tuners;
+
+    if (*multicast_group != '\0' &&
+        (handler_value.feed = feed_new(multicast_group, multicast_port, multicast_ttl,
+                                       multicast_keyframe)) == NULL)
+      error("Unable to publish to the multicast group %s:%d.", multicast_group, multicast_port);
+
+    /* Carte produite par un scan précédent: aucun scan au démarrage. */
+    if (station_map_file != NULL && (handler_value.stations = station_map_load(station_map_file)) == NULL)
+      error("Unable to load the station map, no station sent to clients.");
+
+    /* Chaque tuner n'est plus accédé que par son thread, les threads
+       sont répartis sur les processeurs. */
+    for (i = 0; i < n_fm_tuners; i++) {
+      tuner = &handler_value.tuners[i];
+      tuner->worker = tuner_worker_new(fm_tuners[i], n_cpus > 1 ? i % n_cpus : -1, af_rssi);
+      server_conf.wakeup_fds[server_conf.n_wakeup_fds++] = tuner_worker_get_fd(tuner->worker);
+    }
+
+    server_run(&server_conf, HANDLER_LOOP_DELAY);
+
+    for (i = 0; i < n_fm_tuners; i++) {
+      tuner = &handler_value.tuners[i];
+      tuner_worker_free(tuner->worker);
+
+      #ifdef DEBUG
+        rds_get_stats(tuner->rds, &rds_stats);
+        debug("RDS tuner %d: %lu unknown groups, %lu rejected groups, %lu rejected blocks.\n",
+              i, rds_stats.unknown, rds_stats.rejected_groups, rds_stats.rejected_blocks);
+        debug("RDS tuner %d: %lu name/text updates.\n", i, rds_stats.updates);
+        if (tuner->rds_seconds > 0)
+          debug("RDS acquisition tuner %d: %.1f groups/s, %.2f missed/s, %.2f duplicated reads/s (%lu s).\n",
+                i, (double)tuner->rds_stats.received / tuner->rds_seconds,
+                (double)tuner->rds_stats.missed / tuner->rds_seconds,
+                (double)tuner->rds_stats.duplicated / tuner->rds_seconds, tuner->rds_seconds);
+        debug("AF tuner %d: %lu switches, %lu failures, %ld ms muted, %ld ms on a weak signal.\n",
+              i, tuner->af_switches, tuner->af_failures, tuner->af_mute_time, tuner->af_weak_time);
+      #endif
+
+      rds_free(tuner->rds);
+    }
+
+    station_map_free(handler_value.stations);
+    store_close(handler_value.store);
+    rds_cache_free(handler_value.rds_cache);
+    rds_log_close(handler_value.rds_log);
+    feed_free(handler_value.feed);
   }
 
   exit(EXIT_SUCCESS);
@@ -0,0 +1,109 @@
+/*
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdint.h>
+
+#include "../utils/alloc.h"
+#include "../utils/error.h"
+#include "../utils/ptime.h"
+#include "feed.h"
+
+struct Feed {
+  Socket sock;
+  uint32_t seq;
+
+  /* Dernier état complet publié et période en ms. */
+  Time keyframe_time;
+  long keyframe_period;
+  int keyframe_sent;
+
+  Feed_stats stats;
+};
+
+/* --------------------------------------------------------------------- */
+
+Feed *feed_new (const char *group, in_port_t port, int ttl, long keyframe_period) {
+  Feed *feed;
+  Socket sock;
+  IP ip;
+
+  if (resolve_host(&ip, group, port) == -1 || (sock = udp_get_multicast(&ip, ttl)) == -1)
+    return NULL;
+
+  feed = pnew0(Feed);
+  feed->sock = sock;
+  feed->keyframe_period = keyframe_period;
+
+  return feed;
+}
+
+void feed_free (Feed *feed) {
+  if (feed == NULL)
+    return;
+
+  debug("[feed]%lu datagrams, %lu keyframes, %lu errors.\n",
+        feed->stats.datagrams, feed->stats.keyframes, feed->stats.errors);
+
+  tcp_close(feed->sock);
+  free(feed);
+
+  return;
+}
+
+int feed_publish (Feed *feed, const Frame *frame, int keyframe) {
+  char header[FEED_HEADER_SIZE], *p = header;
+  struct iovec iov[2];
+
+  p = serialize_uint8(p, FEED_VERSION);
+  p = serialize_uint8(p, keyframe ? FEED_KEYFRAME : 0);
+  serialize_uint32(p, feed->seq++);
+
+  /* L'en-tête et la trame partagée sont envoyés sans copie. */
+  iov[0].iov_base = header;
+  iov[0].iov_len = FEED_HEADER_SIZE;
+  iov[1].iov_base = (void *)frame->data;
+  iov[1].iov_len = frame->len;
+
+  if (keyframe) {
+    time_get_cur(&feed->keyframe_time);
+    feed->keyframe_sent = 1;
+  }
+
+  if (udp_sendv(feed->sock, iov, 2) == -1) {
+    feed->stats.errors++;
+    return -1;
+  }
+
+  feed->stats.datagrams++;
+  feed->stats.keyframes += !!keyframe;
+
+  return 0;
+}
+
+int feed_keyframe_is_due (Feed *feed) {
+  Time cur;
+
+  if (!feed->keyframe_sent)
+    return 1;
+
+  time_get_cur(&cur);
+
+  return time_diff(&feed->keyframe_time, &cur) >= feed->keyframe_period;
+}
+
+void feed_get_stats (Feed *feed, Feed_stats *stats) {
+  *stats = feed->stats;
+  return;
+}
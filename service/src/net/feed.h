@@ -0,0 +1,62 @@
+/*
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _FEED_H_
+#define _FEED_H_
+
+#include "../utils/socket.h"
+#include "frame.h"
+
+/* Publication des broadcasts sur un groupe multicast, pour des récepteurs
+   qui ne font qu'écouter. Chaque datagramme contient un en-tête suivi
+   des messages d'une trame, comme envoyés aux clients TCP v2:
+     - version (uint8, FEED_VERSION),
+     - flags (uint8, FEED_KEYFRAME si la trame est l'état complet),
+     - numéro de séquence (uint32), incrémenté à chaque datagramme.
+   Un récepteur qui arrive ou qui voit un numéro manquant attend le
+   prochain état complet. */
+#define FEED_VERSION 2
+#define FEED_KEYFRAME 0x01
+#define FEED_HEADER_SIZE 6
+
+typedef struct Feed Feed;
+
+typedef struct Feed_stats {
+  unsigned long datagrams;
+  unsigned long keyframes;
+  unsigned long errors; /* Datagrammes non envoyés. */
+} Feed_stats;
+
+/* Crée une publication vers le groupe group:port. Ses datagrammes
+   traversent au plus ttl routeurs, et un état complet est attendu
+   toutes les keyframe_period ms.
+   Retourne NULL en cas d'échec, sinon la publication. */
+Feed *feed_new (const char *group, in_port_t port, int ttl, long keyframe_period);
+
+/* Libère une publication. */
+void feed_free (Feed *feed);
+
+/* Publie une trame, keyframe si elle contient l'état complet.
+   Un datagramme non envoyé est perdu, comme sur le réseau.
+   Retourne -1 en cas d'échec, sinon 0. */
+int feed_publish (Feed *feed, const Frame *frame, int keyframe);
+
+/* Retourne 1 si un état complet doit être publié, sinon 0. */
+int feed_keyframe_is_due (Feed *feed);
+
+/* Donne les compteurs d'une publication. */
+void feed_get_stats (Feed *feed, Feed_stats *stats);
+
+#endif /* _FEED_H_ INCLUDED */
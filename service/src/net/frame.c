@@ -0,0 +1,51 @@
+/*
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+
+#include "../utils/alloc.h"
+#include "frame.h"
+
+Frame *frame_new (int size) {
+  Frame *frame;
+
+  pmalloc(frame, sizeof *frame + size);
+  frame->refs = 1;
+  frame->len = 0;
+  frame->size = size;
+
+  return frame;
+}
+
+Frame *frame_new_copy (const void *data, int len) {
+  Frame *frame = frame_new(len);
+
+  memcpy(frame->data, data, len);
+  frame->len = len;
+
+  return frame;
+}
+
+Frame *frame_ref (Frame *frame) {
+  frame->refs++;
+  return frame;
+}
+
+void frame_unref (Frame *frame) {
+  if (frame != NULL && --frame->refs == 0)
+    free(frame);
+
+  return;
+}
@@ -0,0 +1,42 @@
+/*
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _FRAME_H_
+#define _FRAME_H_
+
+/* Messages encodés une fois et partagés par les files des clients.
+   Le compteur de références n'est pas atomique: une trame n'est
+   utilisée que par le thread du serveur. */
+typedef struct Frame {
+  unsigned int refs;
+  int len; /* Octets encodés. */
+  int size; /* Octets disponibles. */
+  char data[];
+} Frame;
+
+/* Crée une trame vide de size octets, avec une référence. */
+Frame *frame_new (int size);
+
+/* Crée une trame contenant une copie de data, avec une référence. */
+Frame *frame_new_copy (const void *data, int len);
+
+/* Prend une référence sur une trame.
+   Retourne la trame. */
+Frame *frame_ref (Frame *frame);
+
+/* Rend une référence, la trame est libérée avec la dernière. */
+void frame_unref (Frame *frame);
+
+#endif /* _FRAME_H_ INCLUDED */
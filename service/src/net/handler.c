@@ -22,12 +22,6 @@
 
 #include "handler.h"
 
-/* Temps minimum à attendre avant un nouveau message RDS. */
-#define SLEEP_DELAY 40
-
-/* Taille totale en bytes des blocks RDS. */
-#define RDS_BLOCKS_SIZE (RDS_BLOCKS_N * sizeof(uint16_t))
-
 /* Types d'events clients/serveur. */
 #define EVENT_MALFORMED_MESSAGE 0
 #define EVENT_VOLUME 1
@@ -36,32 +30,127 @@
 #define EVENT_SEEKDOWN 4
 #define EVENT_RADIO_NAME 5
 #define EVENT_RADIO_TEXT 6
+#define EVENT_STATION 7
+#define EVENT_PRESET 8
+#define EVENT_PRESET_SAVE 9
+#define EVENT_TUNER 10
+#define EVENT_RDS_PROVISIONAL 11
+#define EVENT_RADIO_TEXT_PART 12
+#define EVENT_PROTOCOL 13
+
+#define EVENT_TYPES_N 14
 
 /* Taille des events. size(Id_event) + size(Data_event) en bytes. */
 #define EVENT_VOLUME_SIZE 2
 #define EVENT_CHANNEL_SIZE 3
-
-/* Message d'erreur renvoyé si un client a émis une mauvaise requête. */
-static const char MALFORMED_MESSAGE[] = { 1, EVENT_MALFORMED_MESSAGE };
-#define MALFORMED_MESSAGE_SIZE (sizeof(MALFORMED_MESSAGE))
-
-/* Masks utilisés sur Handler_value.to_set. */
+#define EVENT_SEEK_SIZE 1
+#define EVENT_PRESET_SIZE 2
+#define EVENT_TUNER_SIZE 2
+#define EVENT_PROTOCOL_SIZE 2
+
+/* Versions du protocole. Un client commence en v1 (longueur des messages
+   sur 1 byte) et demande une autre version par un EVENT_PROTOCOL. En v2,
+   la longueur est sur 2 bytes et les events de tous les tuners d'une
+   boucle sont envoyés dans un seul message. */
+#define PROTOCOL_V1 1
+#define PROTOCOL_V2 2
+#define PROTOCOL_MAX PROTOCOL_V2
+
+/* Les clients v1 lisent la longueur d'un message comme un char signé. */
+#define MESSAGE_V1_LENGTH_MAX 127
+
+#define MESSAGE_V2_HEADER_SIZE 2
+#define MESSAGE_V2_LENGTH_MAX 65535
+
+/* Masks utilisés sur Handler_tuner.to_set. */
 #define MASK_VOLUME (1 << (EVENT_VOLUME - 1))
 #define MASK_CHANNEL (1 << (EVENT_CHANNEL - 1))
 #define MASK_SEEKUP (1 << (EVENT_SEEKUP - 1))
 #define MASK_SEEKDOWN (1 << (EVENT_SEEKDOWN - 1))
-
-#define SEND_BUFFER_SIZE 128
+#define MASK_PRESET (1 << (EVENT_PRESET - 1))
+#define MASK_PRESET_SAVE (1 << (EVENT_PRESET_SAVE - 1))
+
+/* Flag A/B du texte dans le byte de position d'un EVENT_RADIO_TEXT_PART. */
+#define TEXT_PART_AB 0x80
+
+#define SEND_BUFFER_SIZE 256
+
+/* Octets ajoutés au plus à SEND_BUFFER_SIZE octets d'events par leurs
+   messages: coupés en 5 messages v1 au plus, chacun avec sa longueur,
+   ou dans un message v2 précédés d'un EVENT_TUNER. */
+#define MESSAGE_OVERHEAD (5 * (1 + EVENT_TUNER_SIZE))
+
+/* Longueur d'un message v1, premier byte du message. */
+#define MESSAGE_LENGTH(BUF) ((uint8_t)*(BUF))
+
+/* Requête d'un client pour un tuner, appliquée si le message est valide. */
+typedef struct Request {
+  int to_set;
+  uint8_t volume;
+  uint16_t channel;
+  uint8_t preset;
+} Request;
+
+/* Trame en cours d'encodage dans une version du protocole, allouée au
+   premier ajout. */
+typedef struct Writer {
+  Frame *frame;
+  int size;
+  int protocol;
+  char *message; /* Message v2 ouvert, ou NULL. */
+  int tuner; /* Tuner des events suivants du message v2. */
+} Writer;
 
 /* --------------------------------------------------------------------- */
 
-static inline void __print_message (const char *buf) {
-  int i;
+static inline int __get_header_size (int protocol) {
+  return protocol == PROTOCOL_V2 ? MESSAGE_V2_HEADER_SIZE : 1;
+}
+
+static inline int __get_message_length (const char *buf, int protocol) {
+  uint16_t len;
+
+  if (protocol != PROTOCOL_V2)
+    return MESSAGE_LENGTH(buf);
+
+  deserialize_uint16((char *)buf, &len);
+
+  return len;
+}
+
+static inline void __set_message_length (char *buf, int protocol, int len) {
+  if (protocol == PROTOCOL_V2)
+    serialize_uint16(buf, len);
+  else
+    *buf = len;
+
+  return;
+}
+
+/* Longueur max d'un message client: en v2, celle du buffer du client
+   dans le serveur, bien en deçà de MESSAGE_V2_LENGTH_MAX. */
+static inline int __get_message_length_max (int protocol) {
+  return protocol == PROTOCOL_V2 ? SERVER_CLIENT_BUFFER_SIZE : MESSAGE_V1_LENGTH_MAX;
+}
 
-  for (i = 0; i < *buf; i++)
-      printf("%02x", buf[i]);
+static inline void __print_message (const char *buf, int protocol) {
+  int i, len = __get_message_length(buf, protocol);
 
-  printf(" (length=%d)\n", *buf);
+  for (i = 0; i < len; i++)
+      printf("%02x", (uint8_t)buf[i]);
+
+  printf(" (length=%d)\n", len);
+
+  return;
+}
+
+static void __print_frame (const Frame *frame, int protocol) {
+  const char *p;
+
+  for (p = frame->data; p < frame->data + frame->len; p += __get_message_length(p, protocol)) {
+    printf("[server]Broadcast (v%d): ", protocol);
+    __print_message(p, protocol);
+  }
 
   return;
 }
@@ -90,72 +179,177 @@ static inline int __add_text_to_buf (char *buf, uint8_t event, const char *s, ui
 
 /* --------------------------------------------------------------------- */
 
-static int __add_volume_to_buf (char *buf, Fm_tuner *fm_tuner, int volume) {
-  int new_volume = fm_tuner_set_volume(fm_tuner, volume);
+static int __add_station_to_buf (char *buf, const Station *station) {
+  const uint8_t len = strlen(station->name);
 
-  if (new_volume == -1) {
-    error("[server]Set volume failed.");
+  *buf++ = EVENT_STATION;
+  buf = serialize_uint16(buf, station->channel);
+  buf = serialize_uint8(buf, station->rssi);
+  buf = serialize_uint16(buf, station->pi);
+  *buf++ = len;
+  strncpy(buf, station->name, len);
+
+  return len + 7;
+}
+
+/* --------------------------------------------------------------------- */
+
+static int __add_preset_to_buf (char *buf, int preset, int channel) {
+  *buf++ = EVENT_PRESET;
+  *buf++ = preset;
+  serialize_uint16(buf, channel);
+
+  return 4;
+}
+
+static int __add_presets_to_buf (char *buf, Store *store, int tuner) {
+  Store_state state;
+  char *p = buf;
+  int i;
+
+  if (store == NULL || store_get_state(store, tuner, &state) == -1)
     return 0;
-  }
 
-  printf("[server]Set volume: %d.\n", new_volume);
-  return __add_uint8_to_buf(buf, EVENT_VOLUME, new_volume);
+  for (i = 0; i < STORE_PRESETS_N; i++)
+    if (state.presets[i] != STORE_PRESET_NONE)
+      p += __add_preset_to_buf(p, i, state.presets[i]);
+
+  return p - buf;
 }
 
-static int __add_channel_to_buf (char *buf, Fm_tuner *fm_tuner, int channel) {
-  int new_channel = fm_tuner_set_channel(fm_tuner, channel);
+/* --------------------------------------------------------------------- */
+
+/* Le nom/texte n'est ajouté que si sa génération a changé depuis le
+   dernier envoi. */
+static int __add_radio_name_to_buf (char *buf, Handler_tuner *tuner) {
+  const char *radio_name = tuner->snapshot.radio_name;
 
-  if (new_channel == -1) {
-    error("[server]Set channel failed.");
+  if (tuner->snapshot.gens[RDS_FIELD_NAME] == tuner->name_gen)
     return 0;
-  }
 
-  printf("[server]Set channel: %d.\n", new_channel);
-  return __add_uint16_to_buf(buf, EVENT_CHANNEL, new_channel);
+  tuner->name_gen = tuner->snapshot.gens[RDS_FIELD_NAME];
+
+  return __add_text_to_buf(buf, EVENT_RADIO_NAME, radio_name, strlen(radio_name));
 }
 
-static int __add_seek_to_buf (char *buf, Fm_tuner *fm_tuner, int direction) {
-  int cur_channel = fm_tuner_get_channel(fm_tuner);
-  int new_channel;
-  int success;
+static int __add_radio_text_to_buf (char *buf, Handler_tuner *tuner) {
+  const char *radio_text = tuner->snapshot.radio_text;
 
-  if ((new_channel = fm_tuner_seek(fm_tuner, direction, &success)) == -1 || !success) {
-    error("[server]Seek failed.");
-    return __add_channel_to_buf(buf, fm_tuner, cur_channel);
-  }
+  if (tuner->snapshot.gens[RDS_FIELD_TEXT] == tuner->text_gen)
+    return 0;
+
+  tuner->text_gen = tuner->snapshot.gens[RDS_FIELD_TEXT];
+
+  return __add_text_to_buf(buf, EVENT_RADIO_TEXT, radio_text, strlen(radio_text));
+}
+
+static int __add_provisional_to_buf (char *buf, Handler_tuner *tuner) {
+  if (tuner->snapshot.gens[RDS_FIELD_PROVISIONAL] == tuner->provisional_gen)
+    return 0;
+
+  tuner->provisional_gen = tuner->snapshot.gens[RDS_FIELD_PROVISIONAL];
+
+  return __add_uint8_to_buf(buf, EVENT_RDS_PROVISIONAL, tuner->snapshot.provisional);
+}
+
+/* --------------------------------------------------------------------- */
+
+static inline int __add_text_part_to_buf (char *buf, int ab, int start, const char *s, uint8_t len) {
+  *buf++ = EVENT_RADIO_TEXT_PART;
+  *buf++ = (ab ? TEXT_PART_AB : 0) | start;
+  *buf++ = len;
+  memcpy(buf, s, len);
 
-  printf("[server]Seek success, channel: %d.\n", new_channel);
-  return __add_uint16_to_buf(buf, EVENT_CHANNEL, new_channel);
+  return len + 3;
 }
 
-static int __add_radio_name_to_buf (char *buf, Rds *rds) {
-  static char prev_radio_name[RDS_RADIO_NAME_MAX_LENGTH + 1];
-  const char *radio_name = rds_get_radio_name(rds);
+/* Retourne le nombre de caractères connus d'un segment du texte: le
+   segment entier, ou jusqu'à la fin du texte. Sinon 0. */
+static inline int __get_segment_length (const char *text) {
+  int i;
+
+  for (i = 0; i < RDS_RADIO_TEXT_SEGMENT_LENGTH && text[i] != '\0'; i++)
+    if (text[i] == RDS_CARRIAGE_RETURN)
+      return i + 1;
+
+  return i == RDS_RADIO_TEXT_SEGMENT_LENGTH ? i : 0;
+}
+
+/* Ajoute les segments connus du texte en cours de réception qui
+   diffèrent de ceux de sent, mis à jour. Les segments consécutifs
+   sont envoyés ensemble. */
+static int __add_text_parts_to_buf (char *buf, const Rds_snapshot *snapshot, char *sent) {
+  const char *text = snapshot->partial_text;
+  char *p = buf;
+  int i, len, start = -1, end = 0;
+  int send;
+
+  for (i = 0; i <= RDS_RADIO_TEXT_MAX_LENGTH; i += RDS_RADIO_TEXT_SEGMENT_LENGTH) {
+    len = i < RDS_RADIO_TEXT_MAX_LENGTH ? __get_segment_length(text + i) : 0;
+    send = len > 0 && memcmp(text + i, sent + i, len);
+
+    /* Fin d'une suite de segments. */
+    if (start != -1 && (!send || end != i)) {
+      p += __add_text_part_to_buf(p, snapshot->text_ab, start, text + start, end - start);
+      start = -1;
+    }
+
+    if (send) {
+      if (start == -1)
+        start = i;
 
-  if (strcmp(prev_radio_name, radio_name)) {
-    strcpy(prev_radio_name, radio_name);
-    return __add_text_to_buf(buf, EVENT_RADIO_NAME, radio_name, strlen(radio_name));
+      end = i + len;
+      memcpy(sent + i, text + i, len);
+    }
   }
 
-  return 0;
+  return p - buf;
 }
 
-static int __add_radio_text_to_buf (char *buf, Rds *rds) {
-  static char prev_radio_text[RDS_RADIO_TEXT_MAX_LENGTH + 1];
-  const char *radio_text = rds_get_radio_text(rds);
+/* Le texte en cours de réception est complet lorsqu'il est le texte
+   publié, suivi d'un retour chariot ou de caractères inconnus. */
+static int __is_text_complete (const Rds_snapshot *snapshot) {
+  const int len = strlen(snapshot->radio_text);
 
-  if (strcmp(prev_radio_text, radio_text)) {
-    strcpy(prev_radio_text, radio_text);
-    return __add_text_to_buf(buf, EVENT_RADIO_TEXT, radio_text, strlen(radio_text));
+  return len > 0 && !memcmp(snapshot->partial_text, snapshot->radio_text, len) &&
+    (len == RDS_RADIO_TEXT_MAX_LENGTH || snapshot->partial_text[len] == RDS_CARRIAGE_RETURN ||
+     snapshot->partial_text[len] == '\0');
+}
+
+/* Un nouveau texte (flag A/B changé) est envoyé en entier. Un texte
+   complet ne l'est pas: EVENT_RADIO_TEXT le donne déjà. */
+static int __add_radio_text_parts_to_buf (char *buf, Handler_tuner *tuner) {
+  if (tuner->snapshot.gens[RDS_FIELD_PARTIAL_TEXT] == tuner->partial_gen)
+    return 0;
+
+  tuner->partial_gen = tuner->snapshot.gens[RDS_FIELD_PARTIAL_TEXT];
+
+  if (tuner->snapshot.text_ab != tuner->text_ab) {
+    tuner->text_ab = tuner->snapshot.text_ab;
+    memset(tuner->sent_text, 0, sizeof tuner->sent_text);
   }
 
-  return 0;
+  if (__is_text_complete(&tuner->snapshot)) {
+    memcpy(tuner->sent_text, tuner->snapshot.partial_text, sizeof tuner->sent_text);
+    return 0;
+  }
+
+  return __add_text_parts_to_buf(buf, &tuner->snapshot, tuner->sent_text);
+}
+
+/* Les segments déjà envoyés sont oubliés: les clients effacent le texte
+   en cours de réception à chaque changement de channel. */
+static inline void __reset_text_parts (Handler_tuner *tuner) {
+  memset(tuner->sent_text, 0, sizeof tuner->sent_text);
+  tuner->partial_gen = 0;
+
+  return;
 }
 
 /* --------------------------------------------------------------------- */
 
-static void __update_leds (Fm_tuner *fm_tuner) {
-  float rssi = fm_tuner_get_rssi(fm_tuner) * 100 / (float)FM_TUNER_RSSI_MAX;
+static void __update_leds (int rssi_value) {
+  float rssi = rssi_value * 100 / (float)FM_TUNER_RSSI_MAX;
   int n = rssi / 20;
   int i;
 
@@ -169,118 +363,439 @@ static void __update_leds (Fm_tuner *fm_tuner) {
 
 /* --------------------------------------------------------------------- */
 
-static int __parse_event (char *buf, int len, Handler_value *value) {
-  char to_set = 0;
-  uint8_t new_volume;
-  uint16_t new_channel;
+/* Etat de la lecture d'un message client. */
+typedef struct Parse_state {
+  Handler_value *value;
+  Request requests[HANDLER_TUNERS_MAX];
+  Request *request; /* Requête du tuner des events suivants. */
+  int protocol; /* Version demandée par un EVENT_PROTOCOL, sinon 0. */
+} Parse_state;
+
+/* Lit les données d'un event client.
+   Retourne -1 si elles sont invalides, sinon 0. */
+typedef int (*Event_parser)(char *data, Parse_state *state);
+
+/* Event échangé avec les clients: taille, bits de Request.to_set et
+   lecture des données (NULL s'il n'en a pas) d'un event reçu, un event
+   de taille nulle n'étant pas accepté des clients. protocol est la
+   première version du protocole dont les clients envoient ou reçoivent
+   l'event: ceux d'une version antérieure ne le connaissent pas. */
+typedef struct Event_type {
+  int size;
+  int mask;
+  Event_parser parse;
+  int protocol;
+} Event_type;
+
+static int __parse_tuner (char *data, Parse_state *state) {
+  uint8_t id;
+
+  deserialize_uint8(data, &id);
+
+  if (id >= state->value->n_tuners)
+    return -1;
 
-  if (len <= 0)
+  /* Les events suivants concernent ce tuner. */
+  state->request = &state->requests[id];
+
+  return 0;
+}
+
+static int __parse_volume (char *data, Parse_state *state) {
+  deserialize_uint8(data, &state->request->volume);
+
+  return 0;
+}
+
+static int __parse_channel (char *data, Parse_state *state) {
+  deserialize_uint16(data, &state->request->channel);
+
+  return 0;
+}
+
+static int __parse_preset (char *data, Parse_state *state) {
+  deserialize_uint8(data, &state->request->preset);
+
+  return state->request->preset < STORE_PRESETS_N ? 0 : -1;
+}
+
+static int __parse_protocol (char *data, Parse_state *state) {
+  uint8_t version;
+
+  deserialize_uint8(data, &version);
+
+  if (version < PROTOCOL_V1)
     return -1;
 
-  /* Tant que le message n'est pas traité en entier... */
-  while (len > 0)
-    switch (*buf++) {
-      case EVENT_VOLUME:
-        if (len < EVENT_VOLUME_SIZE)
-          return -1;
-
-        to_set |= MASK_VOLUME;
-        buf = deserialize_uint8(buf, &new_volume);
-        len -= EVENT_VOLUME_SIZE;
-        break;
+  /* Un client plus récent utilise la plus haute version connue. */
+  state->protocol = version > PROTOCOL_MAX ? PROTOCOL_MAX : version;
 
-      case EVENT_CHANNEL:
-        if (len < EVENT_CHANNEL_SIZE)
-          return -1;
+  return 0;
+}
 
-        to_set |= MASK_CHANNEL;
-        buf = deserialize_uint16(buf, &new_channel);
-        len -= EVENT_CHANNEL_SIZE;
-        break;
+static const Event_type event_types[EVENT_TYPES_N] = {
+  [EVENT_MALFORMED_MESSAGE] = { 0, 0, NULL, PROTOCOL_V1 },
+  [EVENT_VOLUME] = { EVENT_VOLUME_SIZE, MASK_VOLUME, __parse_volume, PROTOCOL_V1 },
+  [EVENT_CHANNEL] = { EVENT_CHANNEL_SIZE, MASK_CHANNEL, __parse_channel, PROTOCOL_V1 },
+  [EVENT_SEEKUP] = { EVENT_SEEK_SIZE, MASK_SEEKUP, NULL, PROTOCOL_V1 },
+  [EVENT_SEEKDOWN] = { EVENT_SEEK_SIZE, MASK_SEEKDOWN, NULL, PROTOCOL_V1 },
+  [EVENT_RADIO_NAME] = { 0, 0, NULL, PROTOCOL_V1 },
+  [EVENT_RADIO_TEXT] = { 0, 0, NULL, PROTOCOL_V1 },
+  [EVENT_STATION] = { 0, 0, NULL, PROTOCOL_V2 },
+  [EVENT_PRESET] = { EVENT_PRESET_SIZE, MASK_PRESET, __parse_preset, PROTOCOL_V2 },
+  [EVENT_PRESET_SAVE] = { EVENT_PRESET_SIZE, MASK_PRESET_SAVE, __parse_preset, PROTOCOL_V2 },
+  [EVENT_TUNER] = { EVENT_TUNER_SIZE, 0, __parse_tuner, PROTOCOL_V2 },
+  [EVENT_RDS_PROVISIONAL] = { 0, 0, NULL, PROTOCOL_V2 },
+  [EVENT_RADIO_TEXT_PART] = { 0, 0, NULL, PROTOCOL_V2 },
+  [EVENT_PROTOCOL] = { EVENT_PROTOCOL_SIZE, 0, __parse_protocol, PROTOCOL_V1 }
+};
 
-      case EVENT_SEEKUP:
-        to_set |= MASK_SEEKUP;
-        buf++;
-        len--;
-        break;
+/* --------------------------------------------------------------------- */
 
-      case EVENT_SEEKDOWN:
-        to_set |= MASK_SEEKDOWN;
-        buf++;
-        len--;
-        break;
+/* Retourne la taille d'un event envoyé aux clients. */
+static int __get_event_size (const char *event) {
+  switch (*event) {
+    case EVENT_MALFORMED_MESSAGE:
+      return 1;
+    case EVENT_CHANNEL:
+      return EVENT_CHANNEL_SIZE;
+    case EVENT_PRESET:
+      return 4;
+    case EVENT_RADIO_NAME:
+    case EVENT_RADIO_TEXT:
+      return 2 + (uint8_t)event[1];
+    case EVENT_STATION:
+      return 7 + (uint8_t)event[6];
+    case EVENT_RADIO_TEXT_PART:
+      return 3 + (uint8_t)event[2];
+    default:
+      return 2;
+  }
+}
+
+/* Copie dans dst les events connus des clients d'une version du
+   protocole. Retourne leur taille. */
+static int __filter_events (char *dst, const char *events, int len, int protocol) {
+  char *p = dst;
+  int n, size;
+
+  for (n = 0; n < len; n += size) {
+    size = __get_event_size(events + n);
 
-      default:
-        return -1;
+    if (event_types[(uint8_t)events[n]].protocol <= protocol) {
+      memcpy(p, events + n, size);
+      p += size;
     }
+  }
 
-  /* Mise en cache des registres à mettre à jour côté tuner. */
-  if (to_set & MASK_VOLUME)
-    value->new_volume = new_volume;
-  if (to_set & MASK_CHANNEL)
-    value->new_channel = new_channel;
+  return p - dst;
+}
 
-  value->to_set |= to_set;
+static void __writer_init (Writer *writer, int protocol, int size) {
+  writer->frame = NULL;
+  writer->size = size;
+  writer->protocol = protocol;
+  writer->message = NULL;
 
-  return 0;
+  return;
 }
 
-int handler_event (Socket sock, int id, char *buf, int len, void *user_value) {
-  Handler_value *value = user_value;
-  int msg_len = len;
+static void __writer_close (Writer *writer) {
+  char *end;
 
-  /* Parse un ensemble de messages clients. */
-  while (msg_len > 0 && msg_len >= *buf) {
-    printf("[server]Received message of client %d: ", id);
-    __print_message(buf);
+  if (writer->message == NULL)
+    return;
 
-    /* Parse un message. */
-    if (__parse_event(buf + 1, *buf - 1, value) == -1) {
-      printf("[server]Malformed message of client %d.\n", id);
+  end = writer->frame->data + writer->frame->len;
+  __set_message_length(writer->message, PROTOCOL_V2, end - writer->message);
+  writer->message = NULL;
+
+  return;
+}
+
+/* Ajoute les events d'un tuner (-1 pour les events sans tuner, comme
+   les stations). Seuls les events connus du protocole sont gardés, et
+   ceux du tuner 0 sans EVENT_TUNER. En v1, chaque ajout est un message,
+   coupé entre deux events avant MESSAGE_V1_LENGTH_MAX. En v2, les ajouts
+   sont regroupés dans un message, coupé avant MESSAGE_V2_LENGTH_MAX,
+   dont les events concernent le tuner 0 jusqu'au premier EVENT_TUNER. */
+static void __writer_add (Writer *writer, int tuner, const char *events, int len) {
+  char known[SEND_BUFFER_SIZE];
+  char *p;
+  int n;
+
+  if (writer->protocol < PROTOCOL_MAX) {
+    if (tuner > 0 && event_types[EVENT_TUNER].protocol > writer->protocol)
+      return;
+
+    if ((len = __filter_events(known, events, len, writer->protocol)) == 0)
+      return;
+
+    events = known;
+  }
+
+  if (writer->frame == NULL)
+    writer->frame = frame_new(writer->size);
 
-      /* Indique une erreur et deconnecte le client. */
-      tcp_send(sock, (void *)MALFORMED_MESSAGE, MALFORMED_MESSAGE_SIZE);
-      shutdown(sock, SHUT_RDWR);
+  p = writer->frame->data + writer->frame->len;
 
-      return len;
+  if (writer->protocol == PROTOCOL_V2) {
+    if (writer->message != NULL && p - writer->message + EVENT_TUNER_SIZE + len > MESSAGE_V2_LENGTH_MAX)
+      __writer_close(writer);
+
+    if (writer->message == NULL) {
+      writer->message = p;
+      writer->tuner = 0;
+      p += MESSAGE_V2_HEADER_SIZE;
+    }
+
+    if (tuner >= 0 && tuner != writer->tuner) {
+      p += __add_uint8_to_buf(p, EVENT_TUNER, tuner);
+      writer->tuner = tuner;
     }
 
-    msg_len -= *buf;
-    buf += *buf;
+    memcpy(p, events, len);
+    writer->frame->len = p + len - writer->frame->data;
+
+    return;
   }
 
-  return len - msg_len;
+  while (len > 0) {
+    writer->message = p++;
+
+    /* Au moins un event par message. */
+    n = __get_event_size(events);
+
+    while (n < len && p - writer->message + n + __get_event_size(events + n) <= MESSAGE_V1_LENGTH_MAX)
+      n += __get_event_size(events + n);
+
+    memcpy(p, events, n);
+    p += n;
+    events += n;
+    len -= n;
+
+    __set_message_length(writer->message, PROTOCOL_V1, p - writer->message);
+  }
+
+  writer->message = NULL;
+  writer->frame->len = p - writer->frame->data;
+
+  return;
+}
+
+/* Retourne la trame encodée, ou NULL si rien n'a été ajouté. */
+static Frame *__writer_finish (Writer *writer) {
+  __writer_close(writer);
+
+  return writer->frame;
+}
+
+/* Envoie des events à un client dans un message de son protocole. */
+static void __send_events (Server *server, int id, int protocol, const char *events, int len) {
+  char buf[MESSAGE_V2_HEADER_SIZE + SEND_BUFFER_SIZE];
+  int header = __get_header_size(protocol);
+
+  __set_message_length(buf, protocol, header + len);
+  memcpy(buf + header, events, len);
+  server_send(server, id, buf, header + len);
+
+  return;
 }
 
 /* --------------------------------------------------------------------- */
 
-void handler_join (Socket sock, int id, void *user_value) {
-  Handler_value *value = user_value;
-  static char buf[SEND_BUFFER_SIZE];
-  char *p = buf + 1;
+/* Encode tout l'état en une trame: la carte des stations si stations,
+   puis les valeurs et presets de chaque tuner. En v1, seuls le
+   volume, le channel et le radio name/text du tuner 0 sont envoyés. */
+static Frame *__state_frame (Handler_value *value, int stations, int protocol) {
+  Handler_tuner *tuner;
+  Rds_snapshot snapshot;
+  Writer writer;
+  char events[SEND_BUFFER_SIZE];
+  char sent[RDS_RADIO_TEXT_MAX_LENGTH];
+  char *p;
+  int i, len, size;
+
+  stations = stations && value->stations != NULL;
+  size = value->n_tuners * 3 * (SEND_BUFFER_SIZE + MESSAGE_OVERHEAD);
+
+  if (stations)
+    for (i = 0; i < value->stations->n; i++)
+      size += strlen(value->stations->stations[i].name) + 7 + MESSAGE_OVERHEAD;
+
+  __writer_init(&writer, protocol, size);
+
+  if (stations)
+    for (i = 0; i < value->stations->n; i++)
+      __writer_add(&writer, -1, events, __add_station_to_buf(events, &value->stations->stations[i]));
+
+  for (i = 0; i < value->n_tuners; i++) {
+    tuner = &value->tuners[i];
+    rds_get_snapshot(tuner->rds, &snapshot);
+
+    /* Valeurs actuelles du volume/channel, radio name/text. */
+    p = events;
+    p += __add_uint8_to_buf(p, EVENT_VOLUME, tuner->volume);
+    p += __add_uint16_to_buf(p, EVENT_CHANNEL, tuner->channel);
+    p += __add_uint8_to_buf(p, EVENT_RDS_PROVISIONAL, snapshot.provisional);
+    p += __add_text_to_buf(p, EVENT_RADIO_NAME, snapshot.radio_name, strlen(snapshot.radio_name));
+    p += __add_text_to_buf(p, EVENT_RADIO_TEXT, snapshot.radio_text, strlen(snapshot.radio_text));
+
+    __writer_add(&writer, i, events, p - events);
+
+    /* Les segments d'un texte incomplet, dans un autre message que le
+       texte publié. */
+    if (!__is_text_complete(&snapshot)) {
+      memset(sent, 0, sizeof sent);
+
+      if ((len = __add_text_parts_to_buf(events, &snapshot, sent)) > 0)
+        __writer_add(&writer, i, events, len);
+    }
 
-  const char *radio_name = rds_get_radio_name(value->rds);
-  const char *radio_text = rds_get_radio_text(value->rds);
+    /* Puis les presets mémorisés. */
+    if ((len = __add_presets_to_buf(events, value->store, i)) > 0)
+      __writer_add(&writer, i, events, len);
+  }
 
-  (void)id;
+  return __writer_finish(&writer);
+}
 
-  /* Envoie les valeurs actuelles du volume/channel, radio name/text. */
-  p += __add_uint8_to_buf(p, EVENT_VOLUME, fm_tuner_get_volume(value->fm_tuner));
-  p += __add_uint16_to_buf(p, EVENT_CHANNEL, fm_tuner_get_channel(value->fm_tuner));
-  p += __add_text_to_buf(p, EVENT_RADIO_NAME, radio_name, strlen(radio_name));
-  p += __add_text_to_buf(p, EVENT_RADIO_TEXT, radio_text, strlen(radio_text));
-  *buf = p - buf;
+void handler_join (Server *server, int id, void *user_value) {
+  Frame *frame;
 
-  if (*buf - 1 > 0)
-    tcp_send(sock, buf, *buf);
+  /* Un client parle v1 tant qu'il n'a pas demandé une autre version. */
+  if (server_get_protocol(server, id) == 0)
+    server_set_protocol(server, id, PROTOCOL_V1);
+
+  frame = __state_frame(user_value, 1, server_get_protocol(server, id));
+  server_send_frame(server, id, frame);
+  frame_unref(frame);
 
   return;
 }
 
 /* --------------------------------------------------------------------- */
 
-void handler_quit (Socket sock, int id, void *user_value) {
-  (void)sock;
+/* Lit les events d'un message d'un client du protocole protocol.
+   requested reçoit la version demandée par le client, ou 0. Retourne -1
+   si le message est invalide, sinon 0. */
+static int __parse_event (char *buf, int len, Handler_value *value, int protocol, int *requested) {
+  Parse_state state;
+  const Event_type *type;
+  Request *request;
+  Handler_tuner *tuner;
+  int i;
+
+  if (len <= 0)
+    return -1;
+
+  memset(&state, 0, sizeof state);
+  state.value = value;
+  state.request = state.requests;
+
+  /* Tant que le message n'est pas traité en entier... */
+  while (len > 0) {
+    if ((uint8_t)*buf >= EVENT_TYPES_N)
+      return -1;
+
+    type = &event_types[(uint8_t)*buf];
+
+    if (type->size == 0 || type->protocol > protocol || len < type->size)
+      return -1;
+
+    if (type->parse != NULL && type->parse(buf + 1, &state) == -1)
+      return -1;
+
+    state.request->to_set |= type->mask;
+    buf += type->size;
+    len -= type->size;
+  }
+
+  /* Mise en cache des registres à mettre à jour côté tuners. */
+  for (i = 0; i < value->n_tuners; i++) {
+    request = &state.requests[i];
+    tuner = &value->tuners[i];
+
+    if (request->to_set & MASK_VOLUME)
+      tuner->new_volume = request->volume;
+    if (request->to_set & MASK_CHANNEL)
+      tuner->new_channel = request->channel;
+    if (request->to_set & (MASK_PRESET | MASK_PRESET_SAVE))
+      tuner->preset = request->preset;
+
+    tuner->to_set |= request->to_set;
+  }
+
+  *requested = state.protocol;
+
+  return 0;
+}
+
+int handler_event (Server *server, int id, char *buf, int len, void *user_value) {
+  static const char malformed[] = { EVENT_MALFORMED_MESSAGE };
+  Handler_value *value = user_value;
+  int protocol = server_get_protocol(server, id);
+  int msg_len = len, header, length, requested;
+  char ack[EVENT_PROTOCOL_SIZE];
+  Frame *frame;
+
+  /* Parse un ensemble de messages clients. */
+  while (msg_len >= (header = __get_header_size(protocol))) {
+    length = __get_message_length(buf, protocol);
+
+    /* Un message plus long que le buffer du client ne serait jamais
+       complet, un client v1 ne peut pas en envoyer de plus long que
+       MESSAGE_V1_LENGTH_MAX. */
+    if (length <= header || length > __get_message_length_max(protocol))
+      goto malformed;
+
+    if (msg_len < length)
+      break;
+
+    printf("[server]Received message of client %d: ", id);
+    __print_message(buf, protocol);
+
+    /* Parse un message. */
+    if (__parse_event(buf + header, length - header, value, protocol, &requested) == -1)
+      goto malformed;
+
+    msg_len -= length;
+    buf += length;
+
+    /* Changement de protocole: acquitté dans l'ancien, puis l'état
+       complet est renvoyé et les messages suivants sont lus dans le
+       nouveau. */
+    if (requested != 0) {
+      printf("[server]Client %d uses the protocol v%d.\n", id, requested);
+
+      __add_uint8_to_buf(ack, EVENT_PROTOCOL, requested);
+      __send_events(server, id, protocol, ack, sizeof ack);
+
+      protocol = requested;
+      server_set_protocol(server, id, protocol);
+
+      frame = __state_frame(value, 1, protocol);
+      server_send_frame(server, id, frame);
+      frame_unref(frame);
+    }
+  }
+
+  return len - msg_len;
+
+ malformed:
+  printf("[server]Malformed message of client %d.\n", id);
+
+  /* Indique une erreur et deconnecte le client. */
+  __send_events(server, id, protocol, malformed, sizeof malformed);
+  server_disconnect(server, id);
+
+  return len;
+}
+
+/* --------------------------------------------------------------------- */
+
+void handler_quit (Server *server, int id, void *user_value) {
+  (void)server;
   (void)id;
   (void)user_value;
 
@@ -289,80 +804,363 @@ void handler_quit (Socket sock, int id, void *user_value) {
 
 /* --------------------------------------------------------------------- */
 
-static void __sleep (void) {
+/* Retourne 1 toutes les HANDLER_LOOP_DELAY ms, sinon 0. */
+static int __tick (void) {
   static Time t_prev;
-  static Time t_cur;
-  long sleep_time;
+  Time t_cur;
 
   time_get_cur(&t_cur);
 
-  sleep_time = SLEEP_DELAY - time_diff(&t_prev, &t_cur);
-  sleep_m(sleep_time);
+  if (time_diff(&t_prev, &t_cur) < HANDLER_LOOP_DELAY)
+    return 0;
 
-  time_get_cur(&t_prev);
+  t_prev = t_cur;
+
+  return 1;
+}
+
+static void __send_command (Handler_tuner *tuner, int type, int cmd_value) {
+  if (tuner_worker_send(tuner->worker, type, cmd_value) == -1)
+    error("[server]Tuner worker is busy, command %d dropped.", type);
 
   return;
 }
 
-static void __rds_decode (Handler_value *value) {
-  static uint16_t prev_blocks[RDS_BLOCKS_N]; /* Permet d'éliminer les doublons. */
-  uint16_t blocks[RDS_BLOCKS_N];
-  int data_exists;
+/* --------------------------------------------------------------------- */
+
+static void __save_state (Handler_value *value, int id, int save_preset) {
+  Handler_tuner *tuner = &value->tuners[id];
+  Store_state state;
+
+  if (value->store == NULL)
+    return;
+
+  if (store_get_state(value->store, id, &state) == -1)
+    memset(&state, 0, sizeof state);
 
-  fm_tuner_read_rds(value->fm_tuner, blocks, &data_exists);
+  state.channel = tuner->channel;
+  state.volume = tuner->volume;
 
-  if (data_exists && memcmp(blocks, prev_blocks, RDS_BLOCKS_SIZE)) {
-    rds_decode(value->rds, blocks);
-    memcpy(prev_blocks, blocks, RDS_BLOCKS_SIZE);
+  if (save_preset) {
+    state.presets[tuner->preset] = tuner->channel;
+    tuner->changed |= MASK_PRESET_SAVE;
   }
 
+  store_set_state(value->store, id, &state);
+
   return;
 }
 
-static void __broadcast (Socket_set *ss, Handler_value *value) {
-  static char buf[SEND_BUFFER_SIZE];
-  Socket sock;
-  char *p = buf + 1;
-  int i = socket_set_get_max_size(ss);
+/* Mémorise les données RDS de la station écoutée par un tuner. */
+static void __save_station (Handler_value *value, Handler_tuner *tuner) {
+  const Rds_snapshot *snapshot = &tuner->snapshot;
+  Store_station station;
 
-  /* Mise à jour des registres. */
-  if (value->to_set & MASK_VOLUME)
-    p += __add_volume_to_buf(p, value->fm_tuner, value->new_volume);
+  /* Données déjà connues, ou rien de connu sur la station. */
+  if (snapshot->provisional || (snapshot->pi == 0 && *snapshot->radio_name == '\0'))
+    return;
 
-  if (value->to_set & MASK_CHANNEL)
-    p += __add_channel_to_buf(p, value->fm_tuner, value->new_channel);
-  else if (value->to_set & MASK_SEEKUP)
-    p += __add_seek_to_buf(p, value->fm_tuner, FM_TUNER_SEEKUP);
-  else if (value->to_set & MASK_SEEKDOWN)
-    p += __add_seek_to_buf(p, value->fm_tuner, FM_TUNER_SEEKDOWN);
+  rds_cache_set(value->rds_cache, tuner->channel, snapshot);
 
-  /* Ajout du RDS. */
-  p += __add_radio_name_to_buf(p, value->rds);
-  p += __add_radio_text_to_buf(p, value->rds);
+  if (value->store == NULL)
+    return;
 
-  *buf = p - buf;
+  station.channel = tuner->channel;
+  station.rssi = tuner->rssi;
+  station.pty = snapshot->program_type;
+  station.pi = snapshot->pi;
+  strcpy(station.name, snapshot->radio_name);
+  strcpy(station.text, snapshot->radio_text);
 
-  /* Broadcast. */
-  if (*buf - 1 > 0) {
-    printf("[server]Broadcast: ");
-    __print_message(buf);
+  store_set_station(value->store, &station);
 
-    for (i--; i > 0; i--)
-      if ((sock = socket_set_get(ss, i)) != -1)
-        tcp_send(sock, buf, *buf);
-  }
+  return;
+}
+
+void handler_restore (Handler_value *value, int id) {
+  Handler_tuner *tuner = &value->tuners[id];
+  Rds_cache_entry entry;
+  Store_station station;
+
+  __reset_text_parts(tuner);
+  rds_set_channel(tuner->rds, tuner->channel);
+
+  if (rds_cache_get(value->rds_cache, tuner->channel, RDS_CACHE_ANY_PI, &entry) == 0)
+    rds_set_station(tuner->rds, entry.pi, entry.program_type, entry.radio_name, entry.radio_text);
+  else if (value->store != NULL && store_get_station(value->store, tuner->channel, &station) == 0)
+    rds_set_station(tuner->rds, station.pi, station.pty, station.name, station.text);
+  else
+    rds_set_station(tuner->rds, 0, RDS_PT_NONE, "", "");
+
+  return;
+}
+
+/* Channel d'un preset, ou -1 s'il n'est pas défini. */
+static int __get_preset (Handler_value *value, int id) {
+  Store_state state;
+  int preset = value->tuners[id].preset;
+
+  if (value->store == NULL || store_get_state(value->store, id, &state) == -1 ||
+      state.presets[preset] == STORE_PRESET_NONE)
+    return -1;
+
+  return state.presets[preset];
+}
+
+/* --------------------------------------------------------------------- */
+
+static void __send_commands (Handler_value *value, int id) {
+  Handler_tuner *tuner = &value->tuners[id];
+  int channel;
+
+  if (tuner->to_set & MASK_VOLUME)
+    __send_command(tuner, TUNER_CMD_VOLUME, tuner->new_volume);
+
+  if (tuner->to_set & MASK_PRESET_SAVE)
+    __save_state(value, id, 1);
+
+  /* Un nouveau channel annule un seek en cours. */
+  if (tuner->to_set & MASK_CHANNEL)
+    __send_command(tuner, TUNER_CMD_CHANNEL, tuner->new_channel);
+  else if ((tuner->to_set & MASK_PRESET) && (channel = __get_preset(value, id)) != -1)
+    __send_command(tuner, TUNER_CMD_CHANNEL, channel);
+  else if (tuner->to_set & MASK_SEEKUP)
+    __send_command(tuner, TUNER_CMD_SEEK, FM_TUNER_SEEKUP);
+  else if (tuner->to_set & MASK_SEEKDOWN)
+    __send_command(tuner, TUNER_CMD_SEEK, FM_TUNER_SEEKDOWN);
 
   /* Reset. */
-  value->to_set = 0;
+  tuner->to_set = 0;
 
   return;
 }
 
-void handler_loop (Socket_set *ss, void *user_value) {
-  __sleep();
-  __update_leds(((Handler_value *)user_value)->fm_tuner);
-  __rds_decode(user_value);
-  __broadcast(ss, user_value);
+/* Chaque groupe n'est reçu qu'une fois du thread du tuner: un groupe
+   répété par la station confirme ses propres caractères. */
+static void __rds_decode (Handler_value *value, int id, uint16_t blocks[static RDS_BLOCKS_N],
+                          const uint8_t bler[static RDS_BLOCKS_N]) {
+  Handler_tuner *tuner = &value->tuners[id];
+  Rds_cache_entry entry;
+  uint16_t pi = rds_get_pi(tuner->rds);
+
+  if (value->rds_log != NULL)
+    rds_log_write(value->rds_log, id, tuner->channel, blocks, bler);
+
+  rds_decode(tuner->rds, blocks, bler);
+
+  /* Une autre station que celle attendue: ses données sont peut-être
+     connues, confirmées au prochain block A. */
+  if (rds_get_pi(tuner->rds) != pi && *rds_get_radio_name(tuner->rds) == '\0' &&
+      rds_cache_get(value->rds_cache, tuner->channel, rds_get_pi(tuner->rds), &entry) == 0)
+    rds_set_station(tuner->rds, entry.pi, entry.program_type, entry.radio_name, entry.radio_text);
+
+  return;
+}
+
+/* Envoie au thread du tuner les AF de la station si elles ont changé. */
+static void __send_afs (Handler_tuner *tuner) {
+  const int *afs;
+  uint16_t pi = rds_get_pi(tuner->rds);
+  int n = rds_get_alternative_frequencies(tuner->rds, &afs);
+  int i;
+
+  if (pi == tuner->af_pi && n == tuner->n_afs && !memcmp(afs, tuner->afs, n * sizeof *afs))
+    return;
+
+  __send_command(tuner, TUNER_CMD_AF_LIST, pi);
+
+  for (i = 0; i < n; i++)
+    __send_command(tuner, TUNER_CMD_AF_ADD, afs[i]);
+
+  tuner->af_pi = pi;
+  tuner->n_afs = n;
+  memcpy(tuner->afs, afs, n * sizeof *afs);
+
+  return;
+}
+
+static void __receive_results (Handler_value *value, int id) {
+  Handler_tuner *tuner = &value->tuners[id];
+  Tuner_result result;
+
+  tuner_worker_ack(tuner->worker);
+
+  while (tuner_worker_receive(tuner->worker, &result) != -1)
+    switch (result.type) {
+      case TUNER_RESULT_VOLUME:
+        printf("[server]Set volume of tuner %d: %d.\n", id, result.value);
+        tuner->volume = result.value;
+        tuner->changed |= MASK_VOLUME;
+        __save_state(value, id, 0);
+        break;
+
+      case TUNER_RESULT_CHANNEL:
+        printf("[server]Set channel of tuner %d: %d.\n", id, result.value);
+        tuner->channel = result.value;
+        tuner->changed |= MASK_CHANNEL;
+        __save_state(value, id, 0);
+        handler_restore(value, id);
+        break;
+
+      case TUNER_RESULT_RSSI:
+        tuner->rssi = result.value;
+
+        /* Les leds n'affichent que le premier tuner. */
+        if (id == 0)
+          __update_leds(result.value);
+        break;
+
+      case TUNER_RESULT_RDS:
+        __rds_decode(value, id, result.blocks, result.bler);
+        break;
+
+      case TUNER_RESULT_RDS_STATS:
+        tuner->rds_stats.received += result.rds_stats.received;
+        tuner->rds_stats.missed += result.rds_stats.missed;
+        tuner->rds_stats.duplicated += result.rds_stats.duplicated;
+        tuner->rds_seconds++;
+
+        if (result.rds_stats.missed > 0)
+          printf("[server]RDS of tuner %d: %lu groups received, %lu missed in the last second.\n",
+                 id, result.rds_stats.received, result.rds_stats.missed);
+        break;
+
+      /* Même PI: les données RDS sont gardées. */
+      case TUNER_RESULT_AF:
+        tuner->af_mute_time += result.mute_time;
+        tuner->af_weak_time += result.weak_time;
+
+        if (result.value == tuner->channel) {
+          printf("[server]No AF for tuner %d, %ld ms on a weak signal.\n", id, result.weak_time);
+          tuner->af_failures++;
+          break;
+        }
+
+        printf("[server]AF of tuner %d: %d -> %d, muted %ld ms, %ld ms on a weak signal.\n",
+               id, tuner->channel, result.value, result.mute_time, result.weak_time);
+        tuner->af_switches++;
+        tuner->channel = result.value;
+        tuner->changed |= MASK_CHANNEL;
+        __reset_text_parts(tuner);
+        __save_state(value, id, 0);
+        break;
+    }
+
+  return;
+}
+
+/* Ajoute des events d'un tuner à la trame de chaque protocole. */
+static void __add_to_writers (Writer writers[static PROTOCOL_MAX], int tuner, const char *events, int len) {
+  int i;
+
+  if (len > 0)
+    for (i = 0; i < PROTOCOL_MAX; i++)
+      __writer_add(&writers[i], tuner, events, len);
+
+  return;
+}
+
+/* Encode les changements d'un tuner depuis le dernier appel. */
+static void __encode_changes (Handler_value *value, int id, Writer writers[static PROTOCOL_MAX]) {
+  Handler_tuner *tuner = &value->tuners[id];
+  char buf[SEND_BUFFER_SIZE];
+  char *p = buf;
+  char *rds_start;
+
+  /* Nouvelles valeurs du tuner. */
+  if (tuner->changed & MASK_VOLUME)
+    p += __add_uint8_to_buf(p, EVENT_VOLUME, tuner->volume);
+  if (tuner->changed & MASK_CHANNEL)
+    p += __add_uint16_to_buf(p, EVENT_CHANNEL, tuner->channel);
+  if (tuner->changed & MASK_PRESET_SAVE)
+    p += __add_preset_to_buf(p, tuner->preset, tuner->channel);
+
+  tuner->changed = 0;
+
+  /* Ajout du RDS, mémorisé s'il a changé. La vue n'est copiée que
+     si une génération a changé. */
+  if (rds_get_generation(tuner->rds, RDS_FIELD_ANY) != tuner->snapshot.gens[RDS_FIELD_ANY])
+    rds_get_snapshot(tuner->rds, &tuner->snapshot);
+
+  rds_start = p;
+  p += __add_provisional_to_buf(p, tuner);
+  p += __add_radio_name_to_buf(p, tuner);
+  p += __add_radio_text_to_buf(p, tuner);
+
+  if (p != rds_start)
+    __save_station(value, tuner);
+
+  __add_to_writers(writers, id, buf, p - buf);
+
+  /* Les segments du texte, dans un autre message que le texte publié. */
+  __add_to_writers(writers, id, buf, __add_radio_text_parts_to_buf(buf, tuner));
+
+  return;
+}
+
+/* Les changements sont encodés une fois par protocole dans une trame
+   partagée par les files des clients. La trame v2 est aussi publiée
+   sur le groupe multicast. */
+static void __broadcast (Server *server, Handler_value *value, Writer writers[static PROTOCOL_MAX]) {
+  Frame *frame;
+  int i;
+
+  for (i = 0; i < PROTOCOL_MAX; i++) {
+    if ((frame = __writer_finish(&writers[i])) == NULL)
+      continue;
+
+    __print_frame(frame, writers[i].protocol);
+    server_broadcast(server, writers[i].protocol, frame);
+
+    if (writers[i].protocol == PROTOCOL_V2 && value->feed != NULL)
+      feed_publish(value->feed, frame, 0);
+
+    frame_unref(frame);
+  }
+
+  return;
+}
+
+void handler_loop (Server *server, void *user_value) {
+  Handler_value *value = user_value;
+  Writer writers[PROTOCOL_MAX];
+  Frame *frame;
+  int tick = __tick();
+  int i, size;
+
+  size = value->n_tuners * 2 * (SEND_BUFFER_SIZE + MESSAGE_OVERHEAD);
+
+  for (i = 0; i < PROTOCOL_MAX; i++)
+    __writer_init(&writers[i], PROTOCOL_V1 + i, size);
+
+  for (i = 0; i < value->n_tuners; i++) {
+    __send_commands(value, i);
+
+    /* Lectures périodiques, exécutées par le thread du tuner. Le RDS
+       est lu par le thread au rythme des groupes. */
+    if (tick) {
+      __send_command(&value->tuners[i], TUNER_CMD_READ_RSSI, 0);
+      __send_afs(&value->tuners[i]);
+    }
+
+    __receive_results(value, i);
+
+    __encode_changes(value, i, writers);
+  }
+
+  __broadcast(server, value, writers);
+
+  /* Etat complet pour les récepteurs arrivés en retard ou ayant perdu
+     des datagrammes. */
+  if (value->feed != NULL && feed_keyframe_is_due(value->feed)) {
+    frame = __state_frame(value, 0, PROTOCOL_V2);
+    feed_publish(value->feed, frame, 1);
+    frame_unref(frame);
+  }
+
+  /* Au plus une écriture du log par période. */
+  if (tick && value->rds_log != NULL)
+    rds_log_flush(value->rds_log);
 
   return;
 }
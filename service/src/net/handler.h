@@ -16,22 +16,87 @@
 #ifndef _HANDLER_H_
 #define _HANDLER_H_
 
-#include "../fm_tuner.h"
 #include "../rds.h"
-#include "../utils/socket.h"
+#include "../rds_cache.h"
+#include "../rds_log.h"
+#include "../station_map.h"
+#include "../store.h"
+#include "../tuner_worker.h"
+#include "feed.h"
+#include "server.h"
 
-typedef struct Handler_value {
-  Fm_tuner *fm_tuner;
+/* Période en ms des lectures RSSI/RDS et des broadcasts. */
+#define HANDLER_LOOP_DELAY 40
+
+/* Nombre max de tuners servis, identifiés par leur index. */
+#define HANDLER_TUNERS_MAX STORE_TUNERS_MAX
+
+/* Un tuner servi aux clients. */
+typedef struct Handler_tuner {
+  Tuner_worker *worker;
   Rds *rds;
 
-  char to_set;
+  int to_set;
   int new_channel;
   int new_volume;
+  int preset; /* Preset à rappeler ou à mémoriser. */
+
+  /* Dernières valeurs publiées par le tuner. */
+  int changed;
+  int volume;
+  int channel;
+  int rssi;
+
+  /* Acquisition RDS: compteurs totaux et nombre de secondes. */
+  Tuner_rds_stats rds_stats;
+  unsigned long rds_seconds;
+
+  /* Dernière vue RDS lue et générations du nom/texte/état provisoire
+     envoyés. */
+  Rds_snapshot snapshot;
+  uint32_t name_gen;
+  uint32_t text_gen;
+  uint32_t provisional_gen;
+
+  /* Texte en cours de réception déjà envoyé par segments, avec sa
+     génération et son flag A/B. */
+  char sent_text[RDS_RADIO_TEXT_MAX_LENGTH];
+  uint32_t partial_gen;
+  uint8_t text_ab;
+
+  /* Dernières AF envoyées au thread du tuner. */
+  uint16_t af_pi;
+  int afs[RDS_AF_MAX];
+  int n_afs;
+
+  /* Recherches d'AF: changements de channel, échecs, et durées totales
+     en ms sans son et sur un signal faible. */
+  unsigned long af_switches;
+  unsigned long af_failures;
+  long af_mute_time;
+  long af_weak_time;
+} Handler_tuner;
+
+typedef struct Handler_value {
+  Handler_tuner tuners[HANDLER_TUNERS_MAX];
+  int n_tuners;
+
+  Station_map *stations; /* Carte envoyée aux clients, ou NULL. */
+  Store *store; /* Etat et stations mémorisés, ou NULL. */
+  Rds_cache *rds_cache; /* Stations récemment écoutées. */
+  Rds_log *rds_log; /* Capture des groupes RDS décodés, ou NULL. */
+  Feed *feed; /* Publication multicast des broadcasts, ou NULL. */
 } Handler_value;
 
-int handler_event (Socket sock, int id, char *buf, int len, void *user_value);
-void handler_join (Socket sock, int id, void *user_value);
-void handler_quit (Socket sock, int id, void *user_value);
-void handler_loop (Socket_set *ss, void *user_value);
+/* Remplace les données RDS d'un tuner par celles de la dernière station
+   écoutée sur son channel, sinon par celles du store. Elles restent
+   provisoires jusqu'à la réception du PI. Appelée au démarrage et à
+   chaque changement de channel. */
+void handler_restore (Handler_value *value, int tuner);
+
+int handler_event (Server *server, int id, char *buf, int len, void *user_value);
+void handler_join (Server *server, int id, void *user_value);
+void handler_quit (Server *server, int id, void *user_value);
+void handler_loop (Server *server, void *user_value);
 
 #endif /* _HANDLER_H_ INCLUDED */
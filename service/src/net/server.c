@@ -13,28 +13,55 @@
   along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <errno.h>
 #include <pthread.h>
 #include <signal.h>
 #include <string.h>
+#include <sys/socket.h> /* shutdown */
 
 #include "../utils/alloc.h"
 #include "../utils/error.h"
 #include "server.h"
 
-#define CLIENT_BUFFER_SIZE 128
+#define CLIENT_BUFFER_SIZE SERVER_CLIENT_BUFFER_SIZE
+
+/* Taille initiale d'une file de sortie, doublée lorsqu'elle est pleine. */
+#define CLIENT_FRAMES_MIN 8
+
+/* Trames max envoyées par appel système. */
+#define FLUSH_IOV_MAX 64
+
+/* Trame en position i de la file d'un client. */
+#define FRAME_AT(CLIENT, I) ((CLIENT)->frames[((CLIENT)->first + (I)) % (CLIENT)->max_frames])
 
 typedef struct Client {
   char buf[CLIENT_BUFFER_SIZE];
   int pos;
+  int protocol;
+
+  /* File de sortie (tableau circulaire de trames), octets déjà envoyés
+     de la première trame et octets en attente. */
+  Frame **frames;
+  int first;
+  int n_frames;
+  int max_frames;
+  int head_pos;
+  size_t depth;
+
+  char stale; /* File pleine: état complet à renvoyer une fois vide. */
+  char syncing; /* Envoi de l'état complet en cours. */
+  char closing; /* Déconnexion une fois la file vide. */
 } Client;
 
-typedef struct Server {
+struct Server {
   Socket sock;
   Socket_set *ss;
   Client **clients;
+  Server_conf *conf;
+  Server_stats stats;
   pthread_mutex_t lock_run;
   char run;
-} Server;
+};
 
 /* ---------------------------------------------------------------------- */
 
@@ -83,19 +110,22 @@ static void *__thread_exit (void *arg) {
 
 static void __server_init (Server *server, Server_conf *conf) {
   unsigned int i;
+  int j;
   IP ip;
 
   pmalloc(server->clients, conf->max_clients * sizeof *server->clients);
 
   for (i = 0; i < conf->max_clients; i++)
-    pmalloc(server->clients[i], sizeof **server->clients);
+    pmalloc0(server->clients[i], sizeof **server->clients);
 
+  server->conf = conf;
+  memset(&server->stats, 0, sizeof server->stats);
   server->run = 1;
 
   if (resolve_host(&ip, NULL, conf->port) == -1)
     fatal_error("Unable to make server on port: %d.", conf->port);
 
-  if ((server->sock = tcp_get(&ip)) == -1)
+  if ((server->sock = tcp_get(&ip, conf->backlog)) == -1)
     fatal_error("Unable to get ip.");
 
   /* socket_set contient sockets clients + socket server. */
@@ -103,18 +133,107 @@ static void __server_init (Server *server, Server_conf *conf) {
     fatal_error("Unable to make socket_set.");
 
   socket_set_add(server->ss, server->sock);
+
+  for (j = 0; j < conf->n_wakeup_fds; j++)
+    if (socket_set_watch(server->ss, conf->wakeup_fds[j]) == -1)
+      fatal_error("Unable to watch the wakeup descriptor.");
+
   pthread_mutex_init(&server->lock_run, NULL);
 
   return;
 }
 
+/* Vide la file de sortie d'un client, sauf la première trame si keep.
+   Retourne le nombre de trames abandonnées. */
+static unsigned long __clear_output (Server *server, Client *client, int keep) {
+  unsigned long n = 0;
+  size_t len;
+  int i;
+
+  for (i = keep; i < client->n_frames; i++) {
+    len = FRAME_AT(client, i)->len - (i == 0 ? client->head_pos : 0);
+    client->depth -= len;
+    server->stats.depth -= len;
+
+    frame_unref(FRAME_AT(client, i));
+    n++;
+  }
+
+  if (client->n_frames > keep)
+    client->n_frames = keep;
+
+  if (client->n_frames == 0)
+    client->head_pos = 0;
+
+  return n;
+}
+
+static void __free_output (Server *server, Client *client) {
+  __clear_output(server, client, 0);
+
+  free(client->frames);
+  client->frames = NULL;
+  client->max_frames = 0;
+
+  return;
+}
+
+/* Ajoute une trame à la file d'un client, dont sent octets sont déjà
+   envoyés si la file est vide. */
+static void __push_frame (Server *server, Client *client, Frame *frame, int sent) {
+  Frame **frames;
+  int i, max_frames;
+
+  if (client->n_frames == client->max_frames) {
+    max_frames = client->max_frames ? client->max_frames * 2 : CLIENT_FRAMES_MIN;
+    pmalloc(frames, max_frames * sizeof *frames);
+
+    for (i = 0; i < client->n_frames; i++)
+      frames[i] = FRAME_AT(client, i);
+
+    free(client->frames);
+    client->frames = frames;
+    client->first = 0;
+    client->max_frames = max_frames;
+  }
+
+  client->frames[(client->first + client->n_frames++) % client->max_frames] = frame_ref(frame);
+  client->head_pos += sent;
+  client->depth += frame->len - sent;
+
+  server->stats.queued_frames++;
+  server->stats.depth += frame->len - sent;
+
+  if (client->depth > server->stats.max_depth)
+    server->stats.max_depth = client->depth;
+
+  return;
+}
+
+static void __pop_frame (Client *client) {
+  frame_unref(client->frames[client->first]);
+
+  client->first = (client->first + 1) % client->max_frames;
+  client->n_frames--;
+  client->head_pos = 0;
+
+  return;
+}
+
 static void __server_close (Server *server, Server_conf *conf) {
   unsigned int i;
 
+  debug("[server]Output queues: %lu frames queued, %lu coalesced, %lu resyncs, "
+        "%lu clients dropped, %zu bytes max.\n", server->stats.queued_frames,
+        server->stats.coalesced_frames, server->stats.resyncs,
+        server->stats.dropped_clients, server->stats.max_depth);
+
   socket_set_free(server->ss);
 
-  for (i = 0; i < conf->max_clients; i++)
+  for (i = 0; i < conf->max_clients; i++) {
+    __free_output(server, server->clients[i]);
     free(server->clients[i]);
+  }
 
   free(server->clients);
   pthread_mutex_destroy(&server->lock_run);
@@ -124,52 +243,281 @@ static void __server_close (Server *server, Server_conf *conf) {
 
 /* --------------------------------------------------------------------- */
 
-static void __handle_server (Server *server, Server_conf *conf) {
-  Socket sock = tcp_accept(server->sock);
-  int id;
+static void __close_client (Server *server, int id) {
+  Socket sock = socket_set_get(server->ss, id);
 
-  /* Mauvaise connexion. */
-  if (sock == -1)
-    return;
+  socket_set_remove(server->ss, sock);
+  server->conf->handlers.quit(server, id, server->conf->user_value);
+  tcp_close(sock);
+
+  __free_output(server, server->clients[id - 1]);
+  printf("[server]Bye client %d!\n", id);
+
+  return;
+}
+
+/* Envoie l'état complet à un client. Une file pleine pendant cet envoi
+   ne peut pas être rattrapée: le client est déconnecté. */
+static void __sync (Server *server, int id) {
+  Client *client = server->clients[id - 1];
+
+  client->syncing = 1;
+  server->conf->handlers.join(server, id, server->conf->user_value);
+  client->syncing = 0;
 
-  /* On déconnecte le nouveau client s'il y a trop de monde. */
-  if ((id = socket_set_add(server->ss, sock)) == -1) {
-    printf("[server]No enough place for a new client.\n");
-    tcp_close(sock);
+  return;
+}
+
+/* Le message d'un client ne tient plus dans sa file. */
+static void __queue_full (Server *server, int id) {
+  Client *client = server->clients[id - 1];
+  unsigned long n;
+
+  if (server->conf->overflow == SERVER_OVERFLOW_DROP || client->syncing) {
+    printf("[server]Client %d is too slow, disconnected.\n", id);
+    server->stats.dropped_clients++;
+    __close_client(server, id);
 
     return;
   }
 
-  printf("[server]New client %d!\n", id);
-  memset(server->clients[id - 1], 0, sizeof(Client));
-  conf->handlers.join(sock, id, conf->user_value);
+  /* Seul le message en cours d'envoi est gardé, le reste est remplacé
+     par l'état complet une fois la file vide. */
+  n = __clear_output(server, client, client->head_pos > 0) + 1;
+  printf("[server]Client %d is too slow, %lu frames coalesced.\n", id, n);
+
+  server->stats.coalesced_frames += n;
+  client->stale = 1;
 
   return;
 }
 
-static void __handle_client(Server *server, Server_conf *conf, Socket sock, int id) {
+/* Envoie la file d'un client, plusieurs trames par appel système.
+   Retourne -1 si le client a été déconnecté, sinon 0. */
+static int __flush (Server *server, int id) {
   Client *client = server->clients[id - 1];
-  unsigned int len;
-  int ret;
-
-  /* Normalement si le protocole de gestion des clients est bien fait,
-     ce cas ne devrait jamais arriver. */
-  if (client->pos == CLIENT_BUFFER_SIZE)
-    printf("[server]Warning: buffer is full for client %d!\n", id);
-
-  /* Déconnexion d'un client. */
-  if ((len = tcp_recv(sock, client->buf + client->pos, CLIENT_BUFFER_SIZE - client->pos)) <= 0) {
-    socket_set_remove(server->ss, sock);
-    printf("[server]Bye client %d!\n", id);
+  Socket sock = socket_set_get(server->ss, id);
+  struct iovec iov[FLUSH_IOV_MAX];
+  Frame *frame;
+  int i, n, len, sent, to_send;
+
+  while (client->n_frames > 0) {
+    n = client->n_frames < FLUSH_IOV_MAX ? client->n_frames : FLUSH_IOV_MAX;
+    to_send = -client->head_pos;
+
+    for (i = 0; i < n; i++) {
+      frame = FRAME_AT(client, i);
+      iov[i].iov_base = frame->data;
+      iov[i].iov_len = frame->len;
+      to_send += frame->len;
+    }
+
+    iov[0].iov_base = (char *)iov[0].iov_base + client->head_pos;
+    iov[0].iov_len -= client->head_pos;
+
+    if ((sent = tcp_sendv(sock, iov, n)) == -1) {
+      __close_client(server, id);
+      return -1;
+    }
+
+    client->depth -= sent;
+    server->stats.depth -= sent;
+
+    /* Retire les trames envoyées entièrement. */
+    len = client->head_pos + sent;
+
+    while (client->n_frames > 0 && len >= FRAME_AT(client, 0)->len) {
+      len -= FRAME_AT(client, 0)->len;
+      __pop_frame(client);
+    }
+
+    client->head_pos = len;
+
+    /* Socket plein: attente du prochain EPOLLOUT. */
+    if (sent < to_send)
+      return 0;
+  }
+
+  if (client->closing)
+    shutdown(sock, SHUT_RDWR);
+  else if (client->stale) {
+    client->stale = 0;
+    server->stats.resyncs++;
+    __sync(server, id);
+
+    if (socket_set_get(server->ss, id) != sock)
+      return -1;
+  }
+
+  return 0;
+}
+
+/* --------------------------------------------------------------------- */
+
+int server_send_frame (Server *server, int id, Frame *frame) {
+  Client *client;
+  Socket sock;
+  int sent = 0;
+
+  if (id <= 0 || (sock = socket_set_get(server->ss, id)) == -1)
+    return -1;
+
+  client = server->clients[id - 1];
+
+  if (client->closing)
+    return -1;
+
+  /* La trame est remplacée par l'état complet à venir. */
+  if (client->stale) {
+    server->stats.coalesced_frames++;
+    return -1;
+  }
+
+  /* Envoi direct si rien n'est en attente. */
+  if (client->n_frames == 0 && (sent = tcp_send(sock, frame->data, frame->len)) == -1) {
+    __close_client(server, id);
+    return -1;
   }
 
-  /* Réception d'un message. */
-  else {
+  if (sent == frame->len)
+    return 0;
+
+  /* Une trame commencée est toujours gardée, pour ne pas couper le flux. */
+  if (sent == 0 && client->depth + frame->len > server->conf->queue_size) {
+    __queue_full(server, id);
+    return -1;
+  }
+
+  __push_frame(server, client, frame, sent);
+
+  return 0;
+}
+
+int server_send (Server *server, int id, const void *data, int len) {
+  Frame *frame = frame_new_copy(data, len);
+  int ret = server_send_frame(server, id, frame);
+
+  frame_unref(frame);
+
+  return ret;
+}
+
+void server_broadcast (Server *server, int protocol, Frame *frame) {
+  int i = socket_set_get_max_size(server->ss);
+
+  for (i--; i > 0; i--)
+    if (socket_set_get(server->ss, i) != -1 && server->clients[i - 1]->protocol == protocol)
+      server_send_frame(server, i, frame);
+
+  return;
+}
+
+int server_get_protocol (Server *server, int id) {
+  if (id <= 0 || socket_set_get(server->ss, id) == -1)
+    return -1;
+
+  return server->clients[id - 1]->protocol;
+}
+
+void server_set_protocol (Server *server, int id, int protocol) {
+  if (id > 0 && socket_set_get(server->ss, id) != -1)
+    server->clients[id - 1]->protocol = protocol;
+
+  return;
+}
+
+void server_disconnect (Server *server, int id) {
+  Socket sock;
+
+  if (id <= 0 || (sock = socket_set_get(server->ss, id)) == -1)
+    return;
+
+  /* La fermeture est découverte par la prochaine lecture. */
+  if (server->clients[id - 1]->n_frames == 0)
+    shutdown(sock, SHUT_RDWR);
+  else
+    server->clients[id - 1]->closing = 1;
+
+  return;
+}
+
+long server_get_queue_depth (Server *server, int id) {
+  if (id <= 0 || socket_set_get(server->ss, id) == -1)
+    return -1;
+
+  return server->clients[id - 1]->depth;
+}
+
+void server_get_stats (Server *server, Server_stats *stats) {
+  *stats = server->stats;
+  return;
+}
+
+/* --------------------------------------------------------------------- */
+
+static void __handle_server (Server *server) {
+  Socket sock;
+  int id;
+
+  /* Surveillance sur front: toutes les connexions en attente sont
+     acceptées avant la prochaine attente. */
+  for (;;) {
+    if ((sock = tcp_accept(server->sock)) == -1) {
+      /* Connexion abandonnée par le client avant son acceptation. */
+      if (errno == ECONNABORTED)
+        continue;
+
+      if (errno != EAGAIN && errno != EWOULDBLOCK)
+        error("[server]Unable to accept a client.");
+      break;
+    }
+
+    /* On déconnecte le nouveau client s'il y a trop de monde. */
+    if ((id = socket_set_add(server->ss, sock)) == -1) {
+      printf("[server]No enough place for a new client.\n");
+      tcp_close(sock);
+      continue;
+    }
+
+    printf("[server]New client %d!\n", id);
+    memset(server->clients[id - 1], 0, sizeof(Client));
+    __sync(server, id);
+  }
+
+  return;
+}
+
+static void __handle_client(Server *server, Server_conf *conf, Socket sock, int id) {
+  Client *client = server->clients[id - 1];
+  int len, ret;
+
+  /* Surveillance sur front: le socket est lu jusqu'à EAGAIN. */
+  for (;;) {
+    /* Normalement si le protocole de gestion des clients est bien fait,
+       ce cas ne devrait jamais arriver. */
+    if (client->pos == CLIENT_BUFFER_SIZE)
+      printf("[server]Warning: buffer is full for client %d!\n", id);
+
+    if ((len = tcp_recv(sock, client->buf + client->pos, CLIENT_BUFFER_SIZE - client->pos)) == -1 &&
+        (errno == EAGAIN || errno == EWOULDBLOCK))
+      break;
+
+    /* Déconnexion d'un client. */
+    if (len <= 0) {
+      __close_client(server, id);
+      break;
+    }
+
+    /* Réception d'un message. */
     printf("[server]New message for client %d!\n", id);
     client->pos += len;
 
     /* Déplacement du pointeur de lecture. */
-    ret = conf->handlers.event(sock, id, client->buf, client->pos, conf->user_value);
+    ret = conf->handlers.event(server, id, client->buf, client->pos, conf->user_value);
+
+    /* Client déconnecté par une réponse impossible à envoyer. */
+    if (socket_set_get(server->ss, id) != sock)
+      break;
 
     if (ret > client->pos)
       ret = client->pos;
@@ -188,7 +536,7 @@ static void __handle_client(Server *server, Server_conf *conf, Socket sock, int
 static void __run (Server *server, Server_conf *conf, int timeout) {
   Socket sock;
   Sockets_states states;
-  unsigned int i;
+  int i, id;
 
   for (;;) {
     pthread_mutex_lock(&server->lock_run);
@@ -198,22 +546,31 @@ static void __run (Server *server, Server_conf *conf, int timeout) {
 
     pthread_mutex_unlock(&server->lock_run);
 
-    if (socket_set_select(server->ss, &states, NULL, timeout) == -1)
-      error("Select error.");
+    if (socket_set_wait(server->ss, &states, timeout) == -1)
+      error("Wait error.");
+
+    /* Seuls les sockets prêts sont traités. Un descripteur de réveil
+       n'a rien à traiter ici: la boucle est appelée après l'attente. */
+    for (i = 0; i < states.n; i++) {
+      if ((id = states.ids[i]) == SOCKET_SET_WATCHED)
+        continue;
 
-    /* Socket serveur. */
-    if (socket_is_ready(server->sock, &states))
-      __handle_server(server, conf);
+      /* Socket serveur. */
+      if (id == 0) {
+        __handle_server(server);
+        continue;
+      }
 
-    /* Sockets clients. */
-    for (i = 1; i <= conf->max_clients; i++) {
-      sock = socket_set_get(server->ss, i);
+      /* Socket client, peut-être déconnecté plus tôt dans ce tour. */
+      if ((states.events[i] & SOCKET_READABLE) && (sock = socket_set_get(server->ss, id)) != -1)
+        __handle_client(server, conf, sock, id);
 
-      if (socket_is_ready(sock, &states))
-        __handle_client(server, conf, sock, i);
+      /* De la place pour la file de sortie. */
+      if ((states.events[i] & SOCKET_WRITABLE) && socket_set_get(server->ss, id) != -1)
+        __flush(server, id);
     }
 
-    conf->handlers.loop(server->ss, conf->user_value);
+    conf->handlers.loop(server, conf->user_value);
   }
 
   pthread_mutex_unlock(&server->lock_run);
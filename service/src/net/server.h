@@ -16,12 +16,30 @@
 #ifndef _SERVER_H_
 #define _SERVER_H_
 
+#include <stddef.h>
+
 #include "../utils/socket.h"
+#include "frame.h"
+
+/* Nombre max de descripteurs de réveil. */
+#define SERVER_WAKEUP_FDS_MAX 8
+
+/* Octets reçus d'un client en attente de traitement: un message plus
+   long ne peut pas être reçu. */
+#define SERVER_CLIENT_BUFFER_SIZE 512
+
+/* Politiques d'une file de sortie pleine: les trames en attente sont
+   abandonnés et le client reçoit de nouveau l'état complet (handler join)
+   une fois sa file vidée, ou le client est déconnecté. */
+#define SERVER_OVERFLOW_COALESCE 0
+#define SERVER_OVERFLOW_DROP 1
 
-typedef int (*Fun_client_event)(Socket sock, int id, char *buffer, int len, void *user_value);
-typedef void (*Fun_client_join)(Socket sock, int id, void *user_value);
-typedef void (*Fun_client_quit)(Socket sock, int id, void *user_value);
-typedef void (*Fun_server_loop)(Socket_set *ss, void *user_value);
+typedef struct Server Server;
+
+typedef int (*Fun_client_event)(Server *server, int id, char *buffer, int len, void *user_value);
+typedef void (*Fun_client_join)(Server *server, int id, void *user_value);
+typedef void (*Fun_client_quit)(Server *server, int id, void *user_value);
+typedef void (*Fun_server_loop)(Server *server, void *user_value);
 
 typedef struct Server_handlers {
   Fun_client_event event;
@@ -33,11 +51,61 @@ typedef struct Server_handlers {
 typedef struct Server_conf {
   in_port_t port;
   unsigned int max_clients;
+  int backlog; /* Connexions en attente d'acceptation. */
   Server_handlers handlers;
   void *user_value;
+
+  /* Octets max en attente d'envoi par client, et politique lorsqu'un
+     message ne tient plus dans la file. */
+  size_t queue_size;
+  int overflow;
+
+  /* Descripteurs qui réveillent la boucle serveur lorsqu'ils sont lisibles. */
+  int wakeup_fds[SERVER_WAKEUP_FDS_MAX];
+  int n_wakeup_fds;
 } Server_conf;
 
-/* Execute un serveur qui peut être stoppé par le signal SIGINT. */
+typedef struct Server_stats {
+  unsigned long queued_frames; /* Trames mises en file, socket plein. */
+  unsigned long coalesced_frames; /* Trames abandonnées d'une file pleine. */
+  unsigned long resyncs; /* Etats complets renvoyés après une file pleine. */
+  unsigned long dropped_clients; /* Clients déconnectés, file pleine. */
+  size_t depth; /* Octets en attente dans toutes les files. */
+  size_t max_depth; /* Octets max en attente dans une file. */
+} Server_stats;
+
+/* Execute un serveur qui peut être stoppé par le signal SIGINT.
+   La boucle est appelée au moins toutes les timeout millisecondes. */
 void server_run (Server_conf *conf, int timeout);
 
+/* Envoie une trame à un client sans bloquer. Ce que le socket ne
+   peut pas recevoir est gardé dans la file du client, qui prend une
+   référence sur la trame, et envoyé dès que le socket est de nouveau
+   inscriptible.
+   Retourne -1 si le client n'existe pas, a été déconnecté ou si la
+   trame est abandonnée, sinon 0. */
+int server_send_frame (Server *server, int id, Frame *frame);
+
+/* Envoie une copie de data à un client, comme server_send_frame. */
+int server_send (Server *server, int id, const void *data, int len);
+
+/* Envoie une trame à tous les clients d'un protocole, sans la copier.
+   Un client lent ne retarde pas les autres. */
+void server_broadcast (Server *server, int protocol, Frame *frame);
+
+/* Donne le protocole d'un client, choisi par les handlers (0 à son
+   arrivée). Retourne -1 si le client n'existe pas. */
+int server_get_protocol (Server *server, int id);
+void server_set_protocol (Server *server, int id, int protocol);
+
+/* Déconnecte un client une fois sa file envoyée. */
+void server_disconnect (Server *server, int id);
+
+/* Retourne le nombre d'octets en attente d'envoi d'un client, ou -1
+   s'il n'existe pas. */
+long server_get_queue_depth (Server *server, int id);
+
+/* Donne les compteurs des files de sortie. */
+void server_get_stats (Server *server, Server_stats *stats);
+
 #endif /* _SERVER_H_ INCLUDED */
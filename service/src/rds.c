@@ -13,8 +13,13 @@
   along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <stddef.h>
 #include <string.h>
 
+#if defined(__SSE2__)
+  #include <emmintrin.h>
+#endif
+
 #include "utils/alloc.h"
 #include "utils/error.h"
 
@@ -25,15 +30,47 @@
 #define RDSC 2
 #define RDSD 3
 
-#define BIT_GROUP_ID 12
+/* Blocks gardés, après lecture des BLER. */
+#define VALID_A (1 << RDSA)
+#define VALID_B (1 << RDSB)
+#define VALID_C (1 << RDSC)
+#define VALID_D (1 << RDSD)
+
+/* Erreurs max d'un block gardé: au-delà, les corrections du tuner
+   sont souvent fausses. */
+#define BLER_MAX RDS_BLER_1_2
+
+/* Groupes d'un lot dont les blocks valides et le type sont calculés
+   à la fois. */
+#define BATCH_SIZE 256
+
+#define BIT_GROUP 11
 #define BIT_PT 5
 
 /* Masks relatifs à la norme RDS. */
-#define MASK_GROUP_ID 0xF000
-#define MASK_GROUP_VERSION 0x0800
+#define MASK_GROUP 0x001F /* Type et version, après décalage de BIT_GROUP. */
 
+#define MASK_VERSION 0x0800 /* Version B du groupe. */
 #define MASK_PSNAME_PART 0x0003
 #define MASK_RADIO_TEXT_PART 0x000F
+#define MASK_RADIO_TEXT_AB 0x0010
+
+/* Longueur max du texte transmis par des groupes 2B (16 segments de 2
+   caractères). */
+#define RADIO_TEXT_B_MAX_LENGTH 32
+#define MASK_PTYN_PART 0x0001
+#define MASK_PTYN_AB 0x0010
+#define MASK_EON_VARIANT 0x000F
+
+/* Codes des fréquences alternatives, méthode A: un couple de codes
+   par groupe 0A, le 1er couple donne le nombre de fréquences.
+   Documentation: "doc/RDS_Basics.pdf". */
+#define AF_CHANNEL_MIN 1 /* 87.6 MHz. */
+#define AF_CHANNEL_MAX 204 /* 107.9 MHz. */
+#define AF_CHANNEL_BASE 875
+#define AF_COUNT_MIN 224 /* Aucune fréquence. */
+#define AF_COUNT_MAX 249 /* 25 fréquences. */
+#define AF_LF_MF 250 /* Le code suivant est une fréquence LF/MF. */
 
 #define MASK_MS 0x0008 /* Music/Speech. */
 #define MASK_TA 0x0010 /* Traffic Announcement. */
@@ -44,31 +81,97 @@
    de la structure RDS. */
 #define ST_BIT_NAME 0 /* Length: 2. */
 #define ST_BIT_TEXT 2 /* Length: 4. */
-#define ST_BIT_PT 6   /* Length: 4. */
-#define ST_BIT_MS 10  /* Length: 1. */
-#define ST_BIT_TA 11  /* Length: 1. */
-#define ST_BIT_TP 12  /* Length: 1. */
+#define ST_BIT_PT 6   /* Length: 5. */
+#define ST_BIT_MS 11  /* Length: 1. */
+#define ST_BIT_TA 12  /* Length: 1. */
+#define ST_BIT_TP 13  /* Length: 1. */
+#define ST_BIT_PTYN_AB 14 /* Length: 1. */
+#define ST_BIT_TEXT_AB 15 /* Length: 1. */
 
 #define ST_MASK_NAME 0x0003
 #define ST_MASK_TEXT 0x003C
-#define ST_MASK_PT 0x03C0
+#define ST_MASK_PT 0x07C0
 #define ST_MASK_MS (1 << ST_BIT_MS)
 #define ST_MASK_TA (1 << ST_BIT_TA)
 #define ST_MASK_TP (1 << ST_BIT_TP)
+#define ST_MASK_PTYN_AB (1 << ST_BIT_PTYN_AB)
+#define ST_MASK_TEXT_AB (1 << ST_BIT_TEXT_AB)
 
-/* Fin de ligne. */
-#define RDS_CARRIAGE_RETURN 13
+/* Données reçues au moins une fois, attribut received. */
+#define RECEIVED_CLOCK 0x01
+#define RECEIVED_RT_PLUS 0x02
+#define RECEIVED_TMC 0x04
 
 struct Rds {
   char radio_name[RDS_RADIO_NAME_MAX_LENGTH + 1]; /* Nom actuel de la radio. */
-  char new_radio_name[RDS_RADIO_NAME_MAX_LENGTH + 1]; /* Nom de la radio en cours de parsing. */
-
   char radio_text[RDS_RADIO_TEXT_MAX_LENGTH + 1]; /* Texte actuel de la radio. */
-  char new_radio_text[RDS_RADIO_TEXT_MAX_LENGTH + 1]; /* Texte de la radio en cours de parsing. */
 
+  /* Caractères reçus du nom/texte et nombre de réceptions identiques. */
+  char name_chars[RDS_RADIO_NAME_MAX_LENGTH];
+  uint8_t name_counts[RDS_RADIO_NAME_MAX_LENGTH];
+  char text_chars[RDS_RADIO_TEXT_MAX_LENGTH];
+  uint8_t text_counts[RDS_RADIO_TEXT_MAX_LENGTH];
+
+  /* Nom/texte tels qu'ils seraient décodés sans vérification: segments
+     reçus dans l'ordre et publiés dès qu'ils sont complets. */
+  char unconfirmed_name[RDS_RADIO_NAME_MAX_LENGTH + 1];
+  char new_unconfirmed_name[RDS_RADIO_NAME_MAX_LENGTH + 1];
+  char unconfirmed_text[RDS_RADIO_TEXT_MAX_LENGTH + 1];
+  char new_unconfirmed_text[RDS_RADIO_TEXT_MAX_LENGTH + 1];
+
+  char program_type_name[RDS_PROGRAM_TYPE_NAME_MAX_LENGTH + 1];
+
+  uint16_t pi; /* Program Identification, 0 si inconnu. */
   uint16_t bit_fields; /* Diverses informations RDS. */
+  uint8_t ecc;
+  uint8_t received;
+  uint8_t provisional; /* Données de rds_set_station non confirmées. */
+
+  /* Application ODA transportée par chaque type de groupe, ou 0. */
+  uint16_t aids[RDS_GROUP_TYPES_N];
+
+  Rds_clock clock;
+  Rds_rt_plus rt_plus;
+  Rds_tmc tmc;
+
+  Rds_other_network other_networks[RDS_OTHER_NETWORKS_MAX];
+  int n_other_networks;
+
+  /* Fréquences alternatives: liste complète et liste en cours de
+     réception, dont af_count fréquences sont annoncées et af_received
+     reçues, répétitions de la méthode B comprises. */
+  int afs[RDS_AF_MAX];
+  int n_afs;
+  int new_afs[RDS_AF_MAX];
+  int n_new_afs;
+  int af_count;
+  int af_received;
+
+  /* Champs gardés par rds_set_station. */
+  Rds_stats stats;
+  int compare; /* Décodage sans vérification actif, voir rds_set_compare. */
+  int channel; /* Channel réglé, 0 si inconnu, voir rds_set_channel. */
+
+  /* Vue publiée pour les autres threads, protégée par un seqlock: seq
+     est impair pendant une mise à jour. changed donne les champs
+     RDS_FIELD_* modifiés depuis la dernière publication. */
+  uint32_t seq;
+  Rds_snapshot snapshot;
+  int changed;
 };
 
+/* Champs comparés avant et après un groupe d'un lot. */
+typedef struct Decoded_state {
+  uint16_t pi;
+  uint16_t bit_fields;
+  uint8_t provisional;
+} Decoded_state;
+
+/* Décodeur d'un type de groupe. Les champs communs à tous les groupes
+   (PI, TP, PTY) sont déjà décodés et valid donne les blocks VALID_*
+   utilisables, dont toujours le block B. */
+typedef void (*Group_decoder)(Rds *rds, uint16_t blocks[], int valid);
+
 Rds *rds_new (void) {
   return pnew0(Rds);
 }
@@ -80,27 +183,195 @@ void rds_free (Rds *rds) {
   return;
 }
 
-static void __get_group_type (uint16_t blocks[], int *id, int *version) {
-  *id = (blocks[RDSB] & MASK_GROUP_ID) >> BIT_GROUP_ID;
-  *version = !!(blocks[RDSB] & MASK_GROUP_VERSION);
+void rds_set_compare (Rds *rds, int compare) {
+  rds->compare = !!compare;
+  return;
+}
 
+void rds_set_channel (Rds *rds, int channel) {
+  rds->channel = channel;
   return;
 }
 
-static void __decode_basic_tuning_and_switching_info(Rds *rds, uint16_t blocks[]) {
-  int off = blocks[RDSB] & MASK_PSNAME_PART;
-  int chars;
+/* --------------------------------------------------------------------- */
 
-  #ifdef DEBUG
-    int i;
-  #endif
+static inline void __set_flag (Rds *rds, uint16_t mask, int value) {
+  if (value)
+    rds->bit_fields |= mask;
+  else
+    rds->bit_fields &= ~mask;
 
-  /* Récupération des flags Music/Speech et Traffic Annoucement. */
-  rds->bit_fields &= ~ST_MASK_MS;
-  rds->bit_fields |= (!!(blocks[RDSB] & MASK_MS)) << ST_BIT_MS;
-  rds->bit_fields &= ~ST_MASK_TA;
-  rds->bit_fields |= (!!(blocks[RDSB] & MASK_TA)) << ST_BIT_TA;
+  return;
+}
+
+static inline void __get_chars (char *dst, uint16_t block) {
+  dst[0] = (block & 0xFF00) >> 8;
+  dst[1] = block & 0x00FF;
+
+  return;
+}
+
+/* Reçoit 2 caractères d'un block à la position i. Un caractère différent
+   du précédent reçu à cette position doit à son tour être confirmé.
+   Retourne 1 si un caractère confirmé a changé, sinon 0. */
+static inline int __receive_chars (char *chars, uint8_t *counts, int i, uint16_t block) {
+  char received[2];
+  int j, changed = 0;
+
+  __get_chars(received, block);
+
+  for (j = 0; j < 2; j++, i++)
+    if (chars[i] != received[j]) {
+      changed |= counts[i] >= RDS_CONFIRMATIONS;
+      chars[i] = received[j];
+      counts[i] = 1;
+    } else if (counts[i] < RDS_CONFIRMATIONS)
+      changed |= ++counts[i] == RDS_CONFIRMATIONS;
+
+  return changed;
+}
+
+/* Retourne la position du premier caractère non confirmé parmi n, ou n. */
+static inline int __get_confirmed_length (const uint8_t *counts, int n) {
+  int i;
+
+  for (i = 0; i < n && counts[i] >= RDS_CONFIRMATIONS; i++);
+
+  return i;
+}
+
+/* Publie un nom/texte confirmé s'il a changé. */
+static void __publish (Rds *rds, int field, char *dst, const char *chars, int len) {
+  if (!strncmp(dst, chars, len) && dst[len] == '\0')
+    return;
+
+  memcpy(dst, chars, len);
+  dst[len] = '\0';
+  rds->stats.updates++;
+  rds->changed |= 1 << field;
+
+  debug("[rds]Radio %s: '%s'\n", field == RDS_FIELD_NAME ? "name" : "text", dst);
+
+  return;
+}
+
+/* --------------------------------------------------------------------- */
+
+/* Copies byte par byte avec des accès atomiques: le seqlock détecte
+   une lecture concurrente d'une écriture, qui reste sans effet. */
+static inline void __store_bytes (void *dst, const void *src, size_t size) {
+  unsigned char *d = dst;
+  const unsigned char *s = src;
+  size_t i;
+
+  for (i = 0; i < size; i++)
+    __atomic_store_n(&d[i], s[i], __ATOMIC_RELAXED);
+
+  return;
+}
+
+static inline void __load_bytes (void *dst, const void *src, size_t size) {
+  unsigned char *d = dst;
+  const unsigned char *s = src;
+  size_t i;
+
+  for (i = 0; i < size; i++)
+    d[i] = __atomic_load_n(&s[i], __ATOMIC_RELAXED);
+
+  return;
+}
+
+/* Les générations, lues hors seqlock par rds_get_generation, sont
+   copiées par des accès atomiques de 32 bits, le reste de la vue byte
+   par byte. gens est le premier champ de la vue. */
+#define SNAPSHOT_DATA_OFFSET (offsetof(Rds_snapshot, gens) + sizeof(((Rds_snapshot *)0)->gens))
+
+static inline void __store_snapshot (Rds_snapshot *dst, const Rds_snapshot *src) {
+  int i;
+
+  for (i = 0; i < RDS_FIELDS_N; i++)
+    __atomic_store_n(&dst->gens[i], src->gens[i], __ATOMIC_RELAXED);
+
+  __store_bytes((char *)dst + SNAPSHOT_DATA_OFFSET, (const char *)src + SNAPSHOT_DATA_OFFSET,
+                sizeof *src - SNAPSHOT_DATA_OFFSET);
+
+  return;
+}
+
+static inline void __load_snapshot (Rds_snapshot *dst, const Rds_snapshot *src) {
+  int i;
+
+  for (i = 0; i < RDS_FIELDS_N; i++)
+    dst->gens[i] = __atomic_load_n(&src->gens[i], __ATOMIC_RELAXED);
+
+  __load_bytes((char *)dst + SNAPSHOT_DATA_OFFSET, (const char *)src + SNAPSHOT_DATA_OFFSET,
+               sizeof *src - SNAPSHOT_DATA_OFFSET);
+
+  return;
+}
+
+/* Publie les champs modifiés dans la vue des autres threads. Seul le
+   thread qui décode écrit la vue: il peut la lire sans précaution. */
+static void __update_snapshot (Rds *rds) {
+  Rds_snapshot next = rds->snapshot;
+  int changed = rds->changed;
+  int i;
+
+  next.pi = rds->pi;
+  next.program_type = rds_get_program_type(rds);
+  next.ta = !!(rds->bit_fields & ST_MASK_TA);
+  next.tp = !!(rds->bit_fields & ST_MASK_TP);
+  next.music = !!(rds->bit_fields & ST_MASK_MS);
+  next.provisional = rds->provisional;
+
+  if (next.pi != rds->snapshot.pi)
+    changed |= 1 << RDS_FIELD_PI;
+  if (next.program_type != rds->snapshot.program_type)
+    changed |= 1 << RDS_FIELD_PROGRAM_TYPE;
+  if (next.ta != rds->snapshot.ta || next.tp != rds->snapshot.tp || next.music != rds->snapshot.music)
+    changed |= 1 << RDS_FIELD_FLAGS;
+  if (next.provisional != rds->snapshot.provisional)
+    changed |= 1 << RDS_FIELD_PROVISIONAL;
+
+  if (changed == 0)
+    return;
+
+  rds->changed = 0;
+
+  if (changed & (1 << RDS_FIELD_NAME))
+    strcpy(next.radio_name, rds->radio_name);
+  if (changed & (1 << RDS_FIELD_TEXT))
+    strcpy(next.radio_text, rds->radio_text);
+
+  if (changed & (1 << RDS_FIELD_PARTIAL_TEXT)) {
+    for (i = 0; i < RDS_RADIO_TEXT_MAX_LENGTH; i++)
+      next.partial_text[i] = rds->text_counts[i] >= RDS_CONFIRMATIONS ? rds->text_chars[i] : '\0';
+
+    next.text_ab = !!(rds->bit_fields & ST_MASK_TEXT_AB);
+  }
+
+  next.gens[RDS_FIELD_ANY]++;
+
+  for (i = 1; i < RDS_FIELDS_N; i++)
+    if (changed & (1 << i))
+      next.gens[i] = next.gens[RDS_FIELD_ANY];
 
+  /* seq impair avant toute écriture de la vue, pair après. */
+  __atomic_store_n(&rds->seq, rds->seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+
+  __store_snapshot(&rds->snapshot, &next);
+
+  __atomic_store_n(&rds->seq, rds->seq + 1, __ATOMIC_RELEASE);
+
+  return;
+}
+
+/* --------------------------------------------------------------------- */
+
+/* Décodage sans vérification du nom: seules ses mises à jour
+   sont comptées. */
+static void __decode_unconfirmed_name (Rds *rds, int off, uint16_t block) {
   /* Vérification de la position de l'offset du nom de la radio.
      S'il n'est pas bon, on reset et on attend une prochaine séquence. */
   if ((rds->bit_fields & ST_MASK_NAME) >> ST_BIT_NAME != off) {
@@ -109,9 +380,7 @@ static void __decode_basic_tuning_and_switching_info(Rds *rds, uint16_t blocks[]
   }
 
   /* Récupération de 2 lettres contenues dans le nom de la radio. */
-  chars = off * 2;
-  rds->new_radio_name[chars] = (blocks[RDSD] & 0xFF00) >> 8;
-  rds->new_radio_name[chars + 1] = blocks[RDSD] & 0x00FF;
+  __get_chars(rds->new_unconfirmed_name + off * 2, block);
 
   /* Le nom n'est pas complet, on met à jour l'offset. */
   if (off < 3) {
@@ -121,31 +390,23 @@ static void __decode_basic_tuning_and_switching_info(Rds *rds, uint16_t blocks[]
   }
 
   /* Le nom est complet. */
-  #ifdef DEBUG
-    if (strcmp(rds->radio_name, rds->new_radio_name)) {
-      debug("[rds]Radio name: '%s' (", rds->new_radio_name);
-
-      for (i = 0; i < RDS_RADIO_NAME_MAX_LENGTH; i++)
-        debug("%d, ", rds->new_radio_name[i]);
-
-      debug("0)\n");
-    }
-  #endif
+  if (strcmp(rds->unconfirmed_name, rds->new_unconfirmed_name))
+    rds->stats.unconfirmed_updates++;
 
   rds->bit_fields &= ~ST_MASK_NAME;
-  memcpy(rds->radio_name, rds->new_radio_name, RDS_RADIO_NAME_MAX_LENGTH);
-  memset(rds->new_radio_name, 0, RDS_RADIO_NAME_MAX_LENGTH);
+  memcpy(rds->unconfirmed_name, rds->new_unconfirmed_name, RDS_RADIO_NAME_MAX_LENGTH);
+  memset(rds->new_unconfirmed_name, 0, RDS_RADIO_NAME_MAX_LENGTH);
 
   return;
 }
 
-static void __decode_radio_text (Rds *rds, uint16_t blocks[], int version) {
+/* Décodage sans vérification du texte: seules ses mises à jour
+   sont comptées. */
+static void __decode_unconfirmed_text (Rds *rds, uint16_t blocks[], int version) {
   int off = blocks[RDSB] & MASK_RADIO_TEXT_PART;
   int chars;
   int i, n = (!version + 1) * 2;
 
-  /* Vérification de la position de l'offset du text de la radio.
-     S'il n'est pas bon, on reset et on attend une prochaine séquence. */
   if ((rds->bit_fields & ST_MASK_TEXT) >> ST_BIT_TEXT != off) {
     rds->bit_fields &= ~ST_MASK_TEXT;
     return;
@@ -154,26 +415,21 @@ static void __decode_radio_text (Rds *rds, uint16_t blocks[], int version) {
   /* Attention: 2x plus de lettres transmises en 1 message pour la version A. */
   chars = off * n;
 
-  /* Récupération de 4 lettres pour la version A et de 2 pour la version B. */
   if (n == 4) {
-    rds->new_radio_text[chars] = (blocks[RDSC] & 0xFF00) >> 8;
-    rds->new_radio_text[chars + 1] = blocks[RDSC] & 0x00FF;
-    rds->new_radio_text[chars + 2] = (blocks[RDSD] & 0xFF00) >> 8;
-    rds->new_radio_text[chars + 3] = blocks[RDSD] & 0x00FF;
+    __get_chars(rds->new_unconfirmed_text + chars, blocks[RDSC]);
+    __get_chars(rds->new_unconfirmed_text + chars + 2, blocks[RDSD]);
   }
   /* n = 2. */
-  else {
-    rds->new_radio_text[chars] = (blocks[RDSD] & 0xFF00) >> 8;
-    rds->new_radio_text[chars + 1] = blocks[RDSD] & 0x00FF;
-  }
+  else
+    __get_chars(rds->new_unconfirmed_text + chars, blocks[RDSD]);
 
   for (i = 0; i < n; i++)
-    if (rds->new_radio_text[chars + i] == RDS_CARRIAGE_RETURN) {
-      rds->new_radio_text[chars + i] = '\0';
+    if (rds->new_unconfirmed_text[chars + i] == RDS_CARRIAGE_RETURN) {
+      rds->new_unconfirmed_text[chars + i] = '\0';
       goto text_completed;
     }
 
-  /* Le nom n'est pas complet, on met à jour l'offset. */
+  /* Le texte n'est pas complet, on met à jour l'offset. */
   if (off < 15) {
     rds->bit_fields &= ~ST_MASK_TEXT;
     rds->bit_fields |= (off + 1) << ST_BIT_TEXT;
@@ -182,53 +438,544 @@ static void __decode_radio_text (Rds *rds, uint16_t blocks[], int version) {
 
  text_completed:
 
-  /* Le nom est complet. */
-  #ifdef DEBUG
-    if (strcmp(rds->radio_text, rds->new_radio_text)) {
-      debug("[rds]Radio text: '%s' (", rds->new_radio_text);
+  if (strcmp(rds->unconfirmed_text, rds->new_unconfirmed_text))
+    rds->stats.unconfirmed_updates++;
 
-      for (i = 0; i < RDS_RADIO_TEXT_MAX_LENGTH; i++)
-        debug("%d, ", rds->new_radio_text[i]);
+  rds->bit_fields &= ~ST_MASK_TEXT;
+  memcpy(rds->unconfirmed_text, rds->new_unconfirmed_text, RDS_RADIO_TEXT_MAX_LENGTH);
+  memset(rds->new_unconfirmed_text, 0, RDS_RADIO_TEXT_MAX_LENGTH);
 
-      debug("0)\n");
-    }
-  #endif
+  return;
+}
 
-  rds->bit_fields &= ~ST_MASK_TEXT;
-  memcpy(rds->radio_text, rds->new_radio_text, RDS_RADIO_TEXT_MAX_LENGTH);
-  memset(rds->new_radio_text, 0, RDS_RADIO_TEXT_MAX_LENGTH);
+/* --------------------------------------------------------------------- */
+
+/* Remplace les fréquences alternatives par la liste reçue. */
+static void __publish_afs (Rds *rds) {
+  if (rds->n_afs != rds->n_new_afs || memcmp(rds->afs, rds->new_afs, rds->n_new_afs * sizeof *rds->afs)) {
+    memcpy(rds->afs, rds->new_afs, rds->n_new_afs * sizeof *rds->afs);
+    rds->n_afs = rds->n_new_afs;
+
+    debug("[rds]Alternative frequencies: %d.\n", rds->n_afs);
+  }
+
+  rds->n_new_afs = 0;
+  rds->af_count = 0;
+  rds->af_received = 0;
+
+  return;
+}
+
+static inline int __has_new_af (Rds *rds, int channel) {
+  int i;
+
+  for (i = 0; i < rds->n_new_afs; i++)
+    if (rds->new_afs[i] == channel)
+      return 1;
+
+  return 0;
+}
+
+static void __add_af (Rds *rds, int code) {
+  int channel = AF_CHANNEL_BASE + code;
+
+  if (code < AF_CHANNEL_MIN || code > AF_CHANNEL_MAX || rds->af_received == rds->af_count)
+    return;
+
+  rds->af_received++;
+
+  /* Méthode B: la fréquence réglée est répétée dans chaque couple et
+     comptée à chaque fois dans la liste annoncée, mais n'est pas une AF. */
+  if (channel != rds->channel && !__has_new_af(rds, channel))
+    rds->new_afs[rds->n_new_afs++] = channel;
+
+  if (rds->af_received == rds->af_count)
+    __publish_afs(rds);
+
+  return;
+}
+
+/* Block C d'un groupe 0A. */
+static void __decode_alternative_frequencies (Rds *rds, uint16_t block) {
+  int first = block >> 8;
+  int second = block & 0x00FF;
+
+  /* Début d'une liste: la précédente est gardée même si elle est incomplète. */
+  if (first >= AF_COUNT_MIN && first <= AF_COUNT_MAX) {
+    if (rds->n_new_afs > 0)
+      __publish_afs(rds);
+
+    rds->af_count = first - AF_COUNT_MIN;
+    rds->af_received = 0;
+
+    if (rds->af_count == 0)
+      __publish_afs(rds);
+    else
+      __add_af(rds, second);
+  }
+  else if (first != AF_LF_MF) {
+    __add_af(rds, first);
+    __add_af(rds, second);
+  }
+
+  return;
+}
+
+/* Groupes 0A et 0B. */
+static void __decode_basic_tuning_and_switching_info (Rds *rds, uint16_t blocks[], int valid) {
+  int off = blocks[RDSB] & MASK_PSNAME_PART;
+
+  /* Récupération des flags Music/Speech et Traffic Annoucement. */
+  __set_flag(rds, ST_MASK_MS, blocks[RDSB] & MASK_MS);
+  __set_flag(rds, ST_MASK_TA, blocks[RDSB] & MASK_TA);
+
+  /* Le block C de la version B répète le PI. */
+  if (!(blocks[RDSB] & MASK_VERSION) && (valid & VALID_C))
+    __decode_alternative_frequencies(rds, blocks[RDSC]);
+
+  if (!(valid & VALID_D))
+    return;
+
+  /* Récupération de 2 lettres contenues dans le nom de la radio,
+     publié lorsque toutes ses lettres sont confirmées. */
+  if (__receive_chars(rds->name_chars, rds->name_counts, off * 2, blocks[RDSD]) &&
+      __get_confirmed_length(rds->name_counts, RDS_RADIO_NAME_MAX_LENGTH) == RDS_RADIO_NAME_MAX_LENGTH)
+    __publish(rds, RDS_FIELD_NAME, rds->radio_name, rds->name_chars, RDS_RADIO_NAME_MAX_LENGTH);
+
+  return;
+}
+
+/* Groupe 1A: seule la variante 0 (ECC) est gardée. */
+static void __decode_program_item_number (Rds *rds, uint16_t blocks[], int valid) {
+  if ((valid & VALID_C) && (blocks[RDSC] & 0x7000) == 0)
+    rds->ecc = blocks[RDSC] & 0x00FF;
+
+  return;
+}
+
+static void __decode_radio_text (Rds *rds, uint16_t blocks[], int valid, int version) {
+  int ab = !!(blocks[RDSB] & MASK_RADIO_TEXT_AB);
+  int n = (!version + 1) * 2;
+  int chars = (blocks[RDSB] & MASK_RADIO_TEXT_PART) * n;
+  int max = version ? RADIO_TEXT_B_MAX_LENGTH : RDS_RADIO_TEXT_MAX_LENGTH;
+  int changed = 0;
+  int len, end;
+
+  /* Le flag A/B change lorsqu'un nouveau texte est diffusé. */
+  if (ab != !!(rds->bit_fields & ST_MASK_TEXT_AB)) {
+    __set_flag(rds, ST_MASK_TEXT_AB, ab);
+    memset(rds->text_counts, 0, RDS_RADIO_TEXT_MAX_LENGTH);
+    rds->changed |= 1 << RDS_FIELD_PARTIAL_TEXT;
+  }
+
+  /* Récupération de 4 lettres pour la version A et de 2 pour la version B. */
+  if (n == 4 && (valid & VALID_C))
+    changed |= __receive_chars(rds->text_chars, rds->text_counts, chars, blocks[RDSC]);
+  if (valid & VALID_D)
+    changed |= __receive_chars(rds->text_chars, rds->text_counts, chars + n - 2, blocks[RDSD]);
+
+  if (!changed)
+    return;
+
+  /* Chaque segment est placé à sa position: le texte en cours de
+     réception est publié à chaque caractère confirmé. */
+  rds->changed |= 1 << RDS_FIELD_PARTIAL_TEXT;
+
+  /* Le texte est publié lorsque toutes ses lettres sont confirmées,
+     jusqu'à un retour chariot confirmé. */
+  len = __get_confirmed_length(rds->text_counts, max);
+
+  for (end = 0; end < len && rds->text_chars[end] != RDS_CARRIAGE_RETURN; end++);
+
+  if (end < len || len == max)
+    __publish(rds, RDS_FIELD_TEXT, rds->radio_text, rds->text_chars, end);
+
+  return;
+}
+
+/* Groupe 2A. */
+static void __decode_radio_text_a (Rds *rds, uint16_t blocks[], int valid) {
+  __decode_radio_text(rds, blocks, valid, 0);
+  return;
+}
+
+/* Groupe 2B. */
+static void __decode_radio_text_b (Rds *rds, uint16_t blocks[], int valid) {
+  __decode_radio_text(rds, blocks, valid, 1);
+  return;
+}
+
+/* Groupe 3A: un type de groupe transporte désormais une application. */
+static void __decode_open_data_application (Rds *rds, uint16_t blocks[], int valid) {
+  if (valid & VALID_D)
+    rds->aids[blocks[RDSB] & MASK_GROUP] = blocks[RDSD];
+
+  return;
+}
+
+/* Groupe 4A. Documentation: "doc/RDS_Basics.pdf". */
+static void __decode_clock_time (Rds *rds, uint16_t blocks[], int valid) {
+  Rds_clock *clock = &rds->clock;
+  int offset = (blocks[RDSD] & 0x001F) * 30;
+
+  if ((valid & (VALID_C | VALID_D)) != (VALID_C | VALID_D))
+    return;
+
+  clock->mjd = ((long)(blocks[RDSB] & 0x0003) << 15) | (blocks[RDSC] >> 1);
+  clock->hour = ((blocks[RDSC] & 0x0001) << 4) | (blocks[RDSD] >> 12);
+  clock->minute = (blocks[RDSD] >> 6) & 0x003F;
+  clock->offset = (blocks[RDSD] & 0x0020) ? -offset : offset;
+
+  rds->received |= RECEIVED_CLOCK;
+
+  return;
+}
+
+/* Groupe 10A: le flag A/B change lorsqu'un nouveau nom est diffusé. */
+static void __decode_program_type_name (Rds *rds, uint16_t blocks[], int valid) {
+  int ab = !!(blocks[RDSB] & MASK_PTYN_AB);
+  char *chars = rds->program_type_name + (blocks[RDSB] & MASK_PTYN_PART) * 4;
+
+  if (ab != !!(rds->bit_fields & ST_MASK_PTYN_AB)) {
+    __set_flag(rds, ST_MASK_PTYN_AB, ab);
+    memset(rds->program_type_name, 0, RDS_PROGRAM_TYPE_NAME_MAX_LENGTH);
+  }
+
+  if (valid & VALID_C)
+    __get_chars(chars, blocks[RDSC]);
+  if (valid & VALID_D)
+    __get_chars(chars + 2, blocks[RDSD]);
+
+  return;
+}
+
+/* Groupe d'une application RadioText+. */
+static void __decode_rt_plus (Rds *rds, uint16_t blocks[]) {
+  Rds_rt_plus *rt_plus = &rds->rt_plus;
+
+  rt_plus->toggle = !!(blocks[RDSB] & 0x0010);
+  rt_plus->running = !!(blocks[RDSB] & 0x0008);
+
+  rt_plus->tags[0].content_type = ((blocks[RDSB] & 0x0007) << 3) | (blocks[RDSC] >> 13);
+  rt_plus->tags[0].start = (blocks[RDSC] >> 7) & 0x003F;
+  rt_plus->tags[0].length = ((blocks[RDSC] >> 1) & 0x003F) + 1;
+
+  rt_plus->tags[1].content_type = ((blocks[RDSC] & 0x0001) << 5) | (blocks[RDSD] >> 11);
+  rt_plus->tags[1].start = (blocks[RDSD] >> 5) & 0x003F;
+  rt_plus->tags[1].length = (blocks[RDSD] & 0x001F) + 1;
+
+  rds->received |= RECEIVED_RT_PLUS;
+
+  return;
+}
+
+/* Groupe d'une application TMC: seuls les messages utilisateur
+   en un seul groupe sont gardés. */
+static void __decode_tmc (Rds *rds, uint16_t blocks[]) {
+  Rds_tmc *tmc = &rds->tmc;
+
+  if ((blocks[RDSB] & 0x0018) != 0x0008)
+    return;
+
+  tmc->event = blocks[RDSC] & 0x07FF;
+  tmc->extent = (blocks[RDSC] >> 11) & 0x0007;
+  tmc->direction = !!(blocks[RDSC] & 0x4000);
+  tmc->location = blocks[RDSD];
+
+  rds->received |= RECEIVED_TMC;
+
+  return;
+}
+
+/* Groupes pouvant transporter une application ODA. Le groupe 8A est
+   réservé au TMC s'il n'a pas été annoncé par un groupe 3A. */
+static void __decode_application_group (Rds *rds, uint16_t blocks[], int valid) {
+  int group = (blocks[RDSB] >> BIT_GROUP) & MASK_GROUP;
+  uint16_t aid = rds->aids[group];
+
+  if (aid == 0 && group == RDS_GROUP(8, 0))
+    aid = RDS_AID_TMC;
+
+  if (aid != RDS_AID_RT_PLUS && aid != RDS_AID_TMC) {
+    rds->stats.unknown++;
+    return;
+  }
+
+  /* Les 2 applications utilisent les blocks C et D ensemble. */
+  if ((valid & (VALID_C | VALID_D)) != (VALID_C | VALID_D))
+    return;
+
+  if (aid == RDS_AID_RT_PLUS)
+    __decode_rt_plus(rds, blocks);
+  else
+    __decode_tmc(rds, blocks);
 
   return;
 }
 
-void rds_decode (Rds *rds, uint16_t blocks[static RDS_BLOCKS_N]) {
-  int id, version;
+/* Groupe 14A: seuls les noms des autres réseaux sont gardés. */
+static void __decode_enhanced_other_networks (Rds *rds, uint16_t blocks[], int valid) {
+  int variant = blocks[RDSB] & MASK_EON_VARIANT;
+  uint16_t pi = blocks[RDSD];
+  Rds_other_network *network;
+  int i;
 
-  __get_group_type(blocks, &id, &version);
+  if (variant > 3 || (valid & (VALID_C | VALID_D)) != (VALID_C | VALID_D))
+    return;
+
+  for (i = 0; i < rds->n_other_networks && rds->other_networks[i].pi != pi; i++);
+
+  /* Nouveau réseau: le plus ancien est remplacé si la table est pleine. */
+  if (i == rds->n_other_networks) {
+    if (i == RDS_OTHER_NETWORKS_MAX) {
+      memmove(rds->other_networks, rds->other_networks + 1,
+              (RDS_OTHER_NETWORKS_MAX - 1) * sizeof *rds->other_networks);
+      i--;
+    } else
+      rds->n_other_networks++;
+
+    network = &rds->other_networks[i];
+    memset(network, 0, sizeof *network);
+    network->pi = pi;
+  }
+
+  __get_chars(rds->other_networks[i].name + variant * 2, blocks[RDSC]);
+
+  return;
+}
+
+/* Groupe 15B: flags TA et MS du groupe 0, répétés en block D. */
+static void __decode_fast_switching_info (Rds *rds, uint16_t blocks[], int valid) {
+  (void)valid;
+
+  __set_flag(rds, ST_MASK_MS, blocks[RDSB] & MASK_MS);
+  __set_flag(rds, ST_MASK_TA, blocks[RDSB] & MASK_TA);
+
+  return;
+}
+
+/* Décodeurs par type de groupe, NULL pour un groupe non décodé. */
+static const Group_decoder decoders[RDS_GROUP_TYPES_N] = {
+  [RDS_GROUP(0, 0)] = __decode_basic_tuning_and_switching_info,
+  [RDS_GROUP(0, 1)] = __decode_basic_tuning_and_switching_info,
+  [RDS_GROUP(1, 0)] = __decode_program_item_number,
+  [RDS_GROUP(2, 0)] = __decode_radio_text_a,
+  [RDS_GROUP(2, 1)] = __decode_radio_text_b,
+  [RDS_GROUP(3, 0)] = __decode_open_data_application,
+  [RDS_GROUP(4, 0)] = __decode_clock_time,
+  [RDS_GROUP(5, 0)] = __decode_application_group,
+  [RDS_GROUP(6, 0)] = __decode_application_group,
+  [RDS_GROUP(7, 0)] = __decode_application_group,
+  [RDS_GROUP(8, 0)] = __decode_application_group,
+  [RDS_GROUP(9, 0)] = __decode_application_group,
+  [RDS_GROUP(10, 0)] = __decode_program_type_name,
+  [RDS_GROUP(11, 0)] = __decode_application_group,
+  [RDS_GROUP(12, 0)] = __decode_application_group,
+  [RDS_GROUP(13, 0)] = __decode_application_group,
+  [RDS_GROUP(14, 0)] = __decode_enhanced_other_networks,
+  [RDS_GROUP(15, 1)] = __decode_fast_switching_info
+};
+
+/* Efface les données provisoires d'une autre station. Les caractères
+   déjà reçus sont gardés: ils sont publiés une fois confirmés. */
+static void __clear_station (Rds *rds) {
+  if (*rds->radio_name != '\0')
+    rds->changed |= 1 << RDS_FIELD_NAME;
+  if (*rds->radio_text != '\0')
+    rds->changed |= 1 << RDS_FIELD_TEXT;
+
+  *rds->radio_name = '\0';
+  *rds->radio_text = '\0';
+  rds->bit_fields &= ~ST_MASK_PT;
+
+  return;
+}
+
+/* Décodage commun à tous les types de groupes. valid donne les blocks
+   utilisables, dont le block B. */
+static void __decode_common (Rds *rds, uint16_t blocks[], int valid) {
+  /* Le block A contient toujours le PI. Les fréquences alternatives
+     d'une autre station sont oubliées, comme ses données provisoires. */
+  if (valid & VALID_A) {
+    if (rds->pi != blocks[RDSA]) {
+      rds->n_afs = 0;
+      rds->n_new_afs = 0;
+      rds->af_count = 0;
+      rds->af_received = 0;
+
+      if (rds->provisional)
+        __clear_station(rds);
+    }
+
+    rds->provisional = 0;
+
+    rds->pi = blocks[RDSA];
+  }
 
   /* Récupération du flag Traffic Program.
      Si actif, la radio diffuse des infos routières si le flag TA l'est aussi. */
-  rds->bit_fields &= ~ST_MASK_TP;
-  rds->bit_fields |= (!!(blocks[RDSB] & MASK_TP)) << ST_BIT_TP;
+  __set_flag(rds, ST_MASK_TP, blocks[RDSB] & MASK_TP);
 
   /* Récupération du Program Type. */
   rds->bit_fields &= ~ST_MASK_PT;
   rds->bit_fields |= ((blocks[RDSB] & MASK_PT) >> BIT_PT) << ST_BIT_PT;
 
-  switch (id) {
-    case 0:
-      __decode_basic_tuning_and_switching_info(rds, blocks);
-      break;
-    case 2:
-      __decode_radio_text(rds, blocks, version);
-      break;
-    default:
-      printf("[rds]Unsupported group type: %d%c.\n", id, !version ? 'A' : 'B');
+  return;
+}
+
+/* Décode un groupe de type group avec son décodeur. */
+static void __decode_group (Rds *rds, uint16_t blocks[], int valid, int group, Group_decoder decoder) {
+  /* Décodage sans vérification, pour comparaison, même si le type
+     de groupe est faux. */
+  if (rds->compare) {
+    if (group == RDS_GROUP(0, 0) || group == RDS_GROUP(0, 1))
+      __decode_unconfirmed_name(rds, blocks[RDSB] & MASK_PSNAME_PART, blocks[RDSD]);
+    else if (group == RDS_GROUP(2, 0) || group == RDS_GROUP(2, 1))
+      __decode_unconfirmed_text(rds, blocks, group & 1);
+  }
+
+  /* Type de groupe inconnu. */
+  if (!(valid & VALID_B)) {
+    rds->stats.rejected_groups++;
+    return;
+  }
+
+  rds->stats.groups[group]++;
+
+  __decode_common(rds, blocks, valid);
+
+  if (decoder != NULL)
+    decoder(rds, blocks, valid);
+  else
+    rds->stats.unknown++;
+
+  return;
+}
+
+void rds_decode (Rds *rds, uint16_t blocks[static RDS_BLOCKS_N], const uint8_t bler[static RDS_BLOCKS_N]) {
+  int group = (blocks[RDSB] >> BIT_GROUP) & MASK_GROUP;
+  int valid = 0;
+  int i;
+
+  for (i = 0; i < RDS_BLOCKS_N; i++)
+    if (bler[i] <= BLER_MAX)
+      valid |= 1 << i;
+    else if (i != RDSB)
+      rds->stats.rejected_blocks++;
+
+  __decode_group(rds, blocks, valid, group, decoders[group]);
+  __update_snapshot(rds);
+
+  return;
+}
+
+/* --------------------------------------------------------------------- */
+
+/* Blocks valides de n groupes: bit i si bler[i] <= BLER_MAX. Avec SSE2,
+   4 groupes par instruction, sinon les 4 blocks d'un groupe à la fois
+   dans un mot de 32 bits. */
+static void __get_valid_blocks (const uint8_t (*bler)[RDS_BLOCKS_N], size_t n, uint8_t *valids) {
+  uint32_t word, high;
+  size_t i = 0;
+
+  #if defined(__SSE2__)
+    const __m128i max = _mm_set1_epi8(BLER_MAX);
+    const __m128i zero = _mm_setzero_si128();
+    int mask;
+
+    /* Un byte valide ne dépasse pas BLER_MAX: sa soustraction saturée est nulle. */
+    for (; i + 4 <= n; i += 4) {
+      mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_subs_epu8(_mm_loadu_si128((const __m128i *)bler[i]), max), zero));
+      valids[i] = mask & 0xF;
+      valids[i + 1] = (mask >> 4) & 0xF;
+      valids[i + 2] = (mask >> 8) & 0xF;
+      valids[i + 3] = (mask >> 12) & 0xF;
+    }
+  #endif
+
+  for (; i < n; i++) {
+    word = bler[i][0] | bler[i][1] << 8 | (uint32_t)bler[i][2] << 16 | (uint32_t)bler[i][3] << 24;
+
+    /* Bit de poids fort de chaque byte non nul une fois BLER_MAX (1)
+       retiré, puis rassemblement des 4 bits. */
+    word &= 0xFEFEFEFE;
+    high = (((word & 0x7F7F7F7F) + 0x7F7F7F7F) | word) & 0x80808080;
+    valids[i] = ~(((high >> 7) * 0x00204081) >> 21) & 0xF;
   }
 
   return;
 }
 
+/* Champs RDS_FIELD_* qu'un groupe a modifiés depuis l'état before.
+   Ceux modifiés par les décodeurs sont déjà dans changed. */
+static int __get_changes (Rds *rds, const Decoded_state *before) {
+  int changes = rds->changed;
+
+  if (rds->pi != before->pi)
+    changes |= 1 << RDS_FIELD_PI;
+  if ((rds->bit_fields ^ before->bit_fields) & ST_MASK_PT)
+    changes |= 1 << RDS_FIELD_PROGRAM_TYPE;
+  if ((rds->bit_fields ^ before->bit_fields) & (ST_MASK_TA | ST_MASK_TP | ST_MASK_MS))
+    changes |= 1 << RDS_FIELD_FLAGS;
+  if (rds->provisional != before->provisional)
+    changes |= 1 << RDS_FIELD_PROVISIONAL;
+
+  return changes;
+}
+
+void rds_decode_batch (Rds *rds, uint16_t (*groups)[RDS_BLOCKS_N], const uint8_t (*bler)[RDS_BLOCKS_N],
+                       size_t n, Rds_change_handler handler, void *user_value) {
+  uint8_t valids[BATCH_SIZE];
+  uint8_t types[BATCH_SIZE];
+  Decoded_state before;
+  Group_decoder decoder;
+  size_t done, len, i, end;
+  int changed = rds->changed;
+  int group, changes;
+
+  for (done = 0; done < n; done += len) {
+    len = n - done < BATCH_SIZE ? n - done : BATCH_SIZE;
+
+    __get_valid_blocks(bler + done, len, valids);
+
+    for (i = 0; i < len; i++) {
+      types[i] = (groups[done + i][RDSB] >> BIT_GROUP) & MASK_GROUP;
+      rds->stats.rejected_blocks += !(valids[i] & VALID_A) + !(valids[i] & VALID_C) + !(valids[i] & VALID_D);
+    }
+
+    /* Suites de groupes de même type, décodées dans l'ordre: la
+       confirmation des caractères et les changements de PI en dépendent. */
+    for (i = 0; i < len; i = end) {
+      group = types[i];
+      decoder = decoders[group];
+
+      for (end = i; end < len && types[end] == group; end++) {
+        before.pi = rds->pi;
+        before.bit_fields = rds->bit_fields;
+        before.provisional = rds->provisional;
+        rds->changed = 0;
+
+        __decode_group(rds, groups[done + end], valids[end], group, decoder);
+
+        if ((changes = __get_changes(rds, &before)) != 0) {
+          changed |= changes;
+
+          if (handler != NULL)
+            handler(done + end, changes, user_value);
+        }
+      }
+    }
+  }
+
+  /* Une seule publication pour tout le lot. */
+  rds->changed = changed;
+  __update_snapshot(rds);
+
+  return;
+}
+
+/* --------------------------------------------------------------------- */
+
 int rds_get_data_type (Rds *rds) {
   if ((rds->bit_fields & (ST_MASK_TA | ST_MASK_TP)) == (ST_MASK_TA | ST_MASK_TP))
     return RDS_DATA_TYPE_TRAFFIC;
@@ -238,6 +985,33 @@ int rds_get_data_type (Rds *rds) {
   return RDS_DATA_TYPE_SPEECH;
 }
 
+void rds_set_station (Rds *rds, uint16_t pi, int program_type, const char *radio_name, const char *radio_text) {
+  /* Les compteurs et la vue publiée, placés en fin de structure, sont
+     gardés: les lecteurs voient les changements comme ceux d'un décodage. */
+  memset(rds, 0, offsetof(Rds, stats));
+
+  rds->pi = pi;
+  rds->provisional = pi != 0;
+  rds->bit_fields |= (program_type << ST_BIT_PT) & ST_MASK_PT;
+  strncpy(rds->radio_name, radio_name, RDS_RADIO_NAME_MAX_LENGTH);
+  strncpy(rds->radio_text, radio_text, RDS_RADIO_TEXT_MAX_LENGTH);
+
+  if (strcmp(rds->radio_name, rds->snapshot.radio_name))
+    rds->changed |= 1 << RDS_FIELD_NAME;
+  if (strcmp(rds->radio_text, rds->snapshot.radio_text))
+    rds->changed |= 1 << RDS_FIELD_TEXT;
+
+  rds->changed |= 1 << RDS_FIELD_PARTIAL_TEXT;
+
+  __update_snapshot(rds);
+
+  return;
+}
+
+uint16_t rds_get_pi (Rds *rds) {
+  return rds->pi;
+}
+
 const char *rds_get_radio_name (Rds *rds) {
   return rds->radio_name;
 }
@@ -254,3 +1028,70 @@ int rds_get_program_type (Rds *rds) {
 
   return pt;
 }
+
+const char *rds_get_program_type_name (Rds *rds) {
+  return rds->program_type_name;
+}
+
+int rds_get_ecc (Rds *rds) {
+  return rds->ecc;
+}
+
+int rds_get_clock (Rds *rds, Rds_clock *clock) {
+  if (!(rds->received & RECEIVED_CLOCK))
+    return -1;
+
+  *clock = rds->clock;
+
+  return 0;
+}
+
+int rds_get_rt_plus (Rds *rds, Rds_rt_plus *rt_plus) {
+  if (!(rds->received & RECEIVED_RT_PLUS))
+    return -1;
+
+  *rt_plus = rds->rt_plus;
+
+  return 0;
+}
+
+int rds_get_tmc (Rds *rds, Rds_tmc *tmc) {
+  if (!(rds->received & RECEIVED_TMC))
+    return -1;
+
+  *tmc = rds->tmc;
+
+  return 0;
+}
+
+int rds_get_other_networks (Rds *rds, const Rds_other_network **networks) {
+  *networks = rds->other_networks;
+  return rds->n_other_networks;
+}
+
+int rds_get_alternative_frequencies (Rds *rds, const int **channels) {
+  *channels = rds->afs;
+  return rds->n_afs;
+}
+
+uint32_t rds_get_generation (Rds *rds, int field) {
+  return __atomic_load_n(&rds->snapshot.gens[field], __ATOMIC_ACQUIRE);
+}
+
+void rds_get_snapshot (Rds *rds, Rds_snapshot *snapshot) {
+  uint32_t seq;
+
+  do {
+    while ((seq = __atomic_load_n(&rds->seq, __ATOMIC_ACQUIRE)) & 1);
+
+    __load_snapshot(snapshot, &rds->snapshot);
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  } while (__atomic_load_n(&rds->seq, __ATOMIC_RELAXED) != seq);
+
+  return;
+}
+
+void rds_get_stats (Rds *rds, Rds_stats *stats) {
+  *stats = rds->stats;
+  return;
+}
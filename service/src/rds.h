@@ -16,6 +16,7 @@
 #ifndef _RDS_H_
 #define _RDS_H_
 
+#include <stddef.h>
 #include <stdint.h>
 
 /* Type de données transmises. */
@@ -57,22 +58,183 @@
 #define RDS_RADIO_NAME_MAX_LENGTH 8
 #define RDS_RADIO_TEXT_MAX_LENGTH 64
 
+/* Caractères d'un segment du texte (groupe 2A, 2 segments en 2B). */
+#define RDS_RADIO_TEXT_SEGMENT_LENGTH 4
+
+/* Fin du texte, s'il est plus court que RDS_RADIO_TEXT_MAX_LENGTH. */
+#define RDS_CARRIAGE_RETURN 13
+
 #define RDS_BLOCKS_N 4
 
+/* Erreurs d'un block signalées par le tuner (BLER). */
+#define RDS_BLER_NONE 0
+#define RDS_BLER_1_2 1 /* 1 à 2 erreurs corrigées. */
+#define RDS_BLER_3_5 2 /* 3 à 5 erreurs corrigées. */
+#define RDS_BLER_UNCORRECTABLE 3
+
+/* Réceptions identiques d'un caractère du nom/texte avant qu'il soit gardé. */
+#define RDS_CONFIRMATIONS 2
+
+/* Longueur du nom du type de programme (PTYN). */
+#define RDS_PROGRAM_TYPE_NAME_MAX_LENGTH 8
+
+/* Types de groupes: 16 types, chacun en version A et B. */
+#define RDS_GROUP_TYPES_N 32
+
+/* Index d'un type de groupe, ex: RDS_GROUP(4, 0) pour 4A. */
+#define RDS_GROUP(TYPE, VERSION) (((TYPE) << 1) | (VERSION))
+
+/* Nombre max de réseaux annoncés par EON (groupe 14A) gardés. */
+#define RDS_OTHER_NETWORKS_MAX 4
+
+/* Nombre max de fréquences alternatives d'une liste (groupe 0A). */
+#define RDS_AF_MAX 25
+
+/* Champs d'un Rds_snapshot ayant chacun leur génération.
+   RDS_FIELD_ANY change avec n'importe lequel d'entre eux. */
+#define RDS_FIELD_ANY 0
+#define RDS_FIELD_PI 1
+#define RDS_FIELD_NAME 2
+#define RDS_FIELD_TEXT 3
+#define RDS_FIELD_PROGRAM_TYPE 4
+#define RDS_FIELD_FLAGS 5 /* TA, TP et Music/Speech. */
+#define RDS_FIELD_PROVISIONAL 6
+#define RDS_FIELD_PARTIAL_TEXT 7 /* Texte en cours de réception et flag A/B. */
+#define RDS_FIELDS_N 8
+
+/* Identifiants d'applications ODA (groupe 3A). */
+#define RDS_AID_RT_PLUS 0x4BD7
+#define RDS_AID_TMC 0xCD46
+
 typedef struct Rds Rds;
 
+/* Reçoit les champs (bits 1 << RDS_FIELD_*) modifiés par le groupe
+   index d'un lot. */
+typedef void (*Rds_change_handler)(size_t index, int fields, void *user_value);
+
+/* Date et heure UTC (groupe 4A). */
+typedef struct Rds_clock {
+  long mjd; /* Modified Julian Day. */
+  int hour;
+  int minute;
+  int offset; /* Décalage de l'heure locale en minutes. */
+} Rds_clock;
+
+/* Tag RadioText+: un élément du texte de la radio, par exemple
+   le titre (content type 1) ou l'artiste (content type 4). */
+typedef struct Rds_rt_plus_tag {
+  int content_type;
+  int start;
+  int length;
+} Rds_rt_plus_tag;
+
+typedef struct Rds_rt_plus {
+  int running; /* Non nul si un élément est en cours de diffusion. */
+  int toggle; /* Change à chaque nouvel élément. */
+  Rds_rt_plus_tag tags[2];
+} Rds_rt_plus;
+
+/* Message TMC en un seul groupe. */
+typedef struct Rds_tmc {
+  int event;
+  int location;
+  int extent;
+  int direction;
+} Rds_tmc;
+
+/* Réseau annoncé par EON, nom vide s'il est inconnu. */
+typedef struct Rds_other_network {
+  uint16_t pi;
+  char name[RDS_RADIO_NAME_MAX_LENGTH + 1];
+} Rds_other_network;
+
+/* Compteurs des groupes décodés. */
+typedef struct Rds_stats {
+  unsigned long groups[RDS_GROUP_TYPES_N]; /* Groupes reçus par type. */
+  unsigned long unknown; /* Groupes reçus sans décodeur. */
+
+  /* Groupes rejetés (block B trop erroné) et blocks A, C, D rejetés. */
+  unsigned long rejected_groups;
+  unsigned long rejected_blocks;
+
+  /* Changements du nom/texte: publiés, et qui l'auraient été
+     sans rejet des blocks erronés ni confirmation des caractères
+     (compté avec rds_set_compare seulement). */
+  unsigned long updates;
+  unsigned long unconfirmed_updates;
+} Rds_stats;
+
+/* Vue cohérente des principales données RDS, lisible depuis n'importe
+   quel thread. */
+typedef struct Rds_snapshot {
+  /* Génération de chaque champ RDS_FIELD_*. Premier champ de la vue:
+     il est copié par des accès de 32 bits. */
+  uint32_t gens[RDS_FIELDS_N];
+
+  uint16_t pi;
+  uint8_t program_type;
+  uint8_t ta;
+  uint8_t tp;
+  uint8_t music;
+
+  /* Non nul si le nom, le texte et le type de programme sont ceux
+     connus de la station, pas encore confirmés par son PI. */
+  uint8_t provisional;
+
+  char radio_name[RDS_RADIO_NAME_MAX_LENGTH + 1];
+  char radio_text[RDS_RADIO_TEXT_MAX_LENGTH + 1];
+
+  /* Caractères confirmés du texte en cours de réception, '\0' pour
+     ceux qui ne le sont pas, et son flag A/B qui change à chaque
+     nouveau texte. */
+  char partial_text[RDS_RADIO_TEXT_MAX_LENGTH];
+  uint8_t text_ab;
+} Rds_snapshot;
+
 /* Crée un objet Rds. */
 Rds *rds_new (void);
 
 /* Libère un objet Rds. */
 void rds_free (Rds *rds);
 
-/* Décode le contenu de blocks RDS et le stocke dans rds. */
-void rds_decode (Rds *rds, uint16_t blocks[static RDS_BLOCKS_N]);
+/* Active ou non le décodage sans vérification du nom/texte, qui compte
+   unconfirmed_updates. Désactivé par défaut: il ne sert qu'à comparer
+   les décodeurs (bench, relecture d'un log). */
+void rds_set_compare (Rds *rds, int compare);
+
+/* Donne le channel réglé (en 100 kHz), exclu des fréquences
+   alternatives reçues par la méthode B. 0 si inconnu. */
+void rds_set_channel (Rds *rds, int channel);
+
+/* Décode le contenu de blocks RDS et le stocke dans rds. bler donne les
+   erreurs de chaque block: un block avec plus de 2 erreurs corrigées est
+   ignoré, et tout le groupe si c'est le block B. */
+void rds_decode (Rds *rds, uint16_t blocks[static RDS_BLOCKS_N], const uint8_t bler[static RDS_BLOCKS_N]);
+
+/* Décode n groupes consécutifs d'une station, comme n appels de
+   rds_decode, mais les blocks valides et les types sont calculés en bloc
+   et la vue des autres threads n'est publiée qu'une fois, à la fin.
+   handler, s'il n'est pas NULL, est appelé pour chaque groupe qui a
+   modifié un champ. */
+void rds_decode_batch (Rds *rds, uint16_t (*groups)[RDS_BLOCKS_N], const uint8_t (*bler)[RDS_BLOCKS_N],
+                       size_t n, Rds_change_handler handler, void *user_value);
+
+/* Oublie les données décodées et les remplace par des données connues
+   d'une station (PI 0 et chaînes vides si elles sont inconnues). Avec un
+   PI, elles restent provisoires jusqu'au premier block A: elles sont
+   confirmées s'il porte le même PI, sinon le nom, le texte et le type
+   de programme sont effacés. */
+void rds_set_station (Rds *rds, uint16_t pi, int program_type, const char *radio_name, const char *radio_text);
+
+/* Les fonctions suivantes, sauf rds_get_generation et rds_get_snapshot,
+   ne doivent être appelées que par le thread qui décode. */
 
 /* Retourne le type de données: MUSIC, TRAFFIC ou SPEECH. */
 int rds_get_data_type (Rds *rds);
 
+/* Retourne le PI (Program Identification) de la station, 0 si inconnu. */
+uint16_t rds_get_pi (Rds *rds);
+
 /* Donne un nom/le texte de radio actuellement en mémoire. */
 const char *rds_get_radio_name (Rds *rds);
 const char *rds_get_radio_text (Rds *rds);
@@ -80,4 +242,44 @@ const char *rds_get_radio_text (Rds *rds);
 /* Retourne le type de programme. */
 int rds_get_program_type (Rds *rds);
 
+/* Donne le nom du type de programme, "" s'il est inconnu. */
+const char *rds_get_program_type_name (Rds *rds);
+
+/* Retourne l'Extended Country Code, 0 s'il est inconnu. */
+int rds_get_ecc (Rds *rds);
+
+/* Donne la dernière date/heure reçue.
+   Retourne -1 si aucune n'a été reçue, sinon 0. */
+int rds_get_clock (Rds *rds, Rds_clock *clock);
+
+/* Donne les derniers tags RadioText+ reçus.
+   Retourne -1 si aucun n'a été reçu, sinon 0. */
+int rds_get_rt_plus (Rds *rds, Rds_rt_plus *rt_plus);
+
+/* Donne le dernier message TMC reçu.
+   Retourne -1 si aucun n'a été reçu, sinon 0. */
+int rds_get_tmc (Rds *rds, Rds_tmc *tmc);
+
+/* Donne les réseaux annoncés par EON.
+   Retourne leur nombre. */
+int rds_get_other_networks (Rds *rds, const Rds_other_network **networks);
+
+/* Donne les fréquences alternatives de la station, en channels
+   (ex: 938 pour 93.8 MHz). La liste est oubliée si le PI change.
+   Retourne leur nombre. */
+int rds_get_alternative_frequencies (Rds *rds, const int **channels);
+
+/* Retourne la génération d'un champ RDS_FIELD_*, incrémentée à chacun
+   de ses changements. Sans verrou, depuis n'importe quel thread. */
+uint32_t rds_get_generation (Rds *rds, int field);
+
+/* Copie une vue cohérente des données RDS, sans verrou, depuis
+   n'importe quel thread. Une copie concurrente d'une mise à jour
+   est recommencée. */
+void rds_get_snapshot (Rds *rds, Rds_snapshot *snapshot);
+
+/* Copie les compteurs de groupes dans stats. Ils ne sont pas remis à
+   zéro par rds_set_station. */
+void rds_get_stats (Rds *rds, Rds_stats *stats);
+
 #endif /* _RDS_H_ INCLUDED */
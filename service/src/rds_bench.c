@@ -0,0 +1,323 @@
+/*
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils/alloc.h"
+#include "utils/error.h"
+#include "utils/ptime.h"
+
+#include "rds.h"
+#include "rds_bench.h"
+#include "rds_demod.h"
+
+/* Groupes enregistrés par station (~6 minutes de diffusion) et nombre
+   de passes sur l'enregistrement. */
+#define GROUPS_PER_STATION 4096
+#define ROUNDS 64
+
+/* Signal MPX synthétique: groupes par station (~22 s de diffusion) et
+   niveaux relatifs à la pleine échelle du pilote, du RDS, d'un son mono
+   et du bruit blanc. */
+#define MPX_GROUPS_PER_STATION 256
+#define MPX_PILOT_LEVEL 0.08
+#define MPX_RDS_LEVEL 0.04
+#define MPX_AUDIO_LEVEL 0.5
+#define MPX_NOISE_LEVEL 0.1
+#define MPX_PILOT 19000
+#define MPX_AUDIO 1000
+
+/* --------------------------------------------------------------------- */
+
+static void __count_change (size_t index, int fields, void *user_value) {
+  (void)index;
+  (void)fields;
+  ++*(unsigned long *)user_value;
+
+  return;
+}
+
+/* Comme l'émulateur: un block erroné sur 2 est corrigé (BLER 1), l'autre
+   est altéré et non corrigible (BLER 3). */
+static void __add_errors (uint16_t blocks[RDS_BLOCKS_N], uint8_t bler[RDS_BLOCKS_N], int rate, unsigned int *seed) {
+  int i, r;
+
+  for (i = 0; i < RDS_BLOCKS_N; i++) {
+    bler[i] = RDS_BLER_NONE;
+
+    if (rate == 0 || (r = rand_r(seed)) % 100 >= rate)
+      continue;
+
+    if (r & 0x100) {
+      bler[i] = RDS_BLER_UNCORRECTABLE;
+      blocks[i] ^= (r >> 12) | 1;
+    } else
+      bler[i] = RDS_BLER_1_2;
+  }
+
+  return;
+}
+
+void rds_bench_utils (const Si4702_emu_conf *band) {
+  uint16_t (*groups)[RDS_BLOCKS_N];
+  uint8_t (*blers)[RDS_BLOCKS_N];
+  const Si4702_emu_station *stations[SI4702_EMU_STATIONS_MAX];
+  unsigned long n_groups;
+  Rds *rds[SI4702_EMU_STATIONS_MAX];
+  Rds *batch_rds[SI4702_EMU_STATIONS_MAX];
+  Rds_stats stats, batch_stats;
+  unsigned long groups_by_type[RDS_GROUP_TYPES_N] = { 0 };
+  unsigned long unknown = 0;
+  unsigned long rejected_groups = 0, rejected_blocks = 0;
+  unsigned long updates = 0, unconfirmed_updates = 0;
+  unsigned int seed = 1;
+  unsigned long changes = 0;
+  Time start, end;
+  long elapsed, batch_elapsed;
+  int n_stations = 0;
+  int i, j, round;
+
+  for (i = 0; i < band->n_stations; i++)
+    if (band->stations[i].pi != 0)
+      stations[n_stations++] = &band->stations[i];
+
+  if (n_stations == 0)
+    fatal_error("No RDS station in the band.");
+
+  /* Enregistrement hors mesure. */
+  pmalloc(groups, n_stations * GROUPS_PER_STATION * sizeof *groups);
+  pmalloc(blers, n_stations * GROUPS_PER_STATION * sizeof *blers);
+
+  for (i = 0; i < n_stations; i++)
+    for (j = 0; j < GROUPS_PER_STATION; j++)
+      si4702_emu_generate_group(stations[i], j, groups[i * GROUPS_PER_STATION + j]);
+
+  for (i = 0; i < n_stations * GROUPS_PER_STATION; i++)
+    __add_errors(groups[i], blers[i], band->error_rate, &seed);
+
+  /* Un décodeur par station, comme un tuner qui reste réglé. */
+  for (i = 0; i < n_stations; i++) {
+    rds[i] = rds_new();
+    rds_set_compare(rds[i], 1);
+  }
+
+  time_get_cur(&start);
+
+  for (round = 0; round < ROUNDS; round++)
+    for (i = 0; i < n_stations; i++)
+      for (j = 0; j < GROUPS_PER_STATION; j++)
+        rds_decode(rds[i], groups[i * GROUPS_PER_STATION + j], blers[i * GROUPS_PER_STATION + j]);
+
+  time_get_cur(&end);
+
+  elapsed = time_diff_u(&start, &end);
+  n_groups = (unsigned long)ROUNDS * n_stations * GROUPS_PER_STATION;
+
+  printf("RDS bench: %lu groups of %d stations decoded in %ld us.\n", n_groups, n_stations, elapsed);
+  printf("RDS bench: %.0f groups/s, %.1f ns/group.\n",
+         n_groups * 1e6 / (elapsed > 0 ? elapsed : 1), elapsed * 1e3 / n_groups);
+
+  /* Mêmes groupes par lots: un lot par station et par passe, comme la
+     relecture d'une capture. */
+  for (i = 0; i < n_stations; i++) {
+    batch_rds[i] = rds_new();
+    rds_set_compare(batch_rds[i], 1);
+  }
+
+  time_get_cur(&start);
+
+  for (round = 0; round < ROUNDS; round++)
+    for (i = 0; i < n_stations; i++)
+      rds_decode_batch(batch_rds[i], groups + i * GROUPS_PER_STATION, (const uint8_t (*)[RDS_BLOCKS_N])blers + i * GROUPS_PER_STATION,
+                       GROUPS_PER_STATION, __count_change, &changes);
+
+  time_get_cur(&end);
+
+  batch_elapsed = time_diff_u(&start, &end);
+
+  printf("RDS bench: batches: %.0f groups/s, %.1f ns/group, x%.2f, %lu change events.\n",
+         n_groups * 1e6 / (batch_elapsed > 0 ? batch_elapsed : 1), batch_elapsed * 1e3 / n_groups,
+         (double)elapsed / (batch_elapsed > 0 ? batch_elapsed : 1), changes);
+
+  for (i = 0; i < n_stations; i++) {
+    rds_get_stats(rds[i], &stats);
+    rds_get_stats(batch_rds[i], &batch_stats);
+
+    if (memcmp(&stats, &batch_stats, sizeof stats) ||
+        strcmp(rds_get_radio_name(rds[i]), rds_get_radio_name(batch_rds[i])) ||
+        strcmp(rds_get_radio_text(rds[i]), rds_get_radio_text(batch_rds[i])))
+      printf("RDS bench: station %04X decoded differently by batches.\n", rds_get_pi(rds[i]));
+
+    rds_free(batch_rds[i]);
+
+    for (j = 0; j < RDS_GROUP_TYPES_N; j++)
+      groups_by_type[j] += stats.groups[j];
+
+    unknown += stats.unknown;
+    rejected_groups += stats.rejected_groups;
+    rejected_blocks += stats.rejected_blocks;
+    updates += stats.updates;
+    unconfirmed_updates += stats.unconfirmed_updates;
+    rds_free(rds[i]);
+  }
+
+  for (i = 0; i < RDS_GROUP_TYPES_N; i++)
+    if (groups_by_type[i] > 0)
+      printf("Group %2d%c: %lu\n", i >> 1, (i & 1) ? 'B' : 'A', groups_by_type[i]);
+
+  printf("Unknown groups: %lu\n", unknown);
+  printf("Rejected groups: %lu, rejected blocks: %lu (%d%% of erroneous blocks).\n",
+         rejected_groups, rejected_blocks, band->error_rate);
+  printf("Name/text updates: %lu, without confirmation: %lu.\n", updates, unconfirmed_updates);
+
+  free(blers);
+  free(groups);
+
+  return;
+}
+
+/* --------------------------------------------------------------------- */
+
+static uint16_t __get_offset (const uint16_t blocks[static RDS_BLOCKS_N], int i) {
+  static const uint16_t offsets[RDS_BLOCKS_N] = {
+    RDS_DEMOD_OFFSET_A, RDS_DEMOD_OFFSET_B, RDS_DEMOD_OFFSET_C, RDS_DEMOD_OFFSET_D
+  };
+
+  /* Bit de version B du block B: C' remplace C. */
+  return (i == 2 && (blocks[1] & 0x0800)) ? RDS_DEMOD_OFFSET_C2 : offsets[i];
+}
+
+/* Module les groupes d'une station en MPX: chaque bit, codé en différentiel
+   puis en biphase, module en BPSK la sous-porteuse à 3 fois le pilote.
+   Retourne le nombre d'échantillons, n_groups * 104 bits à rate Hz. */
+static size_t __synthesize_mpx (const Si4702_emu_station *station, int rate, int n_groups,
+                                int16_t *samples, unsigned int *seed) {
+  uint16_t blocks[RDS_BLOCKS_N];
+  uint32_t word;
+  uint8_t *bits;
+  size_t n, i;
+  double t, phase, symbol, value;
+  int n_bits = n_groups * RDS_BLOCKS_N * 26;
+  int bit = 0, g, j, k;
+  long index;
+
+  pmalloc(bits, n_bits);
+
+  for (g = 0; g < n_groups; g++) {
+    si4702_emu_generate_group(station, g, blocks);
+
+    for (j = 0; j < RDS_BLOCKS_N; j++) {
+      word = (uint32_t)blocks[j] << 10 | rds_demod_checkword(blocks[j], __get_offset(blocks, j));
+
+      for (k = 25; k >= 0; k--) {
+        bit ^= (word >> k) & 1;
+        bits[(g * RDS_BLOCKS_N + j) * 26 + 25 - k] = bit;
+      }
+    }
+  }
+
+  n = (size_t)(n_bits / RDS_DEMOD_BITRATE * rate);
+
+  for (i = 0; i < n; i++) {
+    t = (double)i / rate;
+    phase = t * RDS_DEMOD_BITRATE;
+    index = (long)phase;
+    symbol = sin(2 * M_PI * (phase - index)) * (bits[index] ? 1 : -1);
+
+    value = MPX_PILOT_LEVEL * sin(2 * M_PI * MPX_PILOT * t) +
+      MPX_RDS_LEVEL * symbol * sin(2 * M_PI * 3 * MPX_PILOT * t) +
+      MPX_AUDIO_LEVEL * sin(2 * M_PI * MPX_AUDIO * t) +
+      MPX_NOISE_LEVEL * (2.0 * rand_r(seed) / RAND_MAX - 1);
+
+    samples[i] = (int16_t)(value * 32767 * 0.9);
+  }
+
+  free(bits);
+
+  return n;
+}
+
+static void __count_group (uint16_t blocks[static RDS_BLOCKS_N], const uint8_t bler[static RDS_BLOCKS_N],
+                           void *user_value) {
+  rds_decode(user_value, blocks, bler);
+
+  return;
+}
+
+void rds_demod_bench_utils (const Si4702_emu_conf *band, int rate) {
+  const Si4702_emu_station *stations[SI4702_EMU_STATIONS_MAX];
+  int16_t *samples;
+  size_t max_samples, n, total = 0;
+  Rds_demod *demod;
+  Rds_demod_stats stats;
+  Rds *rds;
+  Time start, end;
+  long elapsed = 0;
+  unsigned long groups = 0;
+  unsigned int seed = 1;
+  int n_stations = 0;
+  int i;
+
+  for (i = 0; i < band->n_stations; i++)
+    if (band->stations[i].pi != 0)
+      stations[n_stations++] = &band->stations[i];
+
+  if (n_stations == 0)
+    fatal_error("No RDS station in the band.");
+
+  if ((demod = rds_demod_new(rate)) == NULL)
+    fatal_error("Unsupported MPX sample rate: %d Hz.", rate);
+
+  rds_demod_free(demod);
+
+  max_samples = (size_t)(MPX_GROUPS_PER_STATION * RDS_BLOCKS_N * 26 / RDS_DEMOD_BITRATE * rate) + 1;
+  pmalloc(samples, max_samples * sizeof *samples);
+
+  /* Synthèse hors mesure, un démodulateur par station. */
+  for (i = 0; i < n_stations; i++) {
+    n = __synthesize_mpx(stations[i], rate, MPX_GROUPS_PER_STATION, samples, &seed);
+    demod = rds_demod_new(rate);
+    rds = rds_new();
+
+    time_get_cur(&start);
+    rds_demod_process(demod, samples, n, __count_group, rds);
+    time_get_cur(&end);
+
+    elapsed += time_diff_u(&start, &end);
+    total += n;
+
+    rds_demod_get_stats(demod, &stats);
+    groups += stats.groups;
+
+    printf("PI=%04X: %lu/%d groups, %lu syncs, %lu corrected and %lu uncorrectable blocks, "
+           "name='%s', text='%s'\n", stations[i]->pi, stats.groups, MPX_GROUPS_PER_STATION, stats.syncs,
+           stats.corrected_blocks, stats.uncorrectable_blocks, rds_get_radio_name(rds), rds_get_radio_text(rds));
+
+    rds_free(rds);
+    rds_demod_free(demod);
+  }
+
+  printf("MPX bench: %zu samples of %d stations demodulated in %ld us, %lu/%lu groups.\n",
+         total, n_stations, elapsed, groups, (unsigned long)n_stations * MPX_GROUPS_PER_STATION);
+  printf("MPX bench: %.0f samples/s on 1 core, %.1fx real time at %d Hz.\n",
+         total * 1e6 / (elapsed > 0 ? elapsed : 1), (double)total / rate * 1e6 / (elapsed > 0 ? elapsed : 1), rate);
+
+  free(samples);
+
+  return;
+}
@@ -0,0 +1,32 @@
+/*
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _RDS_BENCH_H_
+#define _RDS_BENCH_H_
+
+#include "hw/si4702_emu.h"
+
+/* Enregistre le trafic RDS des stations d'une bande émulée, puis mesure
+   le débit du décodeur en groupes par seconde et affiche les groupes
+   reçus par type. Les erreurs de la bande (error_rate) sont ajoutées
+   à l'enregistrement. */
+void rds_bench_utils (const Si4702_emu_conf *band);
+
+/* Module le RDS des stations d'une bande émulée en signaux MPX échantillonnés
+   à rate Hz, avec pilote, son et bruit, puis mesure le débit du
+   démodulateur en échantillons par seconde et compte les groupes décodés. */
+void rds_demod_bench_utils (const Si4702_emu_conf *band, int rate);
+
+#endif /* _RDS_BENCH_H_ INCLUDED */
@@ -0,0 +1,99 @@
+/*
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+
+#include "utils/alloc.h"
+
+#include "rds_cache.h"
+
+/* Une entrée et sa dernière utilisation, 0 si elle est libre. */
+typedef struct Slot {
+  uint32_t used;
+  Rds_cache_entry entry;
+} Slot;
+
+struct Rds_cache {
+  Slot slots[RDS_CACHE_SIZE];
+  uint32_t clock; /* Dernière utilisation donnée. */
+};
+
+/* --------------------------------------------------------------------- */
+
+Rds_cache *rds_cache_new (void) {
+  return pnew0(Rds_cache);
+}
+
+void rds_cache_free (Rds_cache *cache) {
+  if (cache != NULL)
+    free(cache);
+
+  return;
+}
+
+/* --------------------------------------------------------------------- */
+
+/* Retourne l'emplacement le plus récent d'une station, ou NULL. */
+static Slot *__find (Rds_cache *cache, int channel, uint16_t pi) {
+  Slot *slot, *found = NULL;
+  int i;
+
+  for (i = 0; i < RDS_CACHE_SIZE; i++) {
+    slot = &cache->slots[i];
+
+    if (slot->used != 0 && slot->entry.channel == channel &&
+        (pi == RDS_CACHE_ANY_PI || slot->entry.pi == pi) &&
+        (found == NULL || slot->used > found->used))
+      found = slot;
+  }
+
+  return found;
+}
+
+int rds_cache_get (Rds_cache *cache, int channel, uint16_t pi, Rds_cache_entry *entry) {
+  Slot *slot = __find(cache, channel, pi);
+
+  if (slot == NULL)
+    return -1;
+
+  slot->used = ++cache->clock;
+  *entry = slot->entry;
+
+  return 0;
+}
+
+void rds_cache_set (Rds_cache *cache, int channel, const Rds_snapshot *snapshot) {
+  Slot *slot;
+  int i;
+
+  if (snapshot->pi == 0)
+    return;
+
+  /* Emplacement de la station, sinon un emplacement libre,
+     sinon la station la moins récemment utilisée. */
+  if ((slot = __find(cache, channel, snapshot->pi)) == NULL)
+    for (slot = cache->slots, i = 1; i < RDS_CACHE_SIZE; i++)
+      if (cache->slots[i].used < slot->used)
+        slot = &cache->slots[i];
+
+  slot->used = ++cache->clock;
+  slot->entry.channel = channel;
+  slot->entry.pi = snapshot->pi;
+  slot->entry.program_type = snapshot->program_type;
+  strcpy(slot->entry.radio_name, snapshot->radio_name);
+  strcpy(slot->entry.radio_text, snapshot->radio_text);
+
+  return;
+}
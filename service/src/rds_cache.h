@@ -0,0 +1,57 @@
+/*
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _RDS_CACHE_H_
+#define _RDS_CACHE_H_
+
+#include <stdint.h>
+
+#include "rds.h"
+
+/* Nombre de stations gardées en mémoire. */
+#define RDS_CACHE_SIZE 32
+
+/* PI quelconque pour rds_cache_get. */
+#define RDS_CACHE_ANY_PI 0
+
+typedef struct Rds_cache Rds_cache;
+
+/* Dernières données RDS décodées d'une station. */
+typedef struct Rds_cache_entry {
+  int channel;
+  uint16_t pi;
+  int program_type;
+  char radio_name[RDS_RADIO_NAME_MAX_LENGTH + 1];
+  char radio_text[RDS_RADIO_TEXT_MAX_LENGTH + 1];
+} Rds_cache_entry;
+
+/* Crée un cache vide. Une station y est identifiée par son channel et
+   son PI: un même channel peut recevoir plusieurs stations. */
+Rds_cache *rds_cache_new (void);
+
+/* Libère un cache. */
+void rds_cache_free (Rds_cache *cache);
+
+/* Donne la station d'un channel avec un PI, ou la dernière utilisée de ce
+   channel si pi vaut RDS_CACHE_ANY_PI.
+   Retourne -1 si la station est inconnue, sinon 0. */
+int rds_cache_get (Rds_cache *cache, int channel, uint16_t pi, Rds_cache_entry *entry);
+
+/* Mémorise les données d'une vue RDS reçues sur un channel, ignorées si
+   le PI est inconnu. Si le cache est plein, la station utilisée il y a
+   le plus longtemps est remplacée. */
+void rds_cache_set (Rds_cache *cache, int channel, const Rds_snapshot *snapshot);
+
+#endif /* _RDS_CACHE_H_ INCLUDED */
@@ -0,0 +1,738 @@
+/*
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__AVX__)
+  #include <immintrin.h>
+#elif defined(__SSE__)
+  #include <xmmintrin.h>
+#elif defined(__ARM_NEON)
+  #include <arm_neon.h>
+#endif
+
+#include "utils/alloc.h"
+#include "utils/error.h"
+#include "utils/ptime.h"
+
+#include "rds_demod.h"
+
+/* Floats traités par instruction dans les produits scalaires des filtres.
+   Le nombre de coefficients d'un filtre en est un multiple. */
+#if defined(__AVX__)
+  #define SIMD_WIDTH 8
+#else
+  #define SIMD_WIDTH 4
+#endif
+
+/* Fréquence en Hz après décimation: 13 à 21 échantillons par bit. */
+#define DECIMATED_RATE_MIN 16000
+#define DECIMATED_RATE_MAX 25000
+
+/* Le mélange à 57 kHz est intégré au filtre: un jeu de coefficients par
+   phase de la porteuse vue par les échantillons décimés. */
+#define PHASES_MAX 64
+
+/* Filtre passe-bas après mélange: coupure en Hz et durée de sa réponse
+   en secondes. Le signal RDS occupe +/- 2.4 kHz autour de 57 kHz. */
+#define FILTER_CUTOFF 2800.0
+#define FILTER_DURATION 0.0015
+
+/* Echantillons convertis en float à la fois. */
+#define CHUNK_SIZE 4096
+
+/* Boucle de Costas: gains de phase et de fréquence, et gain de la moyenne
+   du niveau du signal qui normalise l'erreur. */
+#define CARRIER_ALPHA 0.05f
+#define CARRIER_BETA 0.0008f
+#define LEVEL_GAIN 0.002f
+
+/* Horloge des bits: intégrateurs décalés de 1/CLOCK_PHASES bit, gain de
+   la moyenne de leur énergie, et marges pour passer à un intégrateur
+   voisin ou plus éloigné. */
+#define CLOCK_PHASES 16
+#define ENERGY_GAIN 0.01f
+#define CLOCK_HYSTERESIS 1.02f
+#define CLOCK_JUMP 1.2f
+
+/* Un block: 16 bits de données et 10 bits de checkword. */
+#define BLOCK_BITS 26
+#define CHECK_BITS 10
+#define BLOCK_MASK 0x3FFFFFF
+
+/* Polynôme générateur: x^10 + x^8 + x^7 + x^5 + x^4 + x^3 + 1. */
+#define POLYNOMIAL 0x5B9
+
+/* Longueur max des paquets d'erreurs corrigés. */
+#define BURST_MAX 5
+
+/* Synchronisation: 2 offsets séparés d'au plus SYNC_SPAN blocks parmi
+   les SYNC_CANDIDATES derniers, perdue après SYNC_LOST blocks non
+   corrigibles à la suite. */
+#define SYNC_CANDIDATES 8
+#define SYNC_SPAN 6
+#define SYNC_LOST 8
+
+/* Index des blocks d'un groupe. */
+#define BLOCK_A 0
+#define BLOCK_B 1
+#define BLOCK_C 2
+#define BLOCK_D 3
+
+/* Bit de version B d'un groupe dans le block B. */
+#define GROUP_VERSION_B 0x0800
+
+/* --------------------------------------------------------------------- */
+
+typedef struct Candidate {
+  unsigned long bit; /* Position du dernier bit du block. */
+  int index; /* -1 si vide. */
+} Candidate;
+
+struct Rds_demod {
+  /* Filtrage: décimation, coefficients (cos puis -sin) de chaque phase,
+     et historique des échantillons suivi du bloc courant. */
+  int decimation;
+  int n_phases;
+  int n_taps;
+  int phase;
+  int countdown;
+  float *taps;
+  float *buffer;
+
+  /* Porteuse reconstituée et niveau moyen du signal. */
+  float carrier_phase;
+  float carrier_freq;
+  float level;
+
+  /* Horloge des bits. */
+  float bit_phase;
+  float bit_inc;
+  float accs[CLOCK_PHASES];
+  float energies[CLOCK_PHASES];
+  int best;
+  int since_bit;
+  int half_bit;
+  int prev_bit;
+
+  /* Blocks: registre des derniers bits, synchronisation et groupe
+     en cours. */
+  uint32_t reg;
+  unsigned long n_bits;
+  Candidate candidates[SYNC_CANDIDATES];
+  int next_candidate;
+  int synced;
+  int block;
+  int block_bits;
+  int bad_blocks;
+  int group_mask;
+  uint16_t blocks[RDS_BLOCKS_N];
+  uint8_t bler[RDS_BLOCKS_N];
+
+  /* Paquet d'erreurs à corriger par syndrome, 0 si non corrigible. */
+  uint32_t corrections[1 << CHECK_BITS];
+
+  Rds_demod_stats stats;
+};
+
+/* --------------------------------------------------------------------- */
+
+static int __gcd (int a, int b) {
+  int t;
+
+  while (b != 0) {
+    t = a % b;
+    a = b;
+    b = t;
+  }
+
+  return a;
+}
+
+/* Reste de la division d'un block par le polynôme générateur. */
+static uint16_t __syndrome (uint32_t word) {
+  int i;
+
+  for (i = BLOCK_BITS - 1; i >= CHECK_BITS; i--)
+    if (word & (1u << i))
+      word ^= (uint32_t)POLYNOMIAL << (i - CHECK_BITS);
+
+  return word;
+}
+
+/* Les syndromes des paquets d'au plus BURST_MAX bits sont distincts:
+   les plus courts sont enregistrés en premier. */
+static void __init_corrections (uint32_t corrections[static 1 << CHECK_BITS]) {
+  uint32_t burst, error;
+  uint16_t syndrome;
+  int length, middle, shift;
+
+  for (length = 1; length <= BURST_MAX; length++)
+    for (middle = 0; middle < (length > 2 ? 1 << (length - 2) : 1); middle++) {
+      burst = length == 1 ? 1 : (1u << (length - 1)) | ((uint32_t)middle << 1) | 1;
+
+      for (shift = 0; shift <= BLOCK_BITS - length; shift++) {
+        error = burst << shift;
+        syndrome = __syndrome(error);
+
+        if (corrections[syndrome] == 0)
+          corrections[syndrome] = error;
+      }
+    }
+
+  return;
+}
+
+/* Choisit la décimation qui minimise le nombre de phases de la porteuse.
+   Retourne -1 si rate n'est pas supporté, sinon 0. */
+static int __choose_decimation (int rate, int *decimation, int *n_phases) {
+  int period = rate / __gcd(rate, RDS_DEMOD_CARRIER);
+  int d, phases;
+
+  *decimation = 0;
+  *n_phases = PHASES_MAX + 1;
+
+  for (d = (rate + DECIMATED_RATE_MAX - 1) / DECIMATED_RATE_MAX; d <= rate / DECIMATED_RATE_MIN; d++) {
+    phases = period / __gcd(period, d);
+
+    if (phases <= *n_phases) {
+      *decimation = d;
+      *n_phases = phases;
+    }
+  }
+
+  return *n_phases <= PHASES_MAX ? 0 : -1;
+}
+
+/* Passe-bas à fenêtre de Blackman, de gain 1 en continu. Les coefficients
+   sont rangés du plus ancien échantillon au plus récent, complétés par
+   des zéros côté ancien jusqu'à n_taps. Chaque phase s multiplie le
+   passe-bas par la porteuse vue par sa sortie: cos puis -sin. */
+static void __init_taps (Rds_demod *demod, int rate, int length) {
+  int period = rate / __gcd(rate, RDS_DEMOD_CARRIER);
+  double omega = 2 * M_PI * RDS_DEMOD_CARRIER / rate;
+  double fc = FILTER_CUTOFF / rate;
+  double *lowpass, sum = 0, x, angle;
+  float *cos_taps, *sin_taps;
+  int i, k, s, r;
+
+  pmalloc(lowpass, length * sizeof *lowpass);
+
+  for (k = 0; k < length; k++) {
+    x = k - (length - 1) / 2.0;
+    lowpass[k] = (x == 0 ? 2 * fc : sin(2 * M_PI * fc * x) / (M_PI * x)) *
+      (0.42 - 0.5 * cos(2 * M_PI * k / (length - 1)) + 0.08 * cos(4 * M_PI * k / (length - 1)));
+    sum += lowpass[k];
+  }
+
+  for (s = 0; s < demod->n_phases; s++) {
+    cos_taps = demod->taps + s * 2 * demod->n_taps;
+    sin_taps = cos_taps + demod->n_taps;
+
+    /* Phase de la porteuse au dernier échantillon de la sortie s. */
+    r = (s * demod->decimation + demod->decimation - 1) % period;
+
+    for (i = 0; i < demod->n_taps; i++) {
+      /* Age de l'échantillon multiplié par le coefficient i. */
+      k = demod->n_taps - 1 - i;
+
+      if (k >= length) {
+        cos_taps[i] = sin_taps[i] = 0;
+        continue;
+      }
+
+      angle = omega * (r - k);
+      cos_taps[i] = lowpass[k] / sum * cos(angle);
+      sin_taps[i] = -lowpass[k] / sum * sin(angle);
+    }
+  }
+
+  free(lowpass);
+
+  return;
+}
+
+/* --------------------------------------------------------------------- */
+
+/* Produits scalaires de n échantillons par les coefficients cos et sin,
+   n multiple de SIMD_WIDTH. */
+static void __dot2 (const float *cos_taps, const float *sin_taps, const float *x, int n,
+                    float *re, float *im) {
+  int i;
+
+  #if defined(__AVX__)
+    __m256 acc_re = _mm256_setzero_ps(), acc_im = _mm256_setzero_ps(), v;
+    float sums[2][8];
+
+    for (i = 0; i < n; i += 8) {
+      v = _mm256_loadu_ps(x + i);
+      acc_re = _mm256_add_ps(acc_re, _mm256_mul_ps(v, _mm256_loadu_ps(cos_taps + i)));
+      acc_im = _mm256_add_ps(acc_im, _mm256_mul_ps(v, _mm256_loadu_ps(sin_taps + i)));
+    }
+
+    _mm256_storeu_ps(sums[0], acc_re);
+    _mm256_storeu_ps(sums[1], acc_im);
+
+    *re = sums[0][0] + sums[0][1] + sums[0][2] + sums[0][3] + sums[0][4] + sums[0][5] + sums[0][6] + sums[0][7];
+    *im = sums[1][0] + sums[1][1] + sums[1][2] + sums[1][3] + sums[1][4] + sums[1][5] + sums[1][6] + sums[1][7];
+  #elif defined(__SSE__)
+    __m128 acc_re = _mm_setzero_ps(), acc_im = _mm_setzero_ps(), v;
+    float sums[2][4];
+
+    for (i = 0; i < n; i += 4) {
+      v = _mm_loadu_ps(x + i);
+      acc_re = _mm_add_ps(acc_re, _mm_mul_ps(v, _mm_loadu_ps(cos_taps + i)));
+      acc_im = _mm_add_ps(acc_im, _mm_mul_ps(v, _mm_loadu_ps(sin_taps + i)));
+    }
+
+    _mm_storeu_ps(sums[0], acc_re);
+    _mm_storeu_ps(sums[1], acc_im);
+
+    *re = sums[0][0] + sums[0][1] + sums[0][2] + sums[0][3];
+    *im = sums[1][0] + sums[1][1] + sums[1][2] + sums[1][3];
+  #elif defined(__ARM_NEON)
+    float32x4_t acc_re = vdupq_n_f32(0), acc_im = vdupq_n_f32(0), v;
+
+    for (i = 0; i < n; i += 4) {
+      v = vld1q_f32(x + i);
+      acc_re = vmlaq_f32(acc_re, v, vld1q_f32(cos_taps + i));
+      acc_im = vmlaq_f32(acc_im, v, vld1q_f32(sin_taps + i));
+    }
+
+    *re = vgetq_lane_f32(acc_re, 0) + vgetq_lane_f32(acc_re, 1) +
+      vgetq_lane_f32(acc_re, 2) + vgetq_lane_f32(acc_re, 3);
+    *im = vgetq_lane_f32(acc_im, 0) + vgetq_lane_f32(acc_im, 1) +
+      vgetq_lane_f32(acc_im, 2) + vgetq_lane_f32(acc_im, 3);
+  #else
+    float acc_re[4] = { 0 }, acc_im[4] = { 0 };
+    int j;
+
+    for (i = 0; i < n; i += 4)
+      for (j = 0; j < 4; j++) {
+        acc_re[j] += x[i + j] * cos_taps[i + j];
+        acc_im[j] += x[i + j] * sin_taps[i + j];
+      }
+
+    *re = acc_re[0] + acc_re[1] + acc_re[2] + acc_re[3];
+    *im = acc_im[0] + acc_im[1] + acc_im[2] + acc_im[3];
+  #endif
+
+  return;
+}
+
+/* --------------------------------------------------------------------- */
+
+/* Retourne l'index du block dont syndrome est l'offset, sinon -1. */
+static int __get_offset_index (uint16_t syndrome) {
+  switch (syndrome) {
+    case RDS_DEMOD_OFFSET_A:
+      return BLOCK_A;
+    case RDS_DEMOD_OFFSET_B:
+      return BLOCK_B;
+    case RDS_DEMOD_OFFSET_C:
+    case RDS_DEMOD_OFFSET_C2:
+      return BLOCK_C;
+    case RDS_DEMOD_OFFSET_D:
+      return BLOCK_D;
+  }
+
+  return -1;
+}
+
+/* Range un block dans le groupe en cours, qui est donné à handler une
+   fois complet. */
+static void __store_block (Rds_demod *demod, int index, uint16_t data, uint8_t bler,
+                           Rds_demod_handler handler, void *user_value) {
+  demod->blocks[index] = data;
+  demod->bler[index] = bler;
+  demod->group_mask = index == BLOCK_A ? 1 : demod->group_mask | 1 << index;
+
+  if (index == BLOCK_D && demod->group_mask == 0xF) {
+    demod->stats.groups++;
+    handler(demod->blocks, demod->bler, user_value);
+  }
+
+  demod->block = (index + 1) % RDS_BLOCKS_N;
+
+  return;
+}
+
+/* Cherche 2 offsets à une distance cohérente dans le flux de bits. */
+static void __search_sync (Rds_demod *demod, Rds_demod_handler handler, void *user_value) {
+  int index = __get_offset_index(__syndrome(demod->reg));
+  unsigned long distance;
+  Candidate *candidate;
+  int i;
+
+  if (index == -1 || demod->n_bits < BLOCK_BITS)
+    return;
+
+  for (i = 0; i < SYNC_CANDIDATES; i++) {
+    candidate = &demod->candidates[i];
+    distance = demod->n_bits - candidate->bit;
+
+    if (candidate->index == -1 || distance % BLOCK_BITS != 0 || distance / BLOCK_BITS > SYNC_SPAN ||
+        (candidate->index + distance / BLOCK_BITS) % RDS_BLOCKS_N != (unsigned long)index)
+      continue;
+
+    demod->synced = 1;
+    demod->stats.syncs++;
+    demod->block_bits = 0;
+    demod->bad_blocks = 0;
+    demod->group_mask = 0;
+
+    __store_block(demod, index, demod->reg >> CHECK_BITS, RDS_BLER_NONE, handler, user_value);
+    return;
+  }
+
+  demod->candidates[demod->next_candidate].bit = demod->n_bits;
+  demod->candidates[demod->next_candidate].index = index;
+  demod->next_candidate = (demod->next_candidate + 1) % SYNC_CANDIDATES;
+
+  return;
+}
+
+/* Vérifie et corrige un block reçu une fois synchronisé. */
+static void __receive_block (Rds_demod *demod, Rds_demod_handler handler, void *user_value) {
+  uint16_t offsets[2];
+  uint16_t syndrome = __syndrome(demod->reg);
+  uint32_t word = demod->reg, error;
+  uint8_t bler = RDS_BLER_UNCORRECTABLE;
+  int n_offsets = 1, i, n;
+
+  switch (demod->block) {
+    case BLOCK_A:
+      *offsets = RDS_DEMOD_OFFSET_A;
+      break;
+    case BLOCK_B:
+      *offsets = RDS_DEMOD_OFFSET_B;
+      break;
+    case BLOCK_C:
+      /* C' d'abord si le block B annonce un groupe version B. */
+      n_offsets = 2;
+      i = (demod->group_mask & 1 << BLOCK_B) && (demod->blocks[BLOCK_B] & GROUP_VERSION_B);
+      offsets[i] = RDS_DEMOD_OFFSET_C;
+      offsets[!i] = RDS_DEMOD_OFFSET_C2;
+      break;
+    default:
+      *offsets = RDS_DEMOD_OFFSET_D;
+  }
+
+  for (i = 0; i < n_offsets && bler != RDS_BLER_NONE; i++)
+    if (syndrome == offsets[i])
+      bler = RDS_BLER_NONE;
+
+  for (i = 0; i < n_offsets && bler == RDS_BLER_UNCORRECTABLE; i++)
+    if ((error = demod->corrections[syndrome ^ offsets[i]]) != 0) {
+      word ^= error;
+
+      for (n = 0; error != 0; error &= error - 1)
+        n++;
+
+      bler = n <= 2 ? RDS_BLER_1_2 : RDS_BLER_3_5;
+    }
+
+  demod->stats.blocks++;
+
+  if (bler == RDS_BLER_UNCORRECTABLE) {
+    demod->stats.uncorrectable_blocks++;
+
+    /* Glissement de bits ou fin du signal: nouvelle recherche. */
+    if (++demod->bad_blocks >= SYNC_LOST) {
+      demod->synced = 0;
+      demod->group_mask = 0;
+
+      for (i = 0; i < SYNC_CANDIDATES; i++)
+        demod->candidates[i].index = -1;
+      return;
+    }
+  } else {
+    demod->bad_blocks = 0;
+
+    if (bler != RDS_BLER_NONE)
+      demod->stats.corrected_blocks++;
+  }
+
+  __store_block(demod, demod->block, word >> CHECK_BITS, bler, handler, user_value);
+
+  return;
+}
+
+static void __receive_bit (Rds_demod *demod, int bit, Rds_demod_handler handler, void *user_value) {
+  /* Décodage différentiel. */
+  demod->reg = ((demod->reg << 1) | (bit ^ demod->prev_bit)) & BLOCK_MASK;
+  demod->prev_bit = bit;
+  demod->n_bits++;
+  demod->stats.bits++;
+
+  if (!demod->synced)
+    __search_sync(demod, handler, user_value);
+  else if (++demod->block_bits == BLOCK_BITS) {
+    demod->block_bits = 0;
+    __receive_block(demod, handler, user_value);
+  }
+
+  return;
+}
+
+/* Suivi de la dérive de l'horloge juste après un bit: l'intégrateur
+   qui prend le relais n'a pas encore fini le suivant, aucun bit n'est
+   perdu. Un voisin prend le relais dès qu'il est meilleur, les autres
+   seulement s'ils le sont nettement: un intégrateur décalé d'un demi-bit
+   garde l'énergie des bits identiques qui se suivent. */
+static void __follow_clock (Rds_demod *demod) {
+  float best = demod->energies[demod->best];
+  int k, distance;
+
+  for (k = 0; k < CLOCK_PHASES; k++) {
+    distance = (k - demod->best + CLOCK_PHASES) % CLOCK_PHASES;
+
+    if (demod->energies[k] > best * (distance == 1 || distance == CLOCK_PHASES - 1 ?
+                                     CLOCK_HYSTERESIS : CLOCK_JUMP)) {
+      demod->best = k;
+      best = demod->energies[k];
+    }
+  }
+
+  return;
+}
+
+/* Chaque intégrateur somme un bit biphase (+ puis -) à partir de son
+   décalage. Celui de plus forte énergie moyenne donne les bits. */
+static void __recover_bit (Rds_demod *demod, float x, Rds_demod_handler handler, void *user_value) {
+  float phase;
+  int k;
+
+  for (k = 0; k < CLOCK_PHASES; k++) {
+    phase = demod->bit_phase + (float)k / CLOCK_PHASES;
+
+    if (phase >= 1)
+      phase -= 1;
+
+    demod->accs[k] += phase < 0.5f ? x : -x;
+
+    if (phase + demod->bit_inc < 1)
+      continue;
+
+    demod->energies[k] += (fabsf(demod->accs[k]) - demod->energies[k]) * ENERGY_GAIN;
+
+    if (k == demod->best && demod->since_bit >= demod->half_bit) {
+      demod->since_bit = 0;
+      __receive_bit(demod, demod->accs[k] > 0, handler, user_value);
+      __follow_clock(demod);
+    }
+
+    demod->accs[k] = 0;
+  }
+
+  demod->since_bit++;
+
+  if ((demod->bit_phase += demod->bit_inc) >= 1)
+    demod->bit_phase -= 1;
+
+  return;
+}
+
+/* Boucle de Costas sur un échantillon ramené autour de 0 Hz. */
+static void __demodulate (Rds_demod *demod, float i, float q, Rds_demod_handler handler, void *user_value) {
+  float c = cosf(demod->carrier_phase);
+  float s = sinf(demod->carrier_phase);
+  float re = i * c + q * s;
+  float im = q * c - i * s;
+  float err;
+
+  demod->level += (fabsf(re) + fabsf(im) - demod->level) * LEVEL_GAIN;
+
+  if (demod->level <= 0)
+    return;
+
+  err = (re >= 0 ? im : -im) / demod->level;
+
+  if (err > 1)
+    err = 1;
+  else if (err < -1)
+    err = -1;
+
+  demod->carrier_freq += CARRIER_BETA * err;
+  demod->carrier_phase += demod->carrier_freq + CARRIER_ALPHA * err;
+
+  if (demod->carrier_phase > M_PI)
+    demod->carrier_phase -= 2 * M_PI;
+  else if (demod->carrier_phase < -M_PI)
+    demod->carrier_phase += 2 * M_PI;
+
+  __recover_bit(demod, re / demod->level, handler, user_value);
+
+  return;
+}
+
+/* --------------------------------------------------------------------- */
+
+Rds_demod *rds_demod_new (int rate) {
+  Rds_demod *demod;
+  int decimation, n_phases, length, i;
+
+  if (rate <= 2 * RDS_DEMOD_CARRIER || __choose_decimation(rate, &decimation, &n_phases) == -1)
+    return NULL;
+
+  demod = pnew0(Rds_demod);
+
+  demod->decimation = decimation;
+  demod->countdown = decimation;
+  demod->n_phases = n_phases;
+
+  length = (int)(rate * FILTER_DURATION) | 1;
+  demod->n_taps = (length + SIMD_WIDTH - 1) / SIMD_WIDTH * SIMD_WIDTH;
+
+  pmalloc(demod->taps, n_phases * 2 * demod->n_taps * sizeof *demod->taps);
+  pmalloc(demod->buffer, (demod->n_taps - 1 + CHUNK_SIZE) * sizeof *demod->buffer);
+  memset(demod->buffer, 0, (demod->n_taps - 1) * sizeof *demod->buffer);
+
+  __init_taps(demod, rate, length);
+  __init_corrections(demod->corrections);
+
+  demod->bit_inc = RDS_DEMOD_BITRATE * decimation / rate;
+  demod->half_bit = (int)(0.5f / demod->bit_inc);
+
+  for (i = 0; i < SYNC_CANDIDATES; i++)
+    demod->candidates[i].index = -1;
+
+  return demod;
+}
+
+void rds_demod_free (Rds_demod *demod) {
+  free(demod->buffer);
+  free(demod->taps);
+  free(demod);
+
+  return;
+}
+
+void rds_demod_process (Rds_demod *demod, const int16_t *samples, size_t n,
+                        Rds_demod_handler handler, void *user_value) {
+  float *history = demod->buffer + demod->n_taps - 1;
+  const float *taps;
+  float i, q;
+  size_t done, len, k;
+
+  for (done = 0; done < n; done += len) {
+    len = n - done < CHUNK_SIZE ? n - done : CHUNK_SIZE;
+
+    for (k = 0; k < len; k++)
+      history[k] = samples[done + k];
+
+    /* Seule une sortie sur decimation est calculée. */
+    for (k = 0; k < len; k++) {
+      if (--demod->countdown > 0)
+        continue;
+
+      demod->countdown = demod->decimation;
+
+      taps = demod->taps + demod->phase * 2 * demod->n_taps;
+      __dot2(taps, taps + demod->n_taps, demod->buffer + k, demod->n_taps, &i, &q);
+
+      if (++demod->phase == demod->n_phases)
+        demod->phase = 0;
+
+      __demodulate(demod, i, q, handler, user_value);
+    }
+
+    memmove(demod->buffer, demod->buffer + len, (demod->n_taps - 1) * sizeof *demod->buffer);
+  }
+
+  demod->stats.samples += n;
+
+  return;
+}
+
+void rds_demod_get_stats (Rds_demod *demod, Rds_demod_stats *stats) {
+  *stats = demod->stats;
+
+  return;
+}
+
+uint16_t rds_demod_checkword (uint16_t data, uint16_t offset) {
+  return __syndrome((uint32_t)data << CHECK_BITS) ^ offset;
+}
+
+/* --------------------------------------------------------------------- */
+
+static void __decode_group (uint16_t blocks[static RDS_BLOCKS_N], const uint8_t bler[static RDS_BLOCKS_N],
+                            void *user_value) {
+  rds_decode(user_value, blocks, bler);
+
+  return;
+}
+
+void rds_demod_utils (const char *filename, int rate) {
+  const int16_t *samples;
+  struct stat st;
+  Rds_demod *demod;
+  Rds_demod_stats stats;
+  Rds *rds;
+  Time start, end;
+  long elapsed;
+  size_t n;
+  int fd;
+
+  if ((demod = rds_demod_new(rate)) == NULL)
+    fatal_error("Unsupported MPX sample rate: %d Hz.", rate);
+
+  if ((fd = open(filename, O_RDONLY)) == -1)
+    fatal_error("Unable to open the MPX file: %s.", filename);
+
+  if (fstat(fd, &st) == -1 || st.st_size < (off_t)sizeof *samples)
+    fatal_error("Invalid MPX file: %s.", filename);
+
+  if ((samples = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED)
+    fatal_error("Unable to map the MPX file: %s.", filename);
+
+  close(fd);
+
+  /* Lecture unique et dans l'ordre: lecture anticipée agressive. Les
+     échantillons sont utilisés tels quels: machine little-endian. */
+  posix_madvise((void *)samples, st.st_size, POSIX_MADV_SEQUENTIAL);
+
+  n = st.st_size / sizeof *samples;
+  rds = rds_new();
+
+  time_get_cur(&start);
+  rds_demod_process(demod, samples, n, __decode_group, rds);
+  time_get_cur(&end);
+
+  elapsed = time_diff_u(&start, &end);
+  rds_demod_get_stats(demod, &stats);
+
+  printf("MPX: %zu samples (%.1f s at %d Hz) demodulated in %ld us.\n", n, (double)n / rate, rate, elapsed);
+  printf("MPX: %.0f samples/s on 1 core, %.1fx real time.\n",
+         n * 1e6 / (elapsed > 0 ? elapsed : 1), (double)n / rate * 1e6 / (elapsed > 0 ? elapsed : 1));
+  printf("MPX: %lu bits, %lu syncs, %lu blocks (%lu corrected, %lu uncorrectable), %lu groups.\n",
+         stats.bits, stats.syncs, stats.blocks, stats.corrected_blocks, stats.uncorrectable_blocks, stats.groups);
+  printf("MPX: PI=%04X, name='%s', text='%s'\n", rds_get_pi(rds), rds_get_radio_name(rds),
+         rds_get_radio_text(rds));
+
+  rds_free(rds);
+  munmap((void *)samples, st.st_size);
+  rds_demod_free(demod);
+
+  return;
+}
@@ -0,0 +1,82 @@
+/*
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _RDS_DEMOD_H_
+#define _RDS_DEMOD_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "rds.h"
+
+/* Fréquence d'échantillonnage par défaut d'un signal MPX, celle de
+   "rtl_fm -M fm -s 171k". */
+#define RDS_DEMOD_DEFAULT_RATE 171000
+
+/* Sous-porteuse RDS et débit en Hz. */
+#define RDS_DEMOD_CARRIER 57000
+#define RDS_DEMOD_BITRATE 1187.5
+
+/* Mots d'offset de chaque block, C' remplace C dans les groupes version B.
+   Documentation: "doc/RDS_Basics.pdf". */
+#define RDS_DEMOD_OFFSET_A 0x0FC
+#define RDS_DEMOD_OFFSET_B 0x198
+#define RDS_DEMOD_OFFSET_C 0x168
+#define RDS_DEMOD_OFFSET_C2 0x350
+#define RDS_DEMOD_OFFSET_D 0x1B4
+
+typedef struct Rds_demod Rds_demod;
+
+/* Reçoit chaque groupe démodulé avec les erreurs de ses blocks. */
+typedef void (*Rds_demod_handler)(uint16_t blocks[static RDS_BLOCKS_N],
+                                  const uint8_t bler[static RDS_BLOCKS_N], void *user_value);
+
+typedef struct Rds_demod_stats {
+  unsigned long samples;
+  unsigned long bits;
+  unsigned long syncs; /* Synchronisations sur les blocks. */
+  unsigned long blocks; /* Blocks reçus une fois synchronisé. */
+  unsigned long corrected_blocks;
+  unsigned long uncorrectable_blocks;
+  unsigned long groups;
+} Rds_demod_stats;
+
+/* Crée un démodulateur pour un signal MPX échantillonné à rate Hz.
+   Retourne NULL si rate n'est pas supporté, sinon le démodulateur. */
+Rds_demod *rds_demod_new (int rate);
+
+/* Libère un démodulateur. */
+void rds_demod_free (Rds_demod *demod);
+
+/* Démodule n échantillons signés de 16 bits. handler est appelé pour
+   chaque groupe complet, dont les blocks peuvent être donnés tels quels
+   à rds_decode. Les échantillons suivants peuvent être donnés par un
+   autre appel. */
+void rds_demod_process (Rds_demod *demod, const int16_t *samples, size_t n,
+                        Rds_demod_handler handler, void *user_value);
+
+/* Donne les compteurs d'un démodulateur. */
+void rds_demod_get_stats (Rds_demod *demod, Rds_demod_stats *stats);
+
+/* Retourne le checkword d'un block: CRC des données et mot d'offset. */
+uint16_t rds_demod_checkword (uint16_t data, uint16_t offset);
+
+/* Projette en mémoire un fichier MPX (échantillons signés de 16 bits
+   little-endian, mono) et le décode aussi vite que possible. Affiche
+   le débit en échantillons par seconde sur un processeur, les compteurs
+   du démodulateur et les données RDS décodées. */
+void rds_demod_utils (const char *filename, int rate);
+
+#endif /* _RDS_DEMOD_H_ INCLUDED */
@@ -0,0 +1,340 @@
+/*
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "utils/alloc.h"
+#include "utils/error.h"
+#include "utils/ptime.h"
+#include "utils/socket.h" /* serialize/deserialize. */
+
+#include "rds_log.h"
+
+/* Format du fichier, entiers en big-endian:
+   MAGIC(4 bytes) VERSION(1) RESERVED(3) START_SEC(4) START_USEC(4)
+   puis par groupe: TIME(4, ms depuis START) TUNER(1) BLER(1) CHANNEL(2)
+   BLOCKS(4 x 2). BLER contient les erreurs des blocks A à D sur 2 bits,
+   block A en poids fort. */
+#define MAGIC "FMRL"
+#define MAGIC_SIZE 4
+#define VERSION 1
+
+#define HEADER_SIZE 16
+#define RECORD_SIZE 16
+
+/* Un tuner est identifié par 1 byte. */
+#define TUNERS_MAX 256
+
+/* Groupes consécutifs d'un tuner sur un channel décodés en un lot. */
+#define REPLAY_BATCH_SIZE 1024
+
+struct Rds_log {
+  FILE *file;
+  Time start; /* Début de la capture. */
+};
+
+/* Un groupe du log. */
+typedef struct Record {
+  uint32_t time;
+  uint8_t tuner;
+  uint16_t channel;
+  uint16_t blocks[RDS_BLOCKS_N];
+  uint8_t bler[RDS_BLOCKS_N];
+} Record;
+
+/* --------------------------------------------------------------------- */
+
+static void __serialize_header (char *buf, const Time *start) {
+  memcpy(buf, MAGIC, MAGIC_SIZE);
+  buf = serialize_uint8(buf + MAGIC_SIZE, VERSION);
+  memset(buf, 0, 3);
+  buf = serialize_uint32(buf + 3, start->tv_sec);
+  serialize_uint32(buf, start->tv_usec);
+
+  return;
+}
+
+/* Retourne -1 si l'en-tête est invalide, sinon 0. */
+static int __deserialize_header (char *buf, Time *start) {
+  uint8_t version;
+  uint32_t sec, usec;
+
+  if (memcmp(buf, MAGIC, MAGIC_SIZE))
+    return -1;
+
+  buf = deserialize_uint8(buf + MAGIC_SIZE, &version);
+  buf = deserialize_uint32(buf + 3, &sec);
+  deserialize_uint32(buf, &usec);
+
+  if (version != VERSION)
+    return -1;
+
+  start->tv_sec = sec;
+  start->tv_usec = usec;
+
+  return 0;
+}
+
+static void __serialize_record (char *buf, const Record *record) {
+  int i;
+
+  buf = serialize_uint32(buf, record->time);
+  buf = serialize_uint8(buf, record->tuner);
+  buf = serialize_uint8(buf, (record->bler[0] << 6) | (record->bler[1] << 4) |
+                        (record->bler[2] << 2) | record->bler[3]);
+  buf = serialize_uint16(buf, record->channel);
+
+  for (i = 0; i < RDS_BLOCKS_N; i++)
+    buf = serialize_uint16(buf, record->blocks[i]);
+
+  return;
+}
+
+static void __deserialize_record (char *buf, Record *record) {
+  uint8_t bler;
+  int i;
+
+  buf = deserialize_uint32(buf, &record->time);
+  buf = deserialize_uint8(buf, &record->tuner);
+  buf = deserialize_uint8(buf, &bler);
+  buf = deserialize_uint16(buf, &record->channel);
+
+  for (i = 0; i < RDS_BLOCKS_N; i++) {
+    buf = deserialize_uint16(buf, &record->blocks[i]);
+    record->bler[i] = (bler >> (6 - i * 2)) & 0x03;
+  }
+
+  return;
+}
+
+/* --------------------------------------------------------------------- */
+
+Rds_log *rds_log_open (const char *filename) {
+  char header[HEADER_SIZE];
+  Rds_log *rds_log;
+  FILE *file;
+  Time start;
+  long size, partial;
+
+  /* Ecritures toujours en fin de fichier. */
+  if ((file = fopen(filename, "ab+")) == NULL) {
+    error("Unable to open the RDS log: %s.", filename);
+    return NULL;
+  }
+
+  if (fseek(file, 0, SEEK_END) == -1 || (size = ftell(file)) == -1)
+    goto err;
+
+  if (size == 0) {
+    time_get_cur(&start);
+    __serialize_header(header, &start);
+
+    if (fwrite(header, 1, HEADER_SIZE, file) != HEADER_SIZE || fflush(file) == EOF)
+      goto err;
+  } else {
+    rewind(file);
+
+    if (size < HEADER_SIZE || fread(header, 1, HEADER_SIZE, file) != HEADER_SIZE ||
+        __deserialize_header(header, &start) == -1) {
+      error("Invalid RDS log: %s.", filename);
+      fclose(file);
+      return NULL;
+    }
+
+    /* Dernier groupe incomplet: arrêt brutal pendant une écriture. */
+    if ((partial = (size - HEADER_SIZE) % RECORD_SIZE) != 0 &&
+        ftruncate(fileno(file), size - partial) == -1)
+      goto err;
+
+    if (fseek(file, 0, SEEK_END) == -1)
+      goto err;
+  }
+
+  rds_log = pnew0(Rds_log);
+  rds_log->file = file;
+  rds_log->start = start;
+
+  return rds_log;
+
+ err:
+  error("Unable to prepare the RDS log: %s.", filename);
+  fclose(file);
+  return NULL;
+}
+
+void rds_log_close (Rds_log *rds_log) {
+  if (rds_log == NULL)
+    return;
+
+  if (fclose(rds_log->file) == EOF)
+    error("Unable to write the RDS log.");
+
+  free(rds_log);
+
+  return;
+}
+
+void rds_log_write (Rds_log *rds_log, int tuner, int channel,
+                    const uint16_t blocks[static RDS_BLOCKS_N], const uint8_t bler[static RDS_BLOCKS_N]) {
+  char buf[RECORD_SIZE];
+  Record record;
+  Time cur;
+
+  time_get_cur(&cur);
+
+  record.time = time_diff(&rds_log->start, &cur);
+  record.tuner = tuner;
+  record.channel = channel;
+  memcpy(record.blocks, blocks, sizeof record.blocks);
+  memcpy(record.bler, bler, sizeof record.bler);
+
+  __serialize_record(buf, &record);
+
+  /* Une erreur est signalée par rds_log_flush. */
+  fwrite(buf, 1, RECORD_SIZE, rds_log->file);
+
+  return;
+}
+
+int rds_log_flush (Rds_log *rds_log) {
+  if (fflush(rds_log->file) == EOF)
+    return error("Unable to write the RDS log.");
+
+  return 0;
+}
+
+/* --------------------------------------------------------------------- */
+
+static void __print_tuner (int tuner, int channel, Rds *rds) {
+  Rds_stats stats;
+  unsigned long groups = 0;
+  int i;
+
+  rds_get_stats(rds, &stats);
+
+  for (i = 0; i < RDS_GROUP_TYPES_N; i++)
+    groups += stats.groups[i];
+
+  printf("Tuner %d: channel=%d, PI=%04X, name='%s', text='%s'\n", tuner, channel,
+         rds_get_pi(rds), rds_get_radio_name(rds), rds_get_radio_text(rds));
+  printf("Tuner %d: %lu groups, %lu unknown, %lu rejected groups, %lu rejected blocks, "
+         "%lu updates (%lu without confirmation).\n", tuner, groups, stats.unknown,
+         stats.rejected_groups, stats.rejected_blocks, stats.updates, stats.unconfirmed_updates);
+
+  return;
+}
+
+/* Décode un lot de groupes d'un tuner. */
+static void __replay_batch (Rds **rds, int *channels, int tuner, int channel, uint16_t (*groups)[RDS_BLOCKS_N],
+                            const uint8_t (*bler)[RDS_BLOCKS_N], size_t n) {
+  if (rds[tuner] == NULL) {
+    rds[tuner] = rds_new();
+    rds_set_compare(rds[tuner], 1);
+  }
+
+  /* Comme le serveur: les données sont oubliées à chaque changement de channel. */
+  if (channel != channels[tuner]) {
+    rds_set_station(rds[tuner], 0, RDS_PT_NONE, "", "");
+    rds_set_channel(rds[tuner], channel);
+    channels[tuner] = channel;
+  }
+
+  rds_decode_batch(rds[tuner], groups, bler, n, NULL, NULL);
+
+  return;
+}
+
+void rds_log_replay_utils (const char *filename) {
+  static Rds *rds[TUNERS_MAX];
+  static int channels[TUNERS_MAX];
+  static uint16_t groups[REPLAY_BATCH_SIZE][RDS_BLOCKS_N];
+  static uint8_t bler[REPLAY_BATCH_SIZE][RDS_BLOCKS_N];
+  char *data, *p;
+  struct stat st;
+  Record record;
+  Time start, end, created;
+  unsigned long n, i;
+  uint32_t duration = 0;
+  long elapsed;
+  size_t n_groups = 0;
+  int tuner = 0, channel = 0;
+  int fd;
+
+  if ((fd = open(filename, O_RDONLY)) == -1)
+    fatal_error("Unable to open the RDS log: %s.", filename);
+
+  if (fstat(fd, &st) == -1 || st.st_size < HEADER_SIZE)
+    fatal_error("Invalid RDS log: %s.", filename);
+
+  if ((data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED)
+    fatal_error("Unable to map the RDS log: %s.", filename);
+
+  close(fd);
+
+  if (__deserialize_header(data, &created) == -1)
+    fatal_error("Invalid RDS log: %s.", filename);
+
+  /* Lecture unique et dans l'ordre: lecture anticipée agressive. */
+  posix_madvise(data, st.st_size, POSIX_MADV_SEQUENTIAL);
+
+  n = (st.st_size - HEADER_SIZE) / RECORD_SIZE;
+
+  time_get_cur(&start);
+
+  /* Les groupes sont regroupés tant que le tuner et le channel restent
+     les mêmes. */
+  for (i = 0, p = data + HEADER_SIZE; i < n; i++, p += RECORD_SIZE) {
+    __deserialize_record(p, &record);
+
+    if (n_groups > 0 && (record.tuner != tuner || record.channel != channel || n_groups == REPLAY_BATCH_SIZE)) {
+      __replay_batch(rds, channels, tuner, channel, groups, (const uint8_t (*)[RDS_BLOCKS_N])bler, n_groups);
+      n_groups = 0;
+    }
+
+    tuner = record.tuner;
+    channel = record.channel;
+    memcpy(groups[n_groups], record.blocks, sizeof record.blocks);
+    memcpy(bler[n_groups++], record.bler, sizeof record.bler);
+    duration = record.time;
+  }
+
+  if (n_groups > 0)
+    __replay_batch(rds, channels, tuner, channel, groups, (const uint8_t (*)[RDS_BLOCKS_N])bler, n_groups);
+
+  time_get_cur(&end);
+  elapsed = time_diff_u(&start, &end);
+
+  printf("RDS replay: %lu groups over %u ms of capture decoded in %ld us.\n", n, duration, elapsed);
+
+  if (n > 0)
+    printf("RDS replay: %.0f groups/s, %.1f ns/group, %.0fx real time.\n",
+           n * 1e6 / (elapsed > 0 ? elapsed : 1), elapsed * 1e3 / n,
+           duration * 1e3 / (elapsed > 0 ? elapsed : 1));
+
+  for (i = 0; i < TUNERS_MAX; i++)
+    if (rds[i] != NULL) {
+      __print_tuner(i, channels[i], rds[i]);
+      rds_free(rds[i]);
+    }
+
+  munmap(data, st.st_size);
+
+  return;
+}
@@ -0,0 +1,48 @@
+/*
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _RDS_LOG_H_
+#define _RDS_LOG_H_
+
+#include <stdint.h>
+
+#include "rds.h"
+
+typedef struct Rds_log Rds_log;
+
+/* Ouvre un log de capture RDS. Les groupes sont ajoutés à la fin d'un
+   log existant, un dernier groupe à moitié écrit est supprimé.
+   Retourne NULL en cas d'échec, sinon le log. */
+Rds_log *rds_log_open (const char *filename);
+
+/* Ferme un log. Les groupes en attente sont écrits. */
+void rds_log_close (Rds_log *rds_log);
+
+/* Ajoute un groupe reçu par un tuner sur un channel, avec les erreurs
+   de ses blocks. L'écriture est différée jusqu'au prochain rds_log_flush. */
+void rds_log_write (Rds_log *rds_log, int tuner, int channel,
+                    const uint16_t blocks[static RDS_BLOCKS_N], const uint8_t bler[static RDS_BLOCKS_N]);
+
+/* Ecrit les groupes en attente.
+   Retourne -1 en cas d'échec, sinon 0. */
+int rds_log_flush (Rds_log *rds_log);
+
+/* Projette un log en mémoire et le décode aussi vite que possible,
+   un décodeur par tuner remis à zéro à chaque changement de channel.
+   Affiche le débit, les dernières données de chaque tuner et leurs
+   statistiques. */
+void rds_log_replay_utils (const char *filename);
+
+#endif /* _RDS_LOG_H_ INCLUDED */
@@ -0,0 +1,208 @@
+/*
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "utils/error.h"
+#include "utils/ptime.h"
+
+#include "scan.h"
+
+/* RSSI moyen min d'une station en dBuV (seuil de seek par défaut du tuner). */
+#define RSSI_MIN 20
+
+/* Echantillons RSSI/ST d'un channel: un channel faible est abandonné dès
+   le premier, un channel dont la moyenne reste faible après SAMPLES_MIN,
+   les autres sont mesurés SAMPLES_MAX fois. */
+#define SAMPLES_MIN 3
+#define SAMPLES_MAX 10
+#define SAMPLE_DELAY 1
+
+/* Ecoute du RDS en ms: abandon si aucun groupe n'est reçu après
+   RDS_NONE_TIMEOUT, sinon arrêt dès que PI et nom sont connus. Le nom
+   n'est connu qu'après 2 réceptions de chacun de ses segments. */
+#define RDS_TIMEOUT 2500
+#define RDS_NONE_TIMEOUT 300
+#define RDS_DELAY 10
+
+/* --------------------------------------------------------------------- */
+
+/* Mesure le signal du channel réglé.
+   Retourne -1 en cas d'échec, 0 si le channel est trop faible, sinon 1. */
+static int __measure (Fm_tuner *fm_tuner, Station *station) {
+  int rssi, stereo;
+  int sum = 0, n_stereo = 0;
+  int n;
+
+  for (n = 1; n <= SAMPLES_MAX; n++) {
+    if (fm_tuner_get_signal(fm_tuner, &rssi, &stereo) == -1)
+      return -1;
+
+    sum += rssi;
+    n_stereo += stereo;
+
+    if ((n == 1 || n >= SAMPLES_MIN) && sum < RSSI_MIN * n)
+      return 0;
+
+    sleep_m(SAMPLE_DELAY);
+  }
+
+  station->rssi = sum / SAMPLES_MAX;
+  station->stereo = n_stereo * 2 > SAMPLES_MAX;
+
+  return 1;
+}
+
+/* Ecoute le RDS d'une station pour connaître son PI et son nom.
+   Retourne -1 en cas d'échec, sinon 0. */
+static int __listen_rds (Fm_tuner *fm_tuner, Station *station) {
+  uint16_t blocks[RDS_BLOCKS_N];
+  uint8_t bler[RDS_BLOCKS_N];
+  int state, received = 0;
+  int ret = 0;
+  long elapsed;
+  Time start, cur;
+  Rds *rds;
+
+  if (fm_tuner_set_channel(fm_tuner, station->channel) == -1)
+    return -1;
+
+  rds = rds_new();
+  time_get_cur(&start);
+
+  do {
+    if (fm_tuner_read_rds(fm_tuner, blocks, bler, &state) == -1) {
+      ret = -1;
+      break;
+    }
+
+    /* Chaque groupe n'est décodé qu'une fois. */
+    if (state == FM_TUNER_RDS_NEW) {
+      rds_decode(rds, blocks, bler);
+      received = 1;
+    }
+
+    if (rds_get_pi(rds) != 0 && *rds_get_radio_name(rds) != '\0')
+      break;
+
+    sleep_m(RDS_DELAY);
+
+    time_get_cur(&cur);
+    elapsed = time_diff(&start, &cur);
+  } while (elapsed < (received ? RDS_TIMEOUT : RDS_NONE_TIMEOUT));
+
+  station->pi = rds_get_pi(rds);
+  strcpy(station->name, rds_get_radio_name(rds));
+
+  rds_free(rds);
+
+  return ret;
+}
+
+/* Un channel voisin d'une station plus forte n'en reçoit que les
+   restes: seuls les maximums locaux du RSSI sont gardés. */
+static Station_map *__keep_peaks (Station_map *candidates) {
+  Station_map *map = station_map_new();
+  Station *stations = candidates->stations;
+  int i;
+
+  for (i = 0; i < candidates->n; i++) {
+    if (i > 0 && stations[i - 1].channel == stations[i].channel - FM_TUNER_CHANNEL_SPACING &&
+        stations[i - 1].rssi > stations[i].rssi)
+      continue;
+
+    if (i + 1 < candidates->n && stations[i + 1].channel == stations[i].channel + FM_TUNER_CHANNEL_SPACING &&
+        stations[i + 1].rssi > stations[i].rssi)
+      continue;
+
+    station_map_add(map, &stations[i]);
+  }
+
+  station_map_free(candidates);
+
+  return map;
+}
+
+Station_map *scan_band (Fm_tuner *fm_tuner, int rds) {
+  Station_map *map = station_map_new();
+  Station station;
+  int channel, ret, i;
+
+  /* Réglage direct de chaque channel, sans seek matériel. */
+  for (channel = FM_TUNER_CHANNEL_START; channel <= FM_TUNER_CHANNEL_END;
+       channel += FM_TUNER_CHANNEL_SPACING) {
+    if (fm_tuner_set_channel(fm_tuner, channel) == -1 ||
+        (ret = __measure(fm_tuner, &station)) == -1)
+      goto err;
+
+    if (ret) {
+      station.channel = channel;
+      station.pi = 0;
+      *station.name = '\0';
+      station_map_add(map, &station);
+    }
+  }
+
+  map = __keep_peaks(map);
+
+  if (rds)
+    for (i = 0; i < map->n; i++)
+      if (__listen_rds(fm_tuner, &map->stations[i]) == -1)
+        goto err;
+
+  return map;
+
+ err:
+  station_map_free(map);
+  return NULL;
+}
+
+/* --------------------------------------------------------------------- */
+
+void scan_utils (Fm_tuner *fm_tuner, int rds, const char *filename) {
+  Station_map *map;
+  Station *station;
+  Time start, end;
+  int i;
+
+  time_get_cur(&start);
+
+  if ((map = scan_band(fm_tuner, rds)) == NULL)
+    fatal_error("Unable to scan the band.");
+
+  time_get_cur(&end);
+
+  for (i = 0; i < map->n; i++) {
+    station = &map->stations[i];
+    printf("Channel=%d, RSSI=%d%%, %s", station->channel,
+           station->rssi * 100 / FM_TUNER_RSSI_MAX, station->stereo ? "stereo" : "mono");
+
+    if (station->pi != 0)
+      printf(", PI=%04X, name='%s'", station->pi, station->name);
+
+    printf("\n");
+  }
+
+  printf("Scan: %d stations found in %ld ms (%d channels).\n", map->n, time_diff(&start, &end),
+         (FM_TUNER_CHANNEL_END - FM_TUNER_CHANNEL_START) / FM_TUNER_CHANNEL_SPACING + 1);
+
+  if (filename != NULL && station_map_save(map, filename) == -1)
+    fatal_error("Unable to save the station map.");
+
+  station_map_free(map);
+
+  return;
+}
@@ -13,11 +13,20 @@
   along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
-#ifndef _SEEK_H_
-#define _SEEK_H_
+#ifndef _SCAN_H_
+#define _SCAN_H_
 
 #include "fm_tuner.h"
+#include "station_map.h"
 
-void seek_utils (Fm_tuner *fm_tuner);
+/* Parcourt toute la bande channel par channel et retourne les stations
+   trouvées. Si rds est non nul, chaque station est écoutée jusqu'à
+   obtenir son PI et son nom, ou jusqu'à un timeout.
+   Retourne NULL en cas d'échec. */
+Station_map *scan_band (Fm_tuner *fm_tuner, int rds);
 
-#endif /* _SEEK_H_ INCLUDED */
+/* Scanne la bande, affiche les stations trouvées et la durée du scan,
+   puis sauvegarde la carte dans filename s'il n'est pas NULL. */
+void scan_utils (Fm_tuner *fm_tuner, int rds, const char *filename);
+
+#endif /* _SCAN_H_ INCLUDED */
@@ -0,0 +1,201 @@
+/*
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "utils/alloc.h"
+#include "utils/error.h"
+#include "utils/socket.h" /* serialize/deserialize. */
+
+#include "station_map.h"
+
+/* Format du fichier, entiers en big-endian:
+   MAGIC(4 bytes) VERSION(1 byte) N(2 bytes)
+   puis N fois: CHANNEL(2) RSSI(1) FLAGS(1) PI(2) NAME(8). */
+#define MAGIC "FMSM"
+#define MAGIC_SIZE 4
+#define VERSION 1
+
+#define HEADER_SIZE (MAGIC_SIZE + 3)
+#define RECORD_SIZE (6 + RDS_RADIO_NAME_MAX_LENGTH)
+
+#define FLAG_STEREO 0x01
+
+/* Nombre max de stations d'une carte (N sur 2 bytes). */
+#define STATIONS_MAX 0xFFFF
+
+#define PATH_SIZE 256
+
+/* --------------------------------------------------------------------- */
+
+Station_map *station_map_new (void) {
+  return pnew0(Station_map);
+}
+
+void station_map_free (Station_map *map) {
+  if (map != NULL) {
+    free(map->stations);
+    free(map);
+  }
+
+  return;
+}
+
+void station_map_add (Station_map *map, const Station *station) {
+  /* Agrandissement par puissances de 2. */
+  if ((map->n & (map->n - 1)) == 0)
+    prealloc(map->stations, (map->n ? map->n * 2 : 1) * sizeof *map->stations);
+
+  map->stations[map->n++] = *station;
+
+  return;
+}
+
+/* --------------------------------------------------------------------- */
+
+static char *__serialize_station (char *buf, const Station *station) {
+  size_t len = strnlen(station->name, RDS_RADIO_NAME_MAX_LENGTH);
+
+  buf = serialize_uint16(buf, station->channel);
+  buf = serialize_uint8(buf, station->rssi);
+  buf = serialize_uint8(buf, station->stereo ? FLAG_STEREO : 0);
+  buf = serialize_uint16(buf, station->pi);
+
+  /* Nom complété par des 0. */
+  memcpy(buf, station->name, len);
+  memset(buf + len, 0, RDS_RADIO_NAME_MAX_LENGTH - len);
+
+  return buf + RDS_RADIO_NAME_MAX_LENGTH;
+}
+
+static char *__deserialize_station (char *buf, Station *station) {
+  uint8_t rssi, flags;
+  uint16_t channel, pi;
+
+  buf = deserialize_uint16(buf, &channel);
+  buf = deserialize_uint8(buf, &rssi);
+  buf = deserialize_uint8(buf, &flags);
+  buf = deserialize_uint16(buf, &pi);
+
+  station->channel = channel;
+  station->rssi = rssi;
+  station->stereo = !!(flags & FLAG_STEREO);
+  station->pi = pi;
+
+  memcpy(station->name, buf, RDS_RADIO_NAME_MAX_LENGTH);
+  station->name[RDS_RADIO_NAME_MAX_LENGTH] = '\0';
+
+  return buf + RDS_RADIO_NAME_MAX_LENGTH;
+}
+
+int station_map_save (const Station_map *map, const char *filename) {
+  char path[PATH_SIZE];
+  char *buf, *p;
+  size_t size;
+  FILE *file;
+  int i, ret = -1;
+
+  if (map->n > STATIONS_MAX)
+    return error("Too many stations: %d.", map->n);
+
+  if (snprintf(path, PATH_SIZE, "%s.tmp", filename) >= PATH_SIZE)
+    return error("Station map path is too long: %s.", filename);
+
+  size = HEADER_SIZE + map->n * RECORD_SIZE;
+  pmalloc0(buf, size);
+
+  memcpy(buf, MAGIC, MAGIC_SIZE);
+  p = serialize_uint8(buf + MAGIC_SIZE, VERSION);
+  p = serialize_uint16(p, map->n);
+
+  for (i = 0; i < map->n; i++)
+    p = __serialize_station(p, &map->stations[i]);
+
+  /* Ecriture dans un fichier temporaire puis renommage. */
+  if ((file = fopen(path, "wb")) == NULL) {
+    error("Unable to open: %s.", path);
+    goto end;
+  }
+
+  if (fwrite(buf, 1, size, file) != size) {
+    error("Unable to write: %s.", path);
+    fclose(file);
+    goto end;
+  }
+
+  if (fclose(file) == EOF || rename(path, filename) == -1) {
+    error("Unable to save: %s.", filename);
+    goto end;
+  }
+
+  ret = 0;
+
+ end:
+  if (ret == -1)
+    remove(path);
+
+  free(buf);
+  return ret;
+}
+
+Station_map *station_map_load (const char *filename) {
+  char header[HEADER_SIZE];
+  char record[RECORD_SIZE];
+  Station_map *map;
+  Station station;
+  FILE *file;
+  uint8_t version;
+  uint16_t n;
+  int i;
+
+  if ((file = fopen(filename, "rb")) == NULL) {
+    error("Unable to open: %s.", filename);
+    return NULL;
+  }
+
+  if (fread(header, 1, HEADER_SIZE, file) != HEADER_SIZE ||
+      memcmp(header, MAGIC, MAGIC_SIZE)) {
+    error("Invalid station map: %s.", filename);
+    fclose(file);
+    return NULL;
+  }
+
+  deserialize_uint16(deserialize_uint8(header + MAGIC_SIZE, &version), &n);
+
+  if (version != VERSION) {
+    error("Unsupported station map version: %d.", version);
+    fclose(file);
+    return NULL;
+  }
+
+  map = station_map_new();
+
+  for (i = 0; i < n; i++) {
+    if (fread(record, 1, RECORD_SIZE, file) != RECORD_SIZE) {
+      error("Truncated station map: %s.", filename);
+      station_map_free(map);
+      fclose(file);
+      return NULL;
+    }
+
+    __deserialize_station(record, &station);
+    station_map_add(map, &station);
+  }
+
+  fclose(file);
+
+  return map;
+}
@@ -0,0 +1,58 @@
+/*
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _STATION_MAP_H_
+#define _STATION_MAP_H_
+
+#include <stdint.h>
+
+#include "rds.h"
+
+/* Une station trouvée par un scan. */
+typedef struct Station {
+  int channel;
+  int rssi; /* En dBuV. */
+  int stereo;
+
+  /* Données RDS, 0 et "" si inconnues. */
+  uint16_t pi;
+  char name[RDS_RADIO_NAME_MAX_LENGTH + 1];
+} Station;
+
+/* Stations triées par channel croissant. */
+typedef struct Station_map {
+  Station *stations;
+  int n;
+} Station_map;
+
+/* Crée une carte vide. */
+Station_map *station_map_new (void);
+
+/* Libère une carte. */
+void station_map_free (Station_map *map);
+
+/* Ajoute une station en fin de carte. */
+void station_map_add (Station_map *map, const Station *station);
+
+/* Sauvegarde une carte dans un fichier binaire. Le fichier est
+   remplacé en une fois: il n'est jamais lu à moitié écrit.
+   Retourne -1 en cas d'échec, sinon 0. */
+int station_map_save (const Station_map *map, const char *filename);
+
+/* Charge une carte sauvegardée par station_map_save.
+   Retourne NULL en cas d'échec, sinon la carte. */
+Station_map *station_map_load (const char *filename);
+
+#endif /* _STATION_MAP_H_ INCLUDED */
@@ -0,0 +1,292 @@
+/*
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "utils/alloc.h"
+#include "utils/error.h"
+
+#include "store.h"
+
+#define MAGIC "FMDB"
+#define MAGIC_SIZE 4
+#define VERSION 2
+
+/* En-tête d'une copie d'enregistrement. gen vaut 0 pour une copie
+   jamais écrite, sum couvre gen et les données. */
+typedef struct Record {
+  uint32_t gen;
+  uint32_t sum;
+} Record;
+
+typedef struct State_record {
+  Record header;
+  Store_state state;
+} State_record;
+
+typedef struct Station_record {
+  Record header;
+  Store_station station;
+} Station_record;
+
+/* Contenu du fichier. Il n'est lu que par la machine qui l'a écrit:
+   les structures sont projetées telles quelles. */
+typedef struct Store_file {
+  char magic[MAGIC_SIZE];
+  uint32_t version;
+  uint32_t size;
+
+  State_record state[STORE_TUNERS_MAX][2];
+  Station_record stations[STORE_STATIONS_MAX][2];
+} Store_file;
+
+struct Store {
+  int fd;
+  Store_file *file;
+  uint32_t gen; /* Dernière génération écrite. */
+};
+
+/* --------------------------------------------------------------------- */
+
+/* FNV-1a. */
+static uint32_t __checksum (uint32_t gen, const void *data, size_t size) {
+  const unsigned char *p = data;
+  uint32_t sum = 2166136261u ^ gen;
+  size_t i;
+
+  for (i = 0; i < size; i++)
+    sum = (sum ^ p[i]) * 16777619u;
+
+  return sum;
+}
+
+static inline int __is_valid (const Record *header, const void *data, size_t size) {
+  return header->gen != 0 && header->sum == __checksum(header->gen, data, size);
+}
+
+/* Retourne l'index de la copie valide la plus récente, ou -1. */
+#define CURRENT_COPY(RECORDS, FIELD)                                                      \
+  (__current_copy(&(RECORDS)[0].header, &(RECORDS)[0].FIELD,                              \
+                  &(RECORDS)[1].header, &(RECORDS)[1].FIELD, sizeof((RECORDS)[0].FIELD)))
+
+static int __current_copy (const Record *h0, const void *d0, const Record *h1, const void *d1, size_t size) {
+  int valid0 = __is_valid(h0, d0, size);
+  int valid1 = __is_valid(h1, d1, size);
+
+  if (valid0 && valid1)
+    return h0->gen > h1->gen ? 0 : 1;
+
+  return valid0 ? 0 : (valid1 ? 1 : -1);
+}
+
+/* Ecrit data dans la copie qui n'est pas la copie courante. L'en-tête est
+   écrit en dernier: une copie à moitié écrite reste invalide. */
+static void __write_copy (Store *store, Record *header, void *dst, const void *data, size_t size) {
+  long page = sysconf(_SC_PAGESIZE);
+  char *start = (char *)((uintptr_t)header & ~(uintptr_t)(page - 1));
+
+  header->gen = 0;
+  memcpy(dst, data, size);
+  header->sum = __checksum(++store->gen, data, size);
+  header->gen = store->gen;
+
+  if (msync(start, (char *)dst + size - start, MS_ASYNC) == -1)
+    error("Unable to sync the store.");
+
+  return;
+}
+
+#define WRITE_RECORD(STORE, RECORDS, FIELD, DATA) do {                      \
+    int __i = CURRENT_COPY(RECORDS, FIELD) == 0;                              \
+    __write_copy(STORE, &(RECORDS)[__i].header, &(RECORDS)[__i].FIELD,        \
+                 DATA, sizeof((RECORDS)[__i].FIELD));                         \
+  } while (0)
+
+/* --------------------------------------------------------------------- */
+
+static void __update_gen (Store *store, const Record *header) {
+  if (header->gen > store->gen)
+    store->gen = header->gen;
+
+  return;
+}
+
+Store *store_open (const char *filename) {
+  Store *store;
+  Store_file *file;
+  struct stat st;
+  int fd, i;
+
+  if ((fd = open(filename, O_RDWR | O_CREAT, 0644)) == -1) {
+    error("Unable to open the store: %s.", filename);
+    return NULL;
+  }
+
+  if (fstat(fd, &st) == -1 ||
+      (st.st_size != sizeof *file && ftruncate(fd, sizeof *file) == -1)) {
+    error("Unable to resize the store: %s.", filename);
+    close(fd);
+    return NULL;
+  }
+
+  if ((file = mmap(NULL, sizeof *file, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+    error("Unable to map the store: %s.", filename);
+    close(fd);
+    return NULL;
+  }
+
+  /* Store nouveau ou d'un autre format: remis à zéro. */
+  if (memcmp(file->magic, MAGIC, MAGIC_SIZE) || file->version != VERSION ||
+      file->size != sizeof *file) {
+    memset(file, 0, sizeof *file);
+    memcpy(file->magic, MAGIC, MAGIC_SIZE);
+    file->version = VERSION;
+    file->size = sizeof *file;
+  }
+
+  store = pnew0(Store);
+  store->fd = fd;
+  store->file = file;
+
+  /* Les générations écrites ensuite sont plus récentes que toutes
+     celles du fichier. */
+  for (i = 0; i < STORE_TUNERS_MAX; i++) {
+    __update_gen(store, &file->state[i][0].header);
+    __update_gen(store, &file->state[i][1].header);
+  }
+
+  for (i = 0; i < STORE_STATIONS_MAX; i++) {
+    __update_gen(store, &file->stations[i][0].header);
+    __update_gen(store, &file->stations[i][1].header);
+  }
+
+  return store;
+}
+
+void store_close (Store *store) {
+  if (store == NULL)
+    return;
+
+  if (msync(store->file, sizeof *store->file, MS_SYNC) == -1)
+    error("Unable to sync the store.");
+
+  munmap(store->file, sizeof *store->file);
+  close(store->fd);
+  free(store);
+
+  return;
+}
+
+/* --------------------------------------------------------------------- */
+
+int store_get_state (Store *store, int tuner, Store_state *state) {
+  int i = CURRENT_COPY(store->file->state[tuner], state);
+
+  if (i == -1)
+    return -1;
+
+  *state = store->file->state[tuner][i].state;
+
+  return 0;
+}
+
+void store_set_state (Store *store, int tuner, const Store_state *state) {
+  Store_state cur;
+
+  if (store_get_state(store, tuner, &cur) == 0 && !memcmp(&cur, state, sizeof cur))
+    return;
+
+  WRITE_RECORD(store, store->file->state[tuner], state, state);
+
+  return;
+}
+
+/* Copie une station avec des bytes de padding et de fin de chaîne
+   nuls, pour que deux copies identiques aient le même checksum. */
+static void __normalize_station (Store_station *dst, const Store_station *src) {
+  memset(dst, 0, sizeof *dst);
+
+  dst->channel = src->channel;
+  dst->rssi = src->rssi;
+  dst->pty = src->pty;
+  dst->pi = src->pi;
+  memcpy(dst->name, src->name, strnlen(src->name, RDS_RADIO_NAME_MAX_LENGTH));
+  memcpy(dst->text, src->text, strnlen(src->text, RDS_RADIO_TEXT_MAX_LENGTH));
+
+  return;
+}
+
+/* Retourne la copie courante d'une station, ou NULL. */
+static Station_record *__get_station_record (Store *store, int slot) {
+  Station_record *records = store->file->stations[slot];
+  int i = CURRENT_COPY(records, station);
+
+  return i == -1 ? NULL : &records[i];
+}
+
+int store_get_station (Store *store, int channel, Store_station *station) {
+  Station_record *record;
+  int i;
+
+  for (i = 0; i < STORE_STATIONS_MAX; i++)
+    if ((record = __get_station_record(store, i)) != NULL && record->station.channel == channel) {
+      *station = record->station;
+      return 0;
+    }
+
+  return -1;
+}
+
+void store_set_station (Store *store, const Store_station *station) {
+  Store_station normalized;
+  Station_record *record;
+  int i, slot = -1;
+  uint32_t oldest = UINT32_MAX;
+
+  __normalize_station(&normalized, station);
+
+  /* Emplacement de la station, sinon un emplacement libre,
+     sinon la station la plus ancienne. */
+  for (i = 0; i < STORE_STATIONS_MAX; i++) {
+    if ((record = __get_station_record(store, i)) == NULL) {
+      if (oldest != 0) {
+        oldest = 0;
+        slot = i;
+      }
+      continue;
+    }
+
+    if (record->station.channel == station->channel) {
+      if (!memcmp(&record->station, &normalized, sizeof normalized))
+        return;
+
+      slot = i;
+      break;
+    }
+
+    if (record->header.gen < oldest) {
+      oldest = record->header.gen;
+      slot = i;
+    }
+  }
+
+  WRITE_RECORD(store, store->file->stations[slot], station, &normalized);
+
+  return;
+}
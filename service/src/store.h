@@ -0,0 +1,75 @@
+/*
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _STORE_H_
+#define _STORE_H_
+
+#include <stdint.h>
+
+#include "rds.h"
+
+/* Nombre de stations mémorisées, de tuners et de presets par tuner. */
+#define STORE_STATIONS_MAX 64
+#define STORE_TUNERS_MAX 4
+#define STORE_PRESETS_N 10
+
+/* Pas de channel pour un preset. */
+#define STORE_PRESET_NONE 0
+
+typedef struct Store Store;
+
+/* Etat d'un tuner restauré au démarrage. */
+typedef struct Store_state {
+  int channel;
+  int volume;
+  int presets[STORE_PRESETS_N]; /* Channels ou STORE_PRESET_NONE. */
+} Store_state;
+
+/* Dernières données connues d'une station. */
+typedef struct Store_station {
+  int channel;
+  int rssi;
+  int pty;
+  uint16_t pi;
+  char name[RDS_RADIO_NAME_MAX_LENGTH + 1];
+  char text[RDS_RADIO_TEXT_MAX_LENGTH + 1];
+} Store_station;
+
+/* Ouvre ou crée un store projeté en mémoire. Chaque enregistrement
+   existe en 2 copies avec checksum: un arrêt brutal pendant une mise
+   à jour ne perd au plus que cette mise à jour.
+   Retourne NULL en cas d'échec, sinon le store. */
+Store *store_open (const char *filename);
+
+/* Ferme un store. Les données sont écrites sur disque. */
+void store_close (Store *store);
+
+/* Donne l'état mémorisé d'un tuner, dans [ 0, STORE_TUNERS_MAX [.
+   Retourne -1 si aucun état n'est mémorisé, sinon 0. */
+int store_get_state (Store *store, int tuner, Store_state *state);
+
+/* Mémorise l'état d'un tuner. Rien n'est écrit s'il n'a pas changé. */
+void store_set_state (Store *store, int tuner, const Store_state *state);
+
+/* Donne les données d'une station.
+   Retourne -1 si la station est inconnue, sinon 0. */
+int store_get_station (Store *store, int channel, Store_station *station);
+
+/* Mémorise une station. Si le store est plein, la station mise à jour
+   il y a le plus longtemps est remplacée. Rien n'est écrit si les
+   données n'ont pas changé. */
+void store_set_station (Store *store, const Store_station *station);
+
+#endif /* _STORE_H_ INCLUDED */
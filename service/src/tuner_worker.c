@@ -0,0 +1,529 @@
+/*
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#define _GNU_SOURCE /* pthread_attr_setaffinity_np. */
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "utils/alloc.h"
+#include "utils/error.h"
+#include "utils/ptime.h"
+#include "utils/ring.h"
+
+#include "tuner_worker.h"
+
+/* Tailles des files de commandes et de résultats. Les lectures
+   périodiques envoyées pendant une recherche d'AF doivent tenir
+   dans la file des commandes. */
+#define CMDS_SIZE 128
+#define RESULTS_SIZE 256
+
+/* Attente en ms entre 2 avancées d'un tune/seek sans pin GPIO2. */
+#define ASYNC_POLL_DELAY 1
+
+/* Lectures successives du RSSI sous le seuil avant une recherche d'AF,
+   et attente en ms après une recherche sans succès. */
+#define AF_WEAK_READS 3
+#define AF_RETRY_DELAY 10000
+
+/* Acquisition RDS, durées en µs. Le tuner signale un groupe (RDSR)
+   toutes les RDS_GROUP_PERIOD pendant au moins 40 ms. Il est lu toutes
+   les RDS_POLL_DELAY de RDS_EARLY avant à RDS_LATE après chaque groupe
+   attendu. Sans groupe reçu depuis RDS_LOST_GROUPS périodes, il est lu
+   toutes les RDS_SEARCH_DELAY, moins que la durée du signalement. */
+#define RDS_GROUP_PERIOD 87600
+#define RDS_EARLY 4000
+#define RDS_LATE 12000
+#define RDS_POLL_DELAY 2000
+#define RDS_SEARCH_DELAY 20000
+#define RDS_LOST_GROUPS 10
+
+/* Période en ms des compteurs de l'acquisition RDS. */
+#define RDS_STATS_PERIOD 1000
+
+/* Opérations en cours. */
+#define PENDING_NONE 0
+#define PENDING_TUNE 1
+#define PENDING_SEEK 2
+
+struct Tuner_worker {
+  Fm_tuner *fm_tuner;
+  pthread_t thread;
+
+  Ring *cmds;
+  int cmds_fd; /* Réveille le thread à chaque commande. */
+
+  Ring *results;
+  int results_fd; /* Réveille la boucle serveur à chaque résultat. */
+
+  char stop;
+
+  /* Tune/seek asynchrone en cours. */
+  int pending;
+  int prev_channel; /* Channel avant le seek, remis en cas d'échec. */
+
+  /* AF de la station réglée et suivi du signal. */
+  Af_list af;
+  int af_rssi;
+  int weak_reads;
+  Time weak_start;
+  Time af_failure; /* Dernière recherche sans succès. */
+
+  /* Acquisition RDS: dernier groupe lu, ou début de la recherche si
+     rds_synced est nul, et prochaine lecture en µs après rds_last. */
+  Time rds_last;
+  int rds_synced;
+  long rds_next;
+  Tuner_rds_stats rds_stats;
+  Time rds_stats_start;
+};
+
+/* --------------------------------------------------------------------- */
+
+static void __notify (int fd) {
+  uint64_t n = 1;
+
+  if (write(fd, &n, sizeof n) != sizeof n)
+    error("[worker]Unable to notify.");
+
+  return;
+}
+
+static void __publish (Tuner_worker *worker, Tuner_result *result) {
+  if (ring_push(worker->results, result) == -1) {
+    error("[worker]Results queue is full, result %d lost.", result->type);
+    return;
+  }
+
+  __notify(worker->results_fd);
+
+  return;
+}
+
+static void __publish_value (Tuner_worker *worker, int type, int value) {
+  Tuner_result result;
+
+  result.type = type;
+  result.value = value;
+  __publish(worker, &result);
+
+  return;
+}
+
+/* --------------------------------------------------------------------- */
+
+/* Un nouveau channel: les groupes sont cherchés sans connaître leur
+   période. */
+static void __reset_rds (Tuner_worker *worker) {
+  worker->rds_synced = 0;
+  worker->rds_next = 0;
+  time_get_cur(&worker->rds_last);
+
+  return;
+}
+
+/* Lit le tuner si un groupe RDS peut être signalé et publie chaque
+   nouveau groupe. Le nombre de périodes écoulées depuis le précédent
+   donne les groupes manqués. */
+static void __acquire_rds (Tuner_worker *worker) {
+  Tuner_result result;
+  Time cur;
+  long elapsed, phase, groups;
+  int state;
+
+  time_get_cur(&cur);
+  elapsed = time_diff_u(&worker->rds_last, &cur);
+
+  if (worker->pending != PENDING_NONE || elapsed < worker->rds_next)
+    return;
+
+  if (fm_tuner_read_rds(worker->fm_tuner, result.blocks, result.bler, &state) == -1) {
+    error("[worker]Read RDS failed.");
+    state = FM_TUNER_RDS_NONE;
+  }
+
+  if (state == FM_TUNER_RDS_NEW) {
+    groups = (elapsed + RDS_GROUP_PERIOD / 2) / RDS_GROUP_PERIOD;
+
+    if (worker->rds_synced && groups > 1)
+      worker->rds_stats.missed += groups - 1;
+
+    worker->rds_stats.received++;
+    result.type = TUNER_RESULT_RDS;
+    __publish(worker, &result);
+
+    worker->rds_last = cur;
+    worker->rds_synced = 1;
+    worker->rds_next = RDS_GROUP_PERIOD - RDS_EARLY;
+    return;
+  }
+
+  if (state == FM_TUNER_RDS_ALREADY_READ)
+    worker->rds_stats.duplicated++;
+
+  /* Aucun groupe reçu ou signal RDS perdu: recherche. */
+  if (!worker->rds_synced || elapsed > RDS_LOST_GROUPS * RDS_GROUP_PERIOD) {
+    worker->rds_synced = 0;
+    worker->rds_last = cur;
+    worker->rds_next = RDS_SEARCH_DELAY;
+    return;
+  }
+
+  /* Autour d'un groupe attendu, sinon jusqu'au suivant. */
+  phase = elapsed % RDS_GROUP_PERIOD;
+
+  if (phase >= RDS_GROUP_PERIOD - RDS_EARLY || phase <= RDS_LATE)
+    worker->rds_next = elapsed + RDS_POLL_DELAY;
+  else
+    worker->rds_next = (elapsed / RDS_GROUP_PERIOD + 1) * RDS_GROUP_PERIOD - RDS_EARLY;
+
+  return;
+}
+
+static void __publish_rds_stats (Tuner_worker *worker) {
+  Tuner_result result;
+  Time cur;
+
+  time_get_cur(&cur);
+
+  if (time_diff(&worker->rds_stats_start, &cur) < RDS_STATS_PERIOD)
+    return;
+
+  result.type = TUNER_RESULT_RDS_STATS;
+  result.rds_stats = worker->rds_stats;
+  __publish(worker, &result);
+
+  memset(&worker->rds_stats, 0, sizeof worker->rds_stats);
+  worker->rds_stats_start = cur;
+
+  return;
+}
+
+/* --------------------------------------------------------------------- */
+
+static void __start_channel (Tuner_worker *worker, int channel) {
+  if (fm_tuner_tune_start(worker->fm_tuner, channel) == -1) {
+    error("[worker]Set channel failed.");
+    worker->pending = PENDING_NONE;
+    return;
+  }
+
+  worker->pending = PENDING_TUNE;
+
+  return;
+}
+
+static void __start_seek (Tuner_worker *worker, int direction) {
+  /* Channel à remettre si le seek échoue. */
+  if (worker->pending == PENDING_NONE)
+    worker->prev_channel = fm_tuner_get_channel(worker->fm_tuner);
+
+  if (fm_tuner_seek_start(worker->fm_tuner, direction) == -1) {
+    error("[worker]Seek failed.");
+    __start_channel(worker, worker->prev_channel);
+    return;
+  }
+
+  worker->pending = PENDING_SEEK;
+
+  return;
+}
+
+/* Fait avancer le tune/seek en cours et publie le nouveau channel
+   une fois l'opération terminée. */
+static void __advance (Tuner_worker *worker) {
+  int channel, success, ret;
+
+  if (worker->pending == PENDING_NONE ||
+      (ret = fm_tuner_async_poll(worker->fm_tuner, &channel, &success)) == FM_TUNER_ASYNC_PENDING)
+    return;
+
+  if (ret != FM_TUNER_ASYNC_IDLE) {
+    if (worker->pending == PENDING_SEEK && (ret == -1 || !success)) {
+      error("[worker]Seek failed.");
+      __start_channel(worker, worker->prev_channel);
+      return;
+    }
+
+    if (ret == -1)
+      error("[worker]Set channel failed.");
+    else
+      __publish_value(worker, TUNER_RESULT_CHANNEL, channel);
+  }
+
+  worker->pending = PENDING_NONE;
+  __reset_rds(worker);
+
+  return;
+}
+
+/* Cherche une AF lorsque le signal reste faible. */
+static void __check_af (Tuner_worker *worker, int rssi) {
+  Tuner_result result;
+  Af_result af_result;
+  Time cur;
+  int ret;
+
+  if (worker->af_rssi == 0 || rssi >= worker->af_rssi) {
+    worker->weak_reads = 0;
+    return;
+  }
+
+  if (worker->weak_reads++ == 0)
+    time_get_cur(&worker->weak_start);
+
+  if (worker->weak_reads < AF_WEAK_READS || worker->pending != PENDING_NONE || worker->af.n == 0)
+    return;
+
+  time_get_cur(&cur);
+
+  if (time_diff(&worker->af_failure, &cur) < AF_RETRY_DELAY)
+    return;
+
+  if ((ret = af_follow(worker->fm_tuner, &worker->af, &af_result)) == -1)
+    error("[worker]AF search failed.");
+
+  __reset_rds(worker);
+  time_get_cur(&cur);
+
+  if (ret != 1)
+    worker->af_failure = cur;
+
+  worker->weak_reads = 0;
+
+  if (ret != -1) {
+    result.type = TUNER_RESULT_AF;
+    result.value = af_result.channel;
+    result.mute_time = af_result.mute_time;
+    result.weak_time = time_diff(&worker->weak_start, &cur);
+    __publish(worker, &result);
+  }
+
+  return;
+}
+
+static void __execute (Tuner_worker *worker, Tuner_cmd *cmd) {
+  int value;
+
+  switch (cmd->type) {
+    case TUNER_CMD_VOLUME:
+      if ((value = fm_tuner_set_volume(worker->fm_tuner, cmd->value)) == -1)
+        error("[worker]Set volume failed.");
+      else
+        __publish_value(worker, TUNER_RESULT_VOLUME, value);
+      break;
+
+    /* Un nouveau channel annule un seek en cours. Les AF de la
+       station précédente sont oubliées. */
+    case TUNER_CMD_CHANNEL:
+      worker->af.n = 0;
+      __start_channel(worker, cmd->value);
+      break;
+
+    case TUNER_CMD_SEEK:
+      worker->af.n = 0;
+      __start_seek(worker, cmd->value);
+      break;
+
+    case TUNER_CMD_READ_RSSI:
+      if ((value = fm_tuner_get_rssi(worker->fm_tuner)) != -1) {
+        __publish_value(worker, TUNER_RESULT_RSSI, value);
+        __check_af(worker, value);
+      }
+      break;
+
+    case TUNER_CMD_AF_LIST:
+      worker->af.pi = cmd->value;
+      worker->af.n = 0;
+      break;
+
+    case TUNER_CMD_AF_ADD:
+      if (worker->af.n < RDS_AF_MAX)
+        worker->af.channels[worker->af.n++] = cmd->value;
+      break;
+  }
+
+  return;
+}
+
+/* Attend une commande. Si une opération est en cours, attend aussi le
+   front GPIO2 qui signale sa fin, ou au plus ASYNC_POLL_DELAY ms sans
+   pin GPIO2. Sinon attend jusqu'à la prochaine lecture RDS. */
+static void __wait_cmds (Tuner_worker *worker) {
+  struct pollfd pfds[2];
+  nfds_t n_fds = 1;
+  uint64_t n;
+  long timeout;
+  Time cur;
+  int ret;
+
+  pfds[0].fd = worker->cmds_fd;
+  pfds[0].events = POLLIN;
+  pfds[0].revents = 0;
+
+  if (worker->pending == PENDING_NONE) {
+    time_get_cur(&cur);
+    timeout = worker->rds_next - time_diff_u(&worker->rds_last, &cur);
+    timeout = timeout <= 0 ? 0 : (timeout + 999) / 1000;
+  }
+  else if ((pfds[1].fd = fm_tuner_get_stc_fd(worker->fm_tuner)) != -1) {
+    pfds[1].events = POLLPRI | POLLERR;
+    pfds[1].revents = 0;
+    n_fds = 2;
+    timeout = FM_TUNER_GPIO2_TIMEOUT;
+  }
+  else
+    timeout = ASYNC_POLL_DELAY;
+
+  if ((ret = poll(pfds, n_fds, timeout)) == -1)
+    return;
+
+  if (n_fds == 2 && (ret == 0 || pfds[1].revents != 0))
+    fm_tuner_ack_stc(worker->fm_tuner, ret != 0);
+
+  if ((pfds[0].revents & POLLIN) &&
+      read(worker->cmds_fd, &n, sizeof n) != sizeof n)
+    error("[worker]Unable to read commands notification.");
+
+  return;
+}
+
+static void *__run (void *arg) {
+  Tuner_worker *worker = arg;
+  Tuner_cmd cmd;
+
+  while (!__atomic_load_n(&worker->stop, __ATOMIC_ACQUIRE)) {
+    while (ring_pop(worker->cmds, &cmd) != -1)
+      __execute(worker, &cmd);
+
+    __advance(worker);
+    __acquire_rds(worker);
+    __publish_rds_stats(worker);
+    __wait_cmds(worker);
+  }
+
+  return NULL;
+}
+
+/* --------------------------------------------------------------------- */
+
+Tuner_worker *tuner_worker_new (Fm_tuner *fm_tuner, int cpu, int af_rssi) {
+  Tuner_worker *worker = pnew0(Tuner_worker);
+  sigset_t set, old_set;
+  pthread_attr_t attr;
+  cpu_set_t cpus;
+
+  worker->fm_tuner = fm_tuner;
+  worker->af_rssi = af_rssi;
+  __reset_rds(worker);
+  worker->rds_stats_start = worker->rds_last;
+
+  if ((worker->cmds = ring_new(sizeof(Tuner_cmd), CMDS_SIZE)) == NULL ||
+      (worker->results = ring_new(sizeof(Tuner_result), RESULTS_SIZE)) == NULL)
+    fatal_error("Unable to create worker queues.");
+
+  if ((worker->cmds_fd = eventfd(0, EFD_NONBLOCK)) == -1 ||
+      (worker->results_fd = eventfd(0, EFD_NONBLOCK)) == -1)
+    fatal_error("Unable to create worker eventfds.");
+
+  pthread_attr_init(&attr);
+
+  /* Un processeur par tuner: les attentes d'un tuner ne retardent pas les autres. */
+  if (cpu >= 0) {
+    CPU_ZERO(&cpus);
+    CPU_SET(cpu, &cpus);
+
+    if (pthread_attr_setaffinity_np(&attr, sizeof cpus, &cpus) != 0)
+      error("[worker]Unable to pin the worker on cpu %d.", cpu);
+  }
+
+  /* Les signaux sont gérés par le serveur, pas par le thread. */
+  sigfillset(&set);
+  pthread_sigmask(SIG_BLOCK, &set, &old_set);
+
+  if (pthread_create(&worker->thread, &attr, __run, worker) != 0)
+    fatal_error("Unable to create tuner worker.");
+
+  pthread_sigmask(SIG_SETMASK, &old_set, NULL);
+  pthread_attr_destroy(&attr);
+
+  return worker;
+}
+
+void tuner_worker_free (Tuner_worker *worker) {
+  if (worker == NULL)
+    return;
+
+  __atomic_store_n(&worker->stop, 1, __ATOMIC_RELEASE);
+  __notify(worker->cmds_fd);
+  pthread_join(worker->thread, NULL);
+
+  /* Une opération en cours ne doit pas rester active sur le tuner.
+     Une fois annulée, seule la descente de STC est attendue. */
+  if (worker->pending != PENDING_NONE) {
+    fm_tuner_async_cancel(worker->fm_tuner);
+
+    while (fm_tuner_async_poll(worker->fm_tuner, NULL, NULL) == FM_TUNER_ASYNC_PENDING)
+      sleep_m(ASYNC_POLL_DELAY);
+  }
+
+  close(worker->cmds_fd);
+  close(worker->results_fd);
+  ring_free(worker->cmds);
+  ring_free(worker->results);
+  free(worker);
+
+  return;
+}
+
+int tuner_worker_send (Tuner_worker *worker, int type, int value) {
+  Tuner_cmd cmd;
+
+  cmd.type = type;
+  cmd.value = value;
+
+  if (ring_push(worker->cmds, &cmd) == -1)
+    return -1;
+
+  __notify(worker->cmds_fd);
+
+  return 0;
+}
+
+int tuner_worker_get_fd (Tuner_worker *worker) {
+  return worker->results_fd;
+}
+
+void tuner_worker_ack (Tuner_worker *worker) {
+  uint64_t n;
+
+  /* Le descripteur n'est pas bloquant: EAGAIN si rien à acquitter. */
+  if (read(worker->results_fd, &n, sizeof n) == -1 && errno != EAGAIN)
+    error("[worker]Unable to read results notification.");
+
+  return;
+}
+
+int tuner_worker_receive (Tuner_worker *worker, Tuner_result *result) {
+  return ring_pop(worker->results, result);
+}
@@ -0,0 +1,96 @@
+/*
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _TUNER_WORKER_H_
+#define _TUNER_WORKER_H_
+
+#include "af.h"
+#include "fm_tuner.h"
+
+/* Commandes exécutées par le thread du tuner. */
+#define TUNER_CMD_VOLUME 0 /* value: volume. */
+#define TUNER_CMD_CHANNEL 1 /* value: channel. */
+#define TUNER_CMD_SEEK 2 /* value: FM_TUNER_SEEKUP ou FM_TUNER_SEEKDOWN. */
+#define TUNER_CMD_READ_RSSI 3
+#define TUNER_CMD_AF_LIST 5 /* value: PI, les AF suivent en TUNER_CMD_AF_ADD. */
+#define TUNER_CMD_AF_ADD 6 /* value: channel d'une AF. */
+
+/* Résultats publiés par le thread du tuner. */
+#define TUNER_RESULT_VOLUME 0 /* value: nouveau volume. */
+#define TUNER_RESULT_CHANNEL 1 /* value: nouveau channel. */
+#define TUNER_RESULT_RSSI 2 /* value: RSSI. */
+#define TUNER_RESULT_RDS 3 /* blocks, bler: blocks RDS reçus et leurs erreurs. */
+#define TUNER_RESULT_AF 4 /* value: channel après une recherche d'AF. */
+#define TUNER_RESULT_RDS_STATS 5 /* rds_stats: compteurs de la dernière seconde. */
+
+/* Acquisition des groupes RDS pendant une seconde: groupes reçus,
+   groupes manqués d'après leur période, et lectures d'un groupe
+   déjà lu, ignorées. */
+typedef struct Tuner_rds_stats {
+  unsigned long received;
+  unsigned long missed;
+  unsigned long duplicated;
+} Tuner_rds_stats;
+
+typedef struct Tuner_cmd {
+  int type;
+  int value;
+} Tuner_cmd;
+
+typedef struct Tuner_result {
+  int type;
+  int value;
+  uint16_t blocks[RDS_BLOCKS_N];
+  uint8_t bler[RDS_BLOCKS_N];
+
+  /* Recherche d'AF: durées en ms sans son et sur un signal faible,
+     de la détection à la fin de la recherche. */
+  long mute_time;
+  long weak_time;
+
+  Tuner_rds_stats rds_stats;
+} Tuner_result;
+
+/* Thread possédant un tuner: il est le seul à accéder au bus. */
+typedef struct Tuner_worker Tuner_worker;
+
+/* Crée un thread qui prend possession de fm_tuner, exécuté sur le
+   processeur cpu, ou sur n'importe lequel si cpu est négatif.
+   Chaque groupe RDS reçu est publié une seule fois, lu peu après le
+   début de son signalement par le tuner.
+   Si af_rssi est non nul, une AF est cherchée lorsque le RSSI reste
+   sous af_rssi (dBuV).
+   fm_tuner ne doit plus être utilisé ailleurs jusqu'à tuner_worker_free. */
+Tuner_worker *tuner_worker_new (Fm_tuner *fm_tuner, int cpu, int af_rssi);
+
+/* Arrête le thread et le libère. Le tuner n'est pas libéré. */
+void tuner_worker_free (Tuner_worker *worker);
+
+/* Envoie une commande au thread.
+   Retourne -1 si la file des commandes est pleine, sinon 0. */
+int tuner_worker_send (Tuner_worker *worker, int type, int value);
+
+/* Descripteur lisible lorsque des résultats sont disponibles. */
+int tuner_worker_get_fd (Tuner_worker *worker);
+
+/* Acquitte le descripteur de tuner_worker_get_fd. A appeler avant
+   de lire les résultats avec tuner_worker_receive. */
+void tuner_worker_ack (Tuner_worker *worker);
+
+/* Récupère un résultat du thread.
+   Retourne -1 s'il n'y a aucun résultat, sinon 0. */
+int tuner_worker_receive (Tuner_worker *worker, Tuner_result *result);
+
+#endif /* _TUNER_WORKER_H_ INCLUDED */
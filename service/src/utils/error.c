@@ -48,12 +48,14 @@ int error (const char *msg, ...) {
   return -1;
 }
 
-void debug (const char *format, ...) {
-  va_list ap;
+#ifdef DEBUG
+  void debug (const char *format, ...) {
+    va_list ap;
 
-  va_start(ap, format);
-  vfprintf(stderr, format, ap);
-  va_end(ap);
+    va_start(ap, format);
+    vfprintf(stderr, format, ap);
+    va_end(ap);
 
-  return;
-}
+    return;
+  }
+#endif
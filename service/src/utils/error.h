@@ -31,7 +31,7 @@ int error (const char *msg, ...);
   /* Affiche un message de debug sur stderr. */
   void debug (const char *format, ...);
 #else
-  #define debug()
+  #define debug(...)
 #endif
 
 #endif /* _ERROR_H_ INCLUDED */
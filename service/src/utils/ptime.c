@@ -39,3 +39,7 @@ void time_get_cur (Time *time) {
 long time_diff (Time *time1, Time *time2) {
   return (time2->tv_usec  - time1->tv_usec) / 1000.0 + (time2->tv_sec - time1->tv_sec) * 1000.0;
 }
+
+long time_diff_u (Time *time1, Time *time2) {
+  return (time2->tv_sec - time1->tv_sec) * 1000000L + (time2->tv_usec - time1->tv_usec);
+}
@@ -29,4 +29,7 @@ void time_get_cur (Time *time);
 /* Retourne la différence entre 2 temps en millisecondes. */
 long time_diff (Time *time1, Time *time2);
 
+/* Retourne la différence entre 2 temps en microsecondes. */
+long time_diff_u (Time *time1, Time *time2);
+
 #endif /* _PTIME_H_ INCLUDED */
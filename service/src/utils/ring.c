@@ -0,0 +1,138 @@
+/*
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ring.h"
+
+/* Documentation: http://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue */
+
+/* Taille d'une ligne de cache: évite que producteurs et consommateurs
+   modifient la même ligne. */
+#define CACHE_LINE_SIZE 64
+
+typedef unsigned long Ring_seq;
+
+struct Ring {
+  char *cells; /* Chaque cellule: un numéro de séquence puis l'élément. */
+  size_t cell_size;
+  size_t elem_size;
+  Ring_seq mask;
+
+  char pad0[CACHE_LINE_SIZE];
+  Ring_seq head; /* Prochaine position d'écriture. */
+  char pad1[CACHE_LINE_SIZE];
+  Ring_seq tail; /* Prochaine position de lecture. */
+  char pad2[CACHE_LINE_SIZE];
+};
+
+static inline Ring_seq *__get_seq (Ring *ring, Ring_seq pos) {
+  return (Ring_seq *)(ring->cells + (pos & ring->mask) * ring->cell_size);
+}
+
+static inline void *__get_data (Ring_seq *seq) {
+  return (char *)seq + sizeof(Ring_seq) * 2;
+}
+
+Ring *ring_new (size_t elem_size, unsigned int size) {
+  Ring *ring;
+  Ring_seq n = 1, i;
+
+  if (size == 0 || (ring = calloc(1, sizeof *ring)) == NULL)
+    return NULL;
+
+  while (n < size)
+    n <<= 1;
+
+  /* Cellules alignées sur 2 Ring_seq pour les données. */
+  ring->elem_size = elem_size;
+  ring->cell_size = sizeof(Ring_seq) * 2 + elem_size;
+  ring->cell_size += (sizeof(Ring_seq) * 2 - ring->cell_size % (sizeof(Ring_seq) * 2)) % (sizeof(Ring_seq) * 2);
+  ring->mask = n - 1;
+
+  if ((ring->cells = malloc(n * ring->cell_size)) == NULL) {
+    free(ring);
+    return NULL;
+  }
+
+  for (i = 0; i < n; i++)
+    *__get_seq(ring, i) = i;
+
+  return ring;
+}
+
+void ring_free (Ring *ring) {
+  if (ring != NULL) {
+    free(ring->cells);
+    free(ring);
+  }
+
+  return;
+}
+
+int ring_push (Ring *ring, const void *elem) {
+  Ring_seq pos = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+  Ring_seq *seq;
+  long diff;
+
+  for (;;) {
+    seq = __get_seq(ring, pos);
+    diff = (long)(__atomic_load_n(seq, __ATOMIC_ACQUIRE) - pos);
+
+    /* Cellule libre: on tente de la réserver. */
+    if (diff == 0) {
+      if (__atomic_compare_exchange_n(&ring->head, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        break;
+    }
+    /* Cellule encore occupée: file pleine. */
+    else if (diff < 0)
+      return -1;
+    else
+      pos = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+  }
+
+  memcpy(__get_data(seq), elem, ring->elem_size);
+  __atomic_store_n(seq, pos + 1, __ATOMIC_RELEASE);
+
+  return 0;
+}
+
+int ring_pop (Ring *ring, void *elem) {
+  Ring_seq pos = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+  Ring_seq *seq;
+  long diff;
+
+  for (;;) {
+    seq = __get_seq(ring, pos);
+    diff = (long)(__atomic_load_n(seq, __ATOMIC_ACQUIRE) - (pos + 1));
+
+    /* Cellule remplie: on tente de la réserver. */
+    if (diff == 0) {
+      if (__atomic_compare_exchange_n(&ring->tail, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        break;
+    }
+    /* Cellule pas encore écrite: file vide. */
+    else if (diff < 0)
+      return -1;
+    else
+      pos = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+  }
+
+  memcpy(elem, __get_data(seq), ring->elem_size);
+  __atomic_store_n(seq, pos + ring->mask + 1, __ATOMIC_RELEASE);
+
+  return 0;
+}
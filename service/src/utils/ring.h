@@ -0,0 +1,41 @@
+/*
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _RING_H_
+#define _RING_H_
+
+#include <stddef.h>
+
+/* File bornée sans verrou, utilisable par plusieurs producteurs
+   et plusieurs consommateurs. Les éléments sont copiés. */
+typedef struct Ring Ring;
+
+/* Crée une file pouvant contenir size éléments de elem_size bytes.
+   size est arrondi à la puissance de 2 supérieure.
+   Retourne une nouvelle file ou NULL en cas d'erreur. */
+Ring *ring_new (size_t elem_size, unsigned int size);
+
+/* Libère une file. */
+void ring_free (Ring *ring);
+
+/* Ajoute une copie de elem à la fin de la file.
+   Retourne -1 si la file est pleine, sinon 0. */
+int ring_push (Ring *ring, const void *elem);
+
+/* Retire le premier élément de la file et le copie dans elem.
+   Retourne -1 si la file est vide, sinon 0. */
+int ring_pop (Ring *ring, void *elem);
+
+#endif /* _RING_H_ INCLUDED */
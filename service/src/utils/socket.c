@@ -13,6 +13,8 @@
   along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#define _GNU_SOURCE /* accept4. */
+
 #include <errno.h>
 #include <stdlib.h>
 #include <string.h> /* memcpy */
@@ -20,6 +22,7 @@
 #if defined __unix__
   #include <fcntl.h> /* fcntl & O_NONBLOCK */
   #include <netdb.h> /* gethostbyname */
+  #include <sys/epoll.h>
   #include <unistd.h> /* close */
 #endif
 
@@ -34,7 +37,11 @@ struct Socket_set {
   Socket *socks;
   int n;
   int max_n;
-  int max_fd;
+
+  /* Emplacements libres, utilisés comme une pile. */
+  int *free_ids;
+
+  int epoll_fd;
 };
 
 /* --------------------------------------------------------------------- */
@@ -60,18 +67,23 @@ char *serialize_uint32 (char *buf, uint32_t value) {
   return buf + 4;
 }
 
+/* Attention: char peut être signé, les bytes sont lus en unsigned char. */
 char *deserialize_uint8 (char *buf, uint8_t *value) {
-  *value = buf[0];
+  *value = (unsigned char)buf[0];
   return buf + 1;
 }
 
 char *deserialize_uint16 (char *buf, uint16_t *value) {
-  *value = (buf[0] << 8 | buf[1]);
+  const unsigned char *p = (unsigned char *)buf;
+
+  *value = (p[0] << 8 | p[1]);
   return buf + 2;
 }
 
 char *deserialize_uint32 (char *buf, uint32_t *value) {
-  *value = (buf[0] << 24 | buf[1] << 16 | buf[2] << 8 | buf[3]);
+  const unsigned char *p = (unsigned char *)buf;
+
+  *value = ((uint32_t)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3]);
   return buf + 4;
 }
 
@@ -107,17 +119,25 @@ Socket_set *socket_set_new (int n) {
   if (ss == NULL)
     return NULL;
 
-  if ((ss->socks = malloc(n * sizeof(Socket))) == NULL) {
+  ss->socks = malloc(n * sizeof(Socket));
+  ss->free_ids = malloc(n * sizeof(int));
+
+  if (ss->socks == NULL || ss->free_ids == NULL ||
+      (ss->epoll_fd = epoll_create1(EPOLL_CLOEXEC)) == -1) {
+    free(ss->socks);
+    free(ss->free_ids);
     free(ss);
     return NULL;
   }
 
   ss->max_n = n;
   ss->n = 0;
-  ss->max_fd = 0;
 
-  for (i = 0; i < ss->max_n; i++)
+  /* Les premiers emplacements sont donnés en premier. */
+  for (i = 0; i < ss->max_n; i++) {
     ss->socks[i] = -1;
+    ss->free_ids[i] = ss->max_n - 1 - i;
+  }
 
   return ss;
 }
@@ -132,26 +152,47 @@ void socket_set_free (Socket_set *ss) {
     if (ss->socks[i] != -1)
       close(ss->socks[i]);
 
+  close(ss->epoll_fd);
+
   free(ss->socks);
+  free(ss->free_ids);
   free(ss);
 
   return;
 }
 
+static int __socket_set_ctl (Socket_set *ss, int op, int fd, int id, uint32_t events) {
+  struct epoll_event event;
+
+  memset(&event, 0, sizeof event);
+  event.events = events | EPOLLET;
+  event.data.u32 = id;
+
+  return epoll_ctl(ss->epoll_fd, op, fd, &event);
+}
+
+int socket_set_watch (Socket_set *ss, int fd) {
+  if (fd < 0)
+    return -1;
+
+  return __socket_set_ctl(ss, EPOLL_CTL_ADD, fd, SOCKET_SET_WATCHED, EPOLLIN);
+}
+
 int socket_set_add (Socket_set *ss, Socket sock) {
   int i;
 
   if (sock < 0 || ss->n == ss->max_n)
     return -1;
 
-  for (i = 0; i < ss->max_n && ss->socks[i] != -1; i++);
+  i = ss->free_ids[ss->max_n - 1 - ss->n];
+
+  /* Sur front, EPOLLOUT n'est signalé qu'après un envoi incomplet. */
+  if (__socket_set_ctl(ss, EPOLL_CTL_ADD, sock, i, EPOLLIN | EPOLLOUT) == -1)
+    return -1;
 
   ss->socks[i] = sock;
   ss->n++;
 
-  if (sock > ss->max_fd)
-    ss->max_fd = sock;
-
   return i;
 }
 
@@ -168,17 +209,11 @@ int socket_set_remove (Socket_set *ss, Socket sock) {
     return -1;
 
   /* Trouvé ! */
+  epoll_ctl(ss->epoll_fd, EPOLL_CTL_DEL, sock, NULL);
+
   ss->socks[i] = -1;
   ss->n--;
-
-  /* On met à jour le max_fd. */
-  if (sock == ss->max_fd) {
-    ss->max_fd = 0;
-
-    for (i = 0; i < ss->max_n; i++)
-      if (ss->socks[i] > ss->max_fd)
-        ss->max_fd = ss->socks[i];
-  }
+  ss->free_ids[ss->max_n - 1 - ss->n] = i;
 
   return i;
 }
@@ -187,41 +222,24 @@ Socket socket_set_get (Socket_set *ss, int id) {
   return (id >= 0 && id < ss->max_n) ? ss->socks[id] : -1;
 }
 
-int socket_set_select (Socket_set *ss, Sockets_states *states, int *stdin, int timeout) {
+int socket_set_wait (Socket_set *ss, Sockets_states *states, int timeout) {
+  struct epoll_event events[SOCKETS_STATES_MAX];
   int i, ret;
-  struct timeval tv;
-
-  /* Mise à 0 de l'ensemble. */
-  FD_ZERO(&*states);
 
-  /* Ajout de stdin si demandé. */
-  if (stdin != NULL) {
-    FD_SET(STDIN_FILENO, &*states);
-    *stdin = 0;
-  }
-
-  /* Ajout des sockets dans l'ensemble. */
-  for (i = 0; i < ss->max_n; i++)
-    if (ss->socks[i] != -1)
-      FD_SET(ss->socks[i], &*states);
-
-  /* Timeout. */
-  tv.tv_sec = 0;
-  tv.tv_usec = timeout;
-
-  /* Select. */
   do {
-    ret = select(ss->max_fd + 1, &*states, NULL, NULL, (timeout > 0) ? &tv : NULL);
-  } while (errno == EINTR);
+    ret = epoll_wait(ss->epoll_fd, events, SOCKETS_STATES_MAX, (timeout > 0) ? timeout : -1);
+  } while (ret == -1 && errno == EINTR);
 
-  if (stdin != NULL && FD_ISSET(STDIN_FILENO, &*states))
-    *stdin = 1;
+  states->n = (ret > 0) ? ret : 0;
 
-  return ret;
-}
+  /* Une erreur ou une fermeture est découverte par la lecture. */
+  for (i = 0; i < states->n; i++) {
+    states->ids[i] = (int)events[i].data.u32;
+    states->events[i] = ((events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) ? SOCKET_READABLE : 0) |
+      ((events[i].events & EPOLLOUT) ? SOCKET_WRITABLE : 0);
+  }
 
-int socket_is_ready (Socket socket, Sockets_states *states) {
-  return FD_ISSET(socket, &*states);
+  return ret;
 }
 
 int socket_set_get_size (Socket_set *ss) {
@@ -234,7 +252,7 @@ int socket_set_get_max_size (Socket_set *ss) {
 
 /* --------------------------------------------------------------------- */
 
-Socket tcp_get (IP *ip) {
+Socket tcp_get (IP *ip, int backlog) {
   struct sockaddr_in addr;
   Socket sock;
   int opt = 1; /* Utilisé pour bloquer le EADDRINUSE et mettre en place TCP_NODELAY */
@@ -268,7 +286,7 @@ Socket tcp_get (IP *ip) {
 
     /* Affectation de l'adresse. */
     if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
-       listen(sock, 5) < 0) {
+       listen(sock, backlog) < 0) {
       close(sock);
       return -1;
     }
@@ -284,30 +302,13 @@ Socket tcp_get (IP *ip) {
   return sock;
 }
 
-static inline int __socket_accept_connection (Socket sock) {
-  int optval;
-  socklen_t optlen = sizeof(optval);
-
-  if (getsockopt(sock, SOL_SOCKET, SO_ACCEPTCONN, &optval, &optlen) == -1)
-    return 0;
-
-  return !!optval;
-}
-
 Socket tcp_accept (Socket server) {
-  struct sockaddr_in addr;
-  socklen_t len;
   Socket sock;
 
-  /* La socket donnée n'est pas un socket serveur. */
-  if (!__socket_accept_connection(server))
-    return -1;
-
-  /* Acceptation d'une connexion TCP. */
-  len = sizeof(addr);
-
-  if ((sock = accept(server, (struct sockaddr *)&addr, &len)) < 0)
-    return -1;
+  /* Un socket non serveur est refusé par accept4 (EINVAL). */
+  do {
+    sock = accept4(server, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+  } while (sock == -1 && errno == EINTR);
 
   return sock;
 }
@@ -316,32 +317,48 @@ int tcp_send (Socket sock, void *data, int len) {
   char *p = data;
   int len_s = 0, len_t;
 
-  if (__socket_accept_connection(sock))
-    return -1;
-
-  do {
-    if ((len_t = send(sock, p, len, 0)) > 0) {
+  /* On envoie tant qu'il reste des données à envoyer et que
+     rien de terrible ne se soit passé autre qu'un signal EINTR. */
+  while (len > 0) {
+    if ((len_t = send(sock, p, len, MSG_NOSIGNAL)) > 0) {
       len -= len_t;
       len_s += len_t;
-      p += len;
+      p += len_t;
+    } else if (len_t == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      break; /* Buffer plein. */
+    } else if (len_t == -1 && errno != EINTR) {
+      return -1;
     }
-
-    /* On envoie tant qu'il reste des données à envoyer et que
-       rien de terrible ne se soit passé autre qu'un signal EINTR. */
-  } while (len > 0 && (errno == EINTR || len_t > 0));
+  }
 
   return len_s;
 }
 
+int tcp_sendv (Socket sock, const struct iovec *iov, int n) {
+  struct msghdr msg;
+  ssize_t len;
+
+  /* sendmsg plutôt que writev pour MSG_NOSIGNAL. */
+  memset(&msg, 0, sizeof msg);
+  msg.msg_iov = (struct iovec *)iov;
+  msg.msg_iovlen = n;
+
+  do {
+    len = sendmsg(sock, &msg, MSG_NOSIGNAL);
+  } while (len == -1 && errno == EINTR);
+
+  if (len == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+    return 0;
+
+  return len;
+}
+
 int tcp_recv (Socket sock, void *data, int len) {
   int len_r;
 
-  if (__socket_accept_connection(sock))
-    return -1;
-
   do {
-    len_r = recv(sock, data, len, 0);
-  } while (errno == EINTR);
+    len_r = recv(sock, data, len, MSG_DONTWAIT);
+  } while (len_r == -1 && errno == EINTR);
 
   return len_r;
 }
@@ -352,3 +369,46 @@ void tcp_close (Socket sock) {
 
   return;
 }
+
+/* --------------------------------------------------------------------- */
+
+Socket udp_get_multicast (IP *ip, int ttl) {
+  struct sockaddr_in addr;
+  Socket sock;
+  unsigned char opt = ttl;
+
+  if (!IN_MULTICAST(ntohl(ip->host)))
+    return -1;
+
+  if ((sock = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0)) < 0)
+    return -1;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = ip->port;
+  addr.sin_addr.s_addr = ip->host;
+
+  /* Un socket connecté au groupe n'a plus besoin de l'adresse à chaque envoi. */
+  if (setsockopt(sock, IPPROTO_IP, IP_MULTICAST_TTL, &opt, sizeof(opt)) < 0 ||
+      connect(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+    close(sock);
+    return -1;
+  }
+
+  return sock;
+}
+
+int udp_sendv (Socket sock, const struct iovec *iov, int n) {
+  struct msghdr msg;
+  ssize_t len;
+
+  memset(&msg, 0, sizeof msg);
+  msg.msg_iov = (struct iovec *)iov;
+  msg.msg_iovlen = n;
+
+  do {
+    len = sendmsg(sock, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+  } while (len == -1 && errno == EINTR);
+
+  return len;
+}
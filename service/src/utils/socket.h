@@ -18,7 +18,7 @@
 
 #if defined __unix__ /* UNIX */
   #include <arpa/inet.h> /* in_addr_t, in_port_t */
-  #include <sys/select.h> /* select & fd_set */
+  #include <sys/uio.h> /* struct iovec */
   typedef int Socket;
 #else
   #error "Socket is not compatible with this platform."
@@ -33,7 +33,22 @@ typedef struct IP {
 /* Un ensemble de sockets. */
 typedef struct Socket_set Socket_set;
 
-typedef fd_set Sockets_states;
+/* Nombre max d'emplacements prêts donnés par une attente. */
+#define SOCKETS_STATES_MAX 64
+
+/* Emplacement donné pour un descripteur surveillé par socket_set_watch. */
+#define SOCKET_SET_WATCHED -1
+
+/* Etats d'un emplacement prêt. */
+#define SOCKET_READABLE 1
+#define SOCKET_WRITABLE 2
+
+/* Emplacements prêts après une attente, avec leurs états. */
+typedef struct Sockets_states {
+  int ids[SOCKETS_STATES_MAX];
+  int events[SOCKETS_STATES_MAX];
+  int n;
+} Sockets_states;
 
 /* ---------------------------------------------------------------------- */
 
@@ -70,13 +85,23 @@ int socket_set_add (Socket_set *ss, Socket sock);
    Retourne l'emplacement du socket supprimé ou -1 en cas d'erreur. */
 int socket_set_remove (Socket_set *ss, Socket sock);
 
+/* Surveille un descripteur (pipe, eventfd...) en plus des sockets
+   de l'ensemble, sans lui attribuer d'emplacement. La surveillance
+   est sur front: le descripteur doit être vidé à chaque réveil.
+   Retourne -1 en cas d'erreur, sinon 0. */
+int socket_set_watch (Socket_set *ss, int fd);
+
 /* Retourne une socket en position id ou -1 sinon. */
 Socket socket_set_get (Socket_set *ss, int id);
 
-/* Applique la fonction select à un ensemble de sockets.
-   Retourne -1 en cas d'erreur, ou sinon les sockets ayant reçus des données. */
-int socket_set_select (Socket_set *ss, Sockets_states *states, int *stdin, int timeout);
-int socket_is_ready (Socket socket, Sockets_states *states);
+/* Attend pendant au plus timeout millisecondes (sans limite si
+   timeout <= 0) que des sockets de l'ensemble deviennent lisibles, ou
+   de nouveau inscriptibles après un envoi incomplet.
+   La surveillance est sur front (epoll): une socket prête doit être lue
+   jusqu'à EAGAIN, sinon elle n'est plus signalée avant l'arrivée de
+   nouvelles données. Seules les sockets prêtes sont données dans states.
+   Retourne -1 en cas d'erreur, sinon le nombre d'emplacements prêts. */
+int socket_set_wait (Socket_set *ss, Sockets_states *states, int timeout);
 
 /* Donne la taille actuelle d'un ensemble de sockets.
    Retourne -1 en cas d'erreur, le nombre de sockets sinon. */
@@ -89,22 +114,45 @@ int socket_set_get_max_size (Socket_set *ss);
 /* ---------------------------------------------------------------------- */
 
 /* Obtenir un socket relative à une ip. Que ce soit un socket cliente ou serveur.
+   Un socket serveur est non bloquant, avec une file de backlog connexions
+   en attente d'acceptation (ignoré pour un client).
    Retourne -1 en cas d'échec ou un socket sinon. */
-Socket tcp_get (IP *ip);
+Socket tcp_get (IP *ip, int backlog);
 
-/* Accepte une connexion TCP.
-   Retourne un socket ou -1 en cas d'erreur. */
+/* Accepte une connexion TCP en attente sur un socket serveur. Le socket
+   accepté n'est pas bloquant.
+   Retourne un socket ou -1 en cas d'erreur ou si la file est vide
+   (errno vaut alors EAGAIN ou EWOULDBLOCK). */
 Socket tcp_accept (Socket server);
 
-/* Envoit des données à partir d'un socket.
+/* Envoit des données à partir d'un socket. Un socket non bloquant
+   n'envoie que ce que son buffer peut contenir.
    Retourne -1 en cas d'échec ou le nombre d'octets envoyés. */
 int tcp_send (Socket sock, void *data, int len);
 
-/* Reçoit des données à partir d'un socket.
-   Retourne -1 en cas d'échec ou le nombre d'octets reçus. */
+/* Envoie n buffers en un appel système, comme writev.
+   Retourne -1 en cas d'échec ou le nombre d'octets envoyés, 0 si le
+   buffer du socket est plein. */
+int tcp_sendv (Socket sock, const struct iovec *iov, int n);
+
+/* Reçoit des données à partir d'un socket, sans bloquer.
+   Retourne -1 en cas d'échec ou si rien n'est disponible (errno vaut
+   alors EAGAIN ou EWOULDBLOCK), 0 si la connexion est fermée, sinon
+   le nombre d'octets reçus. */
 int tcp_recv (Socket sock, void *data, int len);
 
 /* Ferme un socket. */
 void tcp_close (Socket sock);
 
+/* ---------------------------------------------------------------------- */
+
+/* Obtenir un socket UDP qui envoie au groupe multicast ip. Ses datagrammes
+   traversent au plus ttl routeurs.
+   Retourne -1 en cas d'échec ou un socket sinon. */
+Socket udp_get_multicast (IP *ip, int ttl);
+
+/* Envoie n buffers dans un datagramme, sans bloquer.
+   Retourne -1 en cas d'échec ou le nombre d'octets envoyés. */
+int udp_sendv (Socket sock, const struct iovec *iov, int n);
+
 #endif /* _SOCKET_H_ INCLUDED */
@@ -0,0 +1,104 @@
+/*
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+
+#include "hw/i2c.h"
+#include "hw/si4702_emu.h"
+
+#include "fm_tuner.h"
+#include "rds.h"
+
+#include "test.h"
+
+/* Lectures RDS max pour recevoir le nom et le texte d'une station. */
+#define RDS_READS_MAX 4096
+
+/* Décode les groupes reçus jusqu'à avoir le nom et le texte de la station. */
+static void __receive_rds (Fm_tuner *fm_tuner, Rds *rds, const Si4702_emu_station *station) {
+  uint16_t blocks[RDS_BLOCKS_N];
+  uint8_t bler[RDS_BLOCKS_N];
+  int i, state;
+
+  for (i = 0; i < RDS_READS_MAX && (strcmp(rds_get_radio_name(rds), station->ps) ||
+                                    strcmp(rds_get_radio_text(rds), station->rt)); i++) {
+    CHECK(fm_tuner_read_rds(fm_tuner, blocks, bler, &state) == 0);
+
+    if (state == FM_TUNER_RDS_NEW)
+      rds_decode(rds, blocks, bler);
+  }
+
+  CHECK(rds_get_pi(rds) == station->pi);
+  CHECK(!strcmp(rds_get_radio_name(rds), station->ps));
+  CHECK(!strcmp(rds_get_radio_text(rds), station->rt));
+
+  return;
+}
+
+/* Tune, seek et RDS d'un tuner émulé, sans délais ni erreurs. Les
+   stations sont trop faibles pour que le seek s'arrête à côté. */
+int main (void) {
+  static const Si4702_emu_station stations[] = {
+    { 900, 40, 1, 0xF201, 1, 0, 0, "STATIONA", "Station A - Le journal de 13h", { 950 }, 1 },
+    { 950, 42, 1, 0xF202, 10, 0, 0, "STATIONB", "Station B", { 0 }, 0 }
+  };
+  static Si4702_emu_conf emu_conf;
+  Fm_tuner_conf conf = {
+    .pin_sdio = -1,
+    .pin_rst = -1,
+    .pin_gpio2 = -1,
+    .i2c_id = 1,
+    .tuner_addr = 0x10
+  };
+  Fm_tuner *fm_tuner;
+  Rds *rds;
+  int success;
+
+  emu_conf.n_stations = sizeof stations / sizeof *stations;
+  memcpy(emu_conf.stations, stations, sizeof stations);
+  si4702_emu_set_conf(&emu_conf);
+  i2c_set_backend(si4702_emu_get_backend());
+
+  if ((fm_tuner = fm_tuner_new(&conf)) == NULL) {
+    fprintf(stderr, "Unable to open the emulated tuner.\n");
+    return 1;
+  }
+
+  /* Tune: le channel est relu depuis le tuner. */
+  CHECK(fm_tuner_set_channel(fm_tuner, stations[0].channel) == stations[0].channel);
+  CHECK(fm_tuner_get_channel(fm_tuner) == stations[0].channel);
+
+  CHECK(fm_tuner_set_volume(fm_tuner, 9) == 9);
+  CHECK(fm_tuner_get_volume(fm_tuner) == 9);
+
+  rds = rds_new();
+  __receive_rds(fm_tuner, rds, &stations[0]);
+  rds_free(rds);
+
+  /* Seek: la station suivante, puis retour à la précédente. */
+  CHECK(fm_tuner_seek(fm_tuner, FM_TUNER_SEEKUP, &success) == stations[1].channel);
+  CHECK(success);
+
+  rds = rds_new();
+  __receive_rds(fm_tuner, rds, &stations[1]);
+  rds_free(rds);
+
+  CHECK(fm_tuner_seek(fm_tuner, FM_TUNER_SEEKDOWN, &success) == stations[0].channel);
+  CHECK(success);
+
+  fm_tuner_free(fm_tuner);
+
+  return TEST_RESULT;
+}
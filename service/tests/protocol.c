@@ -0,0 +1,337 @@
+/*
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "hw/i2c.h"
+#include "hw/si4702_emu.h"
+#include "net/handler.h"
+#include "utils/ptime.h"
+#include "utils/socket.h"
+
+#include "fm_tuner.h"
+#include "rds.h"
+
+#include "test.h"
+
+#define PORT_BASE 20000
+
+/* Durée en ms sans données après laquelle une réponse est complète. */
+#define RECEIVE_IDLE 300
+#define CONNECT_TRIES 50
+
+#define RECEIVE_BUFFER_SIZE 65536
+
+/* Events des clients, voir handler.c. */
+#define EVENT_MALFORMED_MESSAGE 0x00
+#define EVENT_VOLUME 0x01
+#define EVENT_CHANNEL 0x02
+#define EVENT_RADIO_NAME 0x05
+#define EVENT_RADIO_TEXT 0x06
+#define EVENT_STATION 0x07
+#define EVENT_PRESET 0x08
+#define EVENT_TUNER 0x0A
+#define EVENT_RDS_PROVISIONAL 0x0B
+#define EVENT_RADIO_TEXT_PART 0x0C
+#define EVENT_PROTOCOL 0x0D
+
+#define MESSAGE_V1_LENGTH_MAX 127
+
+/* Events trouvés dans une suite de messages. */
+typedef struct Received {
+  int events[256];
+  int volume; /* Dernier volume reçu. */
+  int max_length;
+  int malformed; /* Messages dont les events dépassent la longueur. */
+} Received;
+
+/* Taille d'un event envoyé aux clients. */
+static int __get_event_size (const uint8_t *event) {
+  switch (*event) {
+    case EVENT_VOLUME:
+    case EVENT_TUNER:
+    case EVENT_RDS_PROVISIONAL:
+    case EVENT_PROTOCOL:
+      return 2;
+    case EVENT_CHANNEL:
+      return 3;
+    case EVENT_RADIO_NAME:
+    case EVENT_RADIO_TEXT:
+      return 2 + event[1];
+    case EVENT_STATION:
+      return 7 + event[6];
+    case EVENT_PRESET:
+      return 4;
+    case EVENT_RADIO_TEXT_PART:
+      return 3 + event[2];
+  }
+
+  return 1;
+}
+
+/* Compte les events de messages, dont la longueur est sur header bytes,
+   jusqu'au message qui change de protocole inclus. Retourne la taille
+   des messages lus. */
+static int __read_messages (const uint8_t *buf, int len, int header, Received *received) {
+  int n = 0, length, protocol = 0, i;
+
+  while (!protocol && len - n >= header) {
+    length = header == 1 ? buf[n] : (buf[n] << 8) | buf[n + 1];
+
+    if (length <= header || len - n < length)
+      break;
+
+    for (i = n + header; i < n + length; i += __get_event_size(buf + i)) {
+      received->events[buf[i]]++;
+
+      if (buf[i] == EVENT_VOLUME)
+        received->volume = buf[i + 1];
+      else if (buf[i] == EVENT_PROTOCOL)
+        protocol = 1;
+    }
+
+    if (i != n + length)
+      received->malformed++;
+
+    if (length > received->max_length)
+      received->max_length = length;
+
+    n += length;
+  }
+
+  return n;
+}
+
+/* Reçoit jusqu'à RECEIVE_IDLE ms sans données ou la fermeture de la
+   connexion. Retourne la taille reçue, *closed vaut 1 si la connexion
+   est fermée. */
+static int __receive (Socket sock, uint8_t *buf, int size, int *closed) {
+  struct pollfd pfd = { .fd = sock, .events = POLLIN };
+  int len = 0, n;
+
+  *closed = 0;
+
+  while (len < size && poll(&pfd, 1, RECEIVE_IDLE) > 0) {
+    if ((n = tcp_recv(sock, buf + len, size - len)) == 0) {
+      *closed = 1;
+      break;
+    }
+
+    if (n > 0)
+      len += n;
+  }
+
+  return len;
+}
+
+static Socket __connect (in_port_t port) {
+  Socket sock = -1;
+  IP ip;
+  int i;
+
+  if (resolve_host(&ip, "127.0.0.1", port) == -1)
+    return -1;
+
+  /* Le serveur peut ne pas encore écouter. */
+  for (i = 0; i < CONNECT_TRIES && (sock = tcp_get(&ip, 0)) == -1; i++)
+    sleep_m(20);
+
+  return sock;
+}
+
+static void *__run_server (void *arg) {
+  server_run(arg, HANDLER_LOOP_DELAY);
+  return NULL;
+}
+
+/* ---------------------------------------------------------------------- */
+
+/* Un client v1 ne reçoit que les events d'origine, en messages d'au
+   plus 127 bytes, et ne peut pas envoyer les events de la v2. */
+static void __test_v1 (in_port_t port) {
+  static const uint8_t preset[] = { 3, EVENT_PRESET, 0 };
+  static uint8_t buf[RECEIVE_BUFFER_SIZE];
+  Received received;
+  Socket sock;
+  int len, closed, i;
+
+  CHECK((sock = __connect(port)) != -1);
+
+  memset(&received, 0, sizeof received);
+  len = __receive(sock, buf, sizeof buf, &closed);
+
+  CHECK(__read_messages(buf, len, 1, &received) == len);
+  CHECK(received.malformed == 0);
+  CHECK(received.max_length <= MESSAGE_V1_LENGTH_MAX);
+  CHECK(received.events[EVENT_VOLUME] == 1);
+  CHECK(received.events[EVENT_CHANNEL] == 1);
+
+  for (i = 0; i < 256; i++)
+    if (i != EVENT_VOLUME && i != EVENT_CHANNEL && i != EVENT_RADIO_NAME && i != EVENT_RADIO_TEXT)
+      CHECK(received.events[i] == 0);
+
+  /* EVENT_PRESET est de la v2: le client est déconnecté. */
+  CHECK(tcp_send(sock, (void *)preset, sizeof preset) == sizeof preset);
+
+  len = __receive(sock, buf, sizeof buf, &closed);
+  CHECK(len >= 2 && buf[len - 2] == 2 && buf[len - 1] == EVENT_MALFORMED_MESSAGE);
+  CHECK(closed);
+
+  tcp_close(sock);
+
+  return;
+}
+
+/* Un client qui passe en v2 reçoit l'acquittement en v1, puis tout
+   l'état en v2, et peut envoyer des messages de plus de 127 bytes. */
+static void __test_v2 (in_port_t port) {
+  static const uint8_t protocol[] = { 3, EVENT_PROTOCOL, 2 };
+  static uint8_t buf[RECEIVE_BUFFER_SIZE];
+  uint8_t volumes[200];
+  Received received;
+  Socket sock;
+  int len, n, closed, i;
+
+  CHECK((sock = __connect(port)) != -1);
+
+  /* Etat v1 de l'arrivée. */
+  len = __receive(sock, buf, sizeof buf, &closed);
+  memset(&received, 0, sizeof received);
+  CHECK(__read_messages(buf, len, 1, &received) == len);
+
+  CHECK(tcp_send(sock, (void *)protocol, sizeof protocol) == sizeof protocol);
+
+  /* Des broadcasts v1 peuvent précéder l'acquittement. */
+  len = __receive(sock, buf, sizeof buf, &closed);
+
+  memset(&received, 0, sizeof received);
+  n = __read_messages(buf, len, 1, &received);
+  CHECK(received.events[EVENT_PROTOCOL] == 1);
+  CHECK(n >= 3 && !memcmp(buf + n - sizeof protocol, protocol, sizeof protocol));
+
+  memset(&received, 0, sizeof received);
+  CHECK(n + __read_messages(buf + n, len - n, 2, &received) == len);
+  CHECK(received.malformed == 0);
+  CHECK(received.events[EVENT_VOLUME] == 1);
+  CHECK(received.events[EVENT_CHANNEL] == 1);
+  CHECK(received.events[EVENT_RDS_PROVISIONAL] >= 1);
+
+  /* 99 volumes: le dernier est appliqué. */
+  volumes[0] = 0;
+  volumes[1] = sizeof volumes;
+
+  for (i = 2; i < (int)sizeof volumes; i += 2) {
+    volumes[i] = EVENT_VOLUME;
+    volumes[i + 1] = i / 2 % 16;
+  }
+
+  CHECK(tcp_send(sock, volumes, sizeof volumes) == sizeof volumes);
+
+  len = __receive(sock, buf, sizeof buf, &closed);
+  CHECK(!closed);
+
+  memset(&received, 0, sizeof received);
+  CHECK(__read_messages(buf, len, 2, &received) == len);
+  CHECK(received.events[EVENT_MALFORMED_MESSAGE] == 0);
+  CHECK(received.events[EVENT_VOLUME] == 1);
+  CHECK(received.volume == volumes[sizeof volumes - 1]);
+
+  tcp_close(sock);
+
+  return;
+}
+
+/* Échanges d'un client en v1 et en v2 avec le service et un tuner
+   émulé. */
+int main (void) {
+  static const Si4702_emu_station stations[] = {
+    { 900, 40, 1, 0xF201, 1, 0, 0, "STATIONA", "Station A - Le journal de 13h", { 0 }, 0 }
+  };
+  static Si4702_emu_conf emu_conf;
+  static Handler_value value;
+  static Server_conf server_conf = {
+    .max_clients = 4,
+    .backlog = 4,
+    .queue_size = RECEIVE_BUFFER_SIZE,
+    .overflow = SERVER_OVERFLOW_COALESCE,
+    .user_value = &value,
+    .handlers = {
+      .event = handler_event,
+      .join = handler_join,
+      .quit = handler_quit,
+      .loop = handler_loop
+    }
+  };
+  Fm_tuner_conf conf = {
+    .pin_sdio = -1,
+    .pin_rst = -1,
+    .pin_gpio2 = -1,
+    .i2c_id = 1,
+    .tuner_addr = 0x10
+  };
+  Handler_tuner *tuner = &value.tuners[0];
+  Fm_tuner *fm_tuner;
+  pthread_t server;
+  sigset_t set;
+
+  emu_conf.n_stations = sizeof stations / sizeof *stations;
+  memcpy(emu_conf.stations, stations, sizeof stations);
+  si4702_emu_set_conf(&emu_conf);
+  i2c_set_backend(si4702_emu_get_backend());
+
+  if ((fm_tuner = fm_tuner_new(&conf)) == NULL) {
+    fprintf(stderr, "Unable to open the emulated tuner.\n");
+    return 1;
+  }
+
+  fm_tuner_set_channel(fm_tuner, stations[0].channel);
+
+  tuner->volume = fm_tuner_get_volume(fm_tuner);
+  tuner->channel = fm_tuner_get_channel(fm_tuner);
+  tuner->rds = rds_new();
+  value.rds_cache = rds_cache_new();
+  value.n_tuners = 1;
+  handler_restore(&value, 0);
+
+  tuner->worker = tuner_worker_new(fm_tuner, -1, 0);
+  server_conf.wakeup_fds[server_conf.n_wakeup_fds++] = tuner_worker_get_fd(tuner->worker);
+  server_conf.port = PORT_BASE + getpid() % 10000;
+
+  /* SIGINT, qui arrête le serveur, n'est reçu que par son thread. */
+  sigemptyset(&set);
+  sigaddset(&set, SIGINT);
+  pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+  if (pthread_create(&server, NULL, __run_server, &server_conf) != 0) {
+    fprintf(stderr, "Unable to create the server thread.\n");
+    return 1;
+  }
+
+  __test_v1(server_conf.port);
+  __test_v2(server_conf.port);
+
+  kill(getpid(), SIGINT);
+  pthread_join(server, NULL);
+
+  tuner_worker_free(tuner->worker);
+  rds_free(tuner->rds);
+  rds_cache_free(value.rds_cache);
+
+  return TEST_RESULT;
+}
@@ -0,0 +1,223 @@
+/*
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <pthread.h>
+#include <string.h>
+
+#include "rds.h"
+
+#include "test.h"
+
+#define PI 0xF201
+
+/* Mises à jour de la vue: les générations dépassent 16 bits. */
+#define SNAPSHOT_UPDATES 70000
+
+/* Codes AF: nombre de fréquences de la liste et fréquence en 100 kHz. */
+#define AF_COUNT(N) (224 + (N))
+#define AF(CHANNEL) ((CHANNEL) - 875)
+
+#define AF_PAIR(FIRST, SECOND) (uint16_t)(((FIRST) << 8) | (SECOND))
+
+/* Groupes d'un lot: au moins 4 pour les comparaisons SSE2. */
+#define BATCH_GROUPS 4
+
+/* BLER essayés sur chaque block: ceux du tuner et des valeurs dont le
+   bit de poids fort est à 1. */
+static const uint8_t blers[] = {
+  RDS_BLER_NONE, RDS_BLER_1_2, RDS_BLER_3_5, RDS_BLER_UNCORRECTABLE, 0x7F, 0x80, 0xFF
+};
+
+#define BLERS_N (sizeof blers / sizeof *blers)
+
+/* Décode un groupe 0A sans erreur dont le block C porte un couple d'AF. */
+static void __decode_af_pair (Rds *rds, uint16_t pair) {
+  uint16_t blocks[RDS_BLOCKS_N] = { PI, 0x0000, pair, 0x2020 };
+  const uint8_t bler[RDS_BLOCKS_N] = { 0 };
+
+  rds_decode(rds, blocks, bler);
+
+  return;
+}
+
+/* Vérifie que les AF publiées sont exactement channels. */
+static int __has_afs (Rds *rds, const int *channels, int n) {
+  const int *afs;
+
+  return rds_get_alternative_frequencies(rds, &afs) == n && !memcmp(afs, channels, n * sizeof *afs);
+}
+
+/* Méthode A: la liste donne directement les AF. */
+static void __test_af_method_a (void) {
+  static const int channels[] = { 938, 1011, 1043 };
+  Rds *rds = rds_new();
+
+  rds_set_channel(rds, 979);
+
+  __decode_af_pair(rds, AF_PAIR(AF_COUNT(3), AF(938)));
+  CHECK(__has_afs(rds, NULL, 0));
+
+  __decode_af_pair(rds, AF_PAIR(AF(1011), AF(1043)));
+  CHECK(__has_afs(rds, channels, 3));
+
+  rds_free(rds);
+
+  return;
+}
+
+/* Méthode B: chaque couple répète la fréquence réglée, qui n'est pas
+   une AF. La liste est publiée dès son dernier couple. */
+static void __test_af_method_b (void) {
+  static const int channels[] = { 938, 1011, 1043 };
+  Rds *rds = rds_new();
+
+  rds_set_channel(rds, 979);
+
+  __decode_af_pair(rds, AF_PAIR(AF_COUNT(7), AF(979)));
+  __decode_af_pair(rds, AF_PAIR(AF(979), AF(938)));
+  __decode_af_pair(rds, AF_PAIR(AF(1011), AF(979)));
+  CHECK(__has_afs(rds, NULL, 0));
+
+  __decode_af_pair(rds, AF_PAIR(AF(979), AF(1043)));
+  CHECK(__has_afs(rds, channels, 3));
+
+  /* Liste répétée: rien ne change. */
+  __decode_af_pair(rds, AF_PAIR(AF_COUNT(7), AF(979)));
+  __decode_af_pair(rds, AF_PAIR(AF(979), AF(938)));
+  CHECK(__has_afs(rds, channels, 3));
+
+  rds_free(rds);
+
+  return;
+}
+
+/* Rejets d'un groupe 0A décodé par rds_decode si n vaut 0, sinon à la
+   position index d'un lot de n groupes, les autres étant sans erreur. */
+static void __get_rejects (const uint8_t bler[RDS_BLOCKS_N], size_t n, size_t index, Rds_stats *stats) {
+  uint16_t groups[BATCH_GROUPS][RDS_BLOCKS_N];
+  uint8_t blers_batch[BATCH_GROUPS][RDS_BLOCKS_N];
+  Rds *rds = rds_new();
+  size_t i;
+
+  memset(blers_batch, RDS_BLER_NONE, sizeof blers_batch);
+
+  for (i = 0; i < BATCH_GROUPS; i++) {
+    groups[i][0] = PI;
+    groups[i][1] = 0x0000;
+    groups[i][2] = 0x0000;
+    groups[i][3] = 0x4142;
+  }
+
+  if (n == 0)
+    rds_decode(rds, groups[0], bler);
+  else {
+    memcpy(blers_batch[index], bler, RDS_BLOCKS_N);
+    rds_decode_batch(rds, groups, (const uint8_t (*)[RDS_BLOCKS_N])blers_batch, n, NULL, NULL);
+  }
+
+  rds_get_stats(rds, stats);
+  rds_free(rds);
+
+  return;
+}
+
+/* Les blocks valides d'un lot, calculés par SSE2 pour 4 groupes et
+   sur 32 bits pour un groupe seul, sont ceux de rds_decode: mêmes
+   blocks et groupes rejetés, à chaque position du lot. */
+static void __test_batch_valid_blocks (void) {
+  uint8_t bler[RDS_BLOCKS_N];
+  Rds_stats expected, stats;
+  size_t combination, index, i;
+  int mismatches = 0;
+
+  for (combination = 0; combination < BLERS_N * BLERS_N * BLERS_N * BLERS_N; combination++) {
+    for (i = 0, index = combination; i < RDS_BLOCKS_N; i++, index /= BLERS_N)
+      bler[i] = blers[index % BLERS_N];
+
+    __get_rejects(bler, 0, 0, &expected);
+
+    for (index = 0; index <= BATCH_GROUPS; index++) {
+      /* Un groupe seul, puis chaque position d'un lot complet. */
+      if (index == BATCH_GROUPS)
+        __get_rejects(bler, 1, 0, &stats);
+      else
+        __get_rejects(bler, BATCH_GROUPS, index, &stats);
+
+      mismatches += stats.rejected_blocks != expected.rejected_blocks ||
+        stats.rejected_groups != expected.rejected_groups;
+    }
+  }
+
+  CHECK(mismatches == 0);
+
+  return;
+}
+
+/* Change le nom à chaque mise à jour: chaque génération de la vue est
+   aussi celle du nom. */
+static void *__update_snapshots (void *arg) {
+  Rds *rds = arg;
+  int i;
+
+  for (i = 0; i < SNAPSHOT_UPDATES; i++)
+    rds_set_station(rds, PI, 10, (i & 1) ? "BBBBBBBB" : "AAAAAAAA", "");
+
+  return NULL;
+}
+
+/* Lectures concurrentes des mises à jour: les générations ne reculent
+   pas et chaque vue copiée est cohérente. */
+static void __test_snapshot_reads (void) {
+  Rds *rds = rds_new();
+  Rds_snapshot snapshot;
+  pthread_t thread;
+  uint32_t gen, prev = 0;
+  int backward = 0, torn = 0;
+
+  if (pthread_create(&thread, NULL, __update_snapshots, rds) != 0) {
+    fprintf(stderr, "Unable to create the writer thread.\n");
+    test_failures++;
+    return;
+  }
+
+  while ((gen = rds_get_generation(rds, RDS_FIELD_ANY)) < SNAPSHOT_UPDATES) {
+    backward += gen < prev;
+    prev = gen;
+
+    rds_get_snapshot(rds, &snapshot);
+    torn += snapshot.gens[RDS_FIELD_ANY] != 0 &&
+      (snapshot.gens[RDS_FIELD_NAME] != snapshot.gens[RDS_FIELD_ANY] ||
+       strcmp(snapshot.radio_name, (snapshot.gens[RDS_FIELD_ANY] & 1) ? "AAAAAAAA" : "BBBBBBBB"));
+  }
+
+  pthread_join(thread, NULL);
+
+  CHECK(backward == 0);
+  CHECK(torn == 0);
+  CHECK(rds_get_generation(rds, RDS_FIELD_ANY) == SNAPSHOT_UPDATES);
+
+  rds_free(rds);
+
+  return;
+}
+
+int main (void) {
+  __test_af_method_a();
+  __test_af_method_b();
+  __test_batch_valid_blocks();
+  __test_snapshot_reads();
+
+  return TEST_RESULT;
+}
@@ -0,0 +1,181 @@
+/*
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "store.h"
+
+#include "test.h"
+
+#define FILENAME_TEMPLATE "/tmp/fmtuner-store-XXXXXX"
+
+/* Lit tout le fichier du store dans buf, qui doit être libéré.
+   Retourne la taille lue. */
+static size_t __read_file (const char *filename, char **buf) {
+  struct stat st;
+  int fd = open(filename, O_RDONLY);
+
+  if (fd == -1 || fstat(fd, &st) == -1 ||
+      (*buf = malloc(st.st_size)) == NULL || read(fd, *buf, st.st_size) != st.st_size) {
+    fprintf(stderr, "Unable to read %s.\n", filename);
+    exit(1);
+  }
+
+  close(fd);
+
+  return st.st_size;
+}
+
+/* Simule une écriture interrompue de la dernière mise à jour: le
+   dernier byte qu'elle a changé par rapport à before est remis à sa
+   valeur d'avant. */
+static void __tear_last_update (const char *filename, const char *before, size_t size) {
+  char *after;
+  size_t i, last = size;
+  int fd;
+
+  CHECK(__read_file(filename, &after) == size);
+
+  for (i = 0; i < size; i++)
+    if (before[i] != after[i])
+      last = i;
+
+  CHECK(last != size);
+
+  if ((fd = open(filename, O_WRONLY)) == -1 || pwrite(fd, before + last, 1, last) != 1) {
+    fprintf(stderr, "Unable to write %s.\n", filename);
+    exit(1);
+  }
+
+  close(fd);
+  free(after);
+
+  return;
+}
+
+static void __make_station (Store_station *station, int channel, const char *name, const char *text) {
+  memset(station, 0, sizeof *station);
+  station->channel = channel;
+  station->rssi = 42;
+  station->pty = 10;
+  station->pi = 0xF201;
+  strcpy(station->name, name);
+  strcpy(station->text, text);
+
+  return;
+}
+
+static int __is_same_station (const Store_station *a, const Store_station *b) {
+  return a->channel == b->channel && a->rssi == b->rssi && a->pty == b->pty && a->pi == b->pi &&
+    !strcmp(a->name, b->name) && !strcmp(a->text, b->text);
+}
+
+/* Une copie d'état à moitié écrite: la copie précédente est relue,
+   puis la mise à jour suivante remplace la copie invalide. */
+static void __test_torn_state (const char *filename) {
+  Store_state state = { .channel = 938, .volume = 5 }, read;
+  Store *store;
+  size_t size;
+  char *before;
+
+  CHECK((store = store_open(filename)) != NULL);
+  store_set_state(store, 0, &state);
+  store_close(store);
+
+  size = __read_file(filename, &before);
+
+  CHECK((store = store_open(filename)) != NULL);
+  state.channel = 1011;
+  store_set_state(store, 0, &state);
+  store_close(store);
+
+  __tear_last_update(filename, before, size);
+  free(before);
+
+  CHECK((store = store_open(filename)) != NULL);
+  CHECK(store_get_state(store, 0, &read) == 0);
+  CHECK(read.channel == 938 && read.volume == 5);
+
+  state.channel = 1058;
+  store_set_state(store, 0, &state);
+  store_close(store);
+
+  CHECK((store = store_open(filename)) != NULL);
+  CHECK(store_get_state(store, 0, &read) == 0);
+  CHECK(read.channel == 1058);
+  CHECK(store_get_state(store, 1, &read) == -1);
+  store_close(store);
+
+  return;
+}
+
+/* Idem pour une station, le nom et le texte étant copiés par le store. */
+static void __test_torn_station (const char *filename) {
+  Store_station first, second, read;
+  Store *store;
+  size_t size;
+  char *before;
+
+  __make_station(&first, 889, "STATIONA", "Le journal de 13h");
+  __make_station(&second, 889, "STATIONB", "Station B - Hit Music Only");
+
+  CHECK((store = store_open(filename)) != NULL);
+  store_set_station(store, &first);
+  store_close(store);
+
+  size = __read_file(filename, &before);
+
+  CHECK((store = store_open(filename)) != NULL);
+  CHECK(store_get_station(store, 889, &read) == 0);
+  CHECK(__is_same_station(&read, &first));
+  store_set_station(store, &second);
+  CHECK(store_get_station(store, 889, &read) == 0);
+  CHECK(__is_same_station(&read, &second));
+  store_close(store);
+
+  __tear_last_update(filename, before, size);
+  free(before);
+
+  CHECK((store = store_open(filename)) != NULL);
+  CHECK(store_get_station(store, 889, &read) == 0);
+  CHECK(__is_same_station(&read, &first));
+  CHECK(store_get_station(store, 938, &read) == -1);
+  store_close(store);
+
+  return;
+}
+
+int main (void) {
+  char filename[] = FILENAME_TEMPLATE;
+  int fd;
+
+  if ((fd = mkstemp(filename)) == -1) {
+    fprintf(stderr, "Unable to create a store file.\n");
+    return 1;
+  }
+
+  close(fd);
+
+  __test_torn_state(filename);
+  __test_torn_station(filename);
+
+  unlink(filename);
+
+  return TEST_RESULT;
+}
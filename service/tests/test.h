@@ -0,0 +1,36 @@
+/*
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _TEST_H_
+#define _TEST_H_
+
+#include <stdio.h>
+
+/* Chaque test est un programme: il retourne TEST_RESULT, non nul si
+   une vérification a échoué. */
+static int test_failures = 0;
+
+/* Vérifie une condition, affiche sa position si elle est fausse. */
+#define CHECK(EXPR)                                                     \
+  do {                                                                  \
+    if (!(EXPR)) {                                                      \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #EXPR); \
+      test_failures++;                                                  \
+    }                                                                   \
+  } while (0)
+
+#define TEST_RESULT (test_failures != 0)
+
+#endif /* _TEST_H_ INCLUDED */